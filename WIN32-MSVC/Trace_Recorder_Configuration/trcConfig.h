@@ -96,8 +96,19 @@ extern "C" {
  * Values:
  * TRC_RECORDER_MODE_SNAPSHOT
  * TRC_RECORDER_MODE_STREAMING
+ *
+ * Snapshot is the default: it keeps the last TRC_CFG_EVENT_BUFFER_SIZE
+ * records and saves them to Trace.dump on an assert, the file read by
+ * analisarastro.c. Define RASTRO_STREAMING in the project's preprocessor
+ * definitions to write the trace continuously to segmented files instead (see
+ * trcStreamingPort.h and the --rastro option), so long runs do not lose their
+ * early events.
  ******************************************************************************/
+#ifdef RASTRO_STREAMING
+#define TRC_CFG_RECORDER_MODE TRC_RECORDER_MODE_STREAMING
+#else
 #define TRC_CFG_RECORDER_MODE TRC_RECORDER_MODE_SNAPSHOT
+#endif
 
 /*******************************************************************************
  * Configuration Macro: TRC_CFG_RECORDER_BUFFER_ALLOCATION
@@ -0,0 +1,64 @@
+/* Standard includes. */
+#include <stdio.h>
+#include <stdint.h>
+
+#include "trcRecorder.h"
+
+#if (TRC_CFG_RECORDER_MODE == TRC_RECORDER_MODE_STREAMING)
+
+static const char *baseRastro = "Trace";
+static FILE *segmento;
+static unsigned numeroSegmento;
+static uint32_t tamanhoSegmento;
+
+void defineArquivoRastro(const char *base) {
+	baseRastro = base;
+}
+
+int32_t leComandoRastro(void *dados, uint32_t tamanho, int32_t *lidos) {
+	(void)dados;
+	(void)tamanho;
+	*lidos = 0;
+	return 0;
+}
+
+static int abreSegmento(void) {
+	char caminho[260];
+	snprintf(caminho, sizeof(caminho), "%s.%03u.psf", baseRastro, numeroSegmento);
+	tamanhoSegmento = 0;
+	if (fopen_s(&segmento, caminho, "wb") != 0) {
+		segmento = NULL;
+		return 0;
+	}
+	return 1;
+}
+
+void abreRastro(void) {
+	if (segmento != NULL)
+		return;
+	numeroSegmento = 0;
+	abreSegmento();
+}
+
+void fechaRastro(void) {
+	if (segmento == NULL)
+		return;
+	fclose(segmento);
+	segmento = NULL;
+}
+
+int32_t escreveRastro(void *dados, uint32_t tamanho, int32_t *escritos) {
+	*escritos = 0;
+	if (segmento != NULL && tamanhoSegmento > 0 && tamanhoSegmento + tamanho > TAMANHO_SEGMENTO_RASTRO) {
+		fclose(segmento);
+		numeroSegmento++;
+		abreSegmento();
+	}
+	if (segmento == NULL || fwrite(dados, 1, tamanho, segmento) != tamanho)
+		return -1;
+	tamanhoSegmento += tamanho;
+	*escritos = (int32_t)tamanho;
+	return 0;
+}
+
+#endif
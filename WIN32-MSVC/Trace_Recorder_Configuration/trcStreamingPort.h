@@ -0,0 +1,35 @@
+#ifndef TRC_STREAMING_PORT_H
+#define TRC_STREAMING_PORT_H
+
+#include <stdint.h>
+
+// Porta de streaming do gravador de rastro (modo TRC_RECORDER_MODE_STREAMING) para arquivo. Os eventos vão para
+// o buffer paginado interno do gravador, o que custa só uma cópia no caminho de quem é rastreado; a tarefa
+// TzCtrl do gravador, acima dos veículos (ver trcStreamingConfig.h), esvazia as páginas prontas no arquivo.
+// O arquivo é dividido em segmentos de até TAMANHO_SEGMENTO_RASTRO bytes, <base>.000.psf, <base>.001.psf, ...,
+// sempre em fronteiras de página, então nenhum evento antigo é sobrescrito e os segmentos concatenados na ordem
+// formam um único rastro válido para o Tracealyzer. Não há canal de comandos: o rastro começa com
+// vTraceEnable(TRC_START) e termina com vTraceStop.
+
+#define TRC_STREAM_PORT_USE_INTERNAL_BUFFER 1
+
+#define TRC_STREAM_PORT_READ_DATA(_ptrData, _size, _ptrBytesRead) leComandoRastro(_ptrData, _size, _ptrBytesRead)
+#define TRC_STREAM_PORT_WRITE_DATA(_ptrData, _size, _ptrBytesWritten) escreveRastro(_ptrData, _size, _ptrBytesWritten)
+#define TRC_STREAM_PORT_ON_TRACE_BEGIN() abreRastro()
+#define TRC_STREAM_PORT_ON_TRACE_END() fechaRastro()
+
+#define TAMANHO_SEGMENTO_RASTRO (64ul * 1024 * 1024)
+
+// Base do nome dos segmentos (padrão "Trace"); deve ser chamada antes de vTraceEnable
+void defineArquivoRastro(const char *base);
+
+// Sem canal de comandos: nunca há nada para ler
+int32_t leComandoRastro(void *dados, uint32_t tamanho, int32_t *lidos);
+
+// Grava uma página no segmento atual, abrindo o próximo quando ele passaria do limite. Retorna 0 se gravou
+int32_t escreveRastro(void *dados, uint32_t tamanho, int32_t *escritos);
+
+void abreRastro(void);
+void fechaRastro(void);
+
+#endif /* TRC_STREAMING_PORT_H */
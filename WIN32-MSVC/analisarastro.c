@@ -0,0 +1,577 @@
+// Analisador de rastros do FreeRTOS+Trace fora do Windows. Lê um Trace.dump gravado em modo snapshot
+// (trcSnapshotConfig.h) e escreve em JSON o tempo de CPU e as ativações de cada tarefa e interrupção, o total de
+// trocas de contexto, o tempo bloqueado em cada fila, semáforo, mutex, grupo de eventos ou notificação de tarefa e os
+// histogramas de latência de escalonamento (do evento de pronto até a tarefa voltar a executar).
+// É um programa à parte, sem FreeRTOS nem API do Windows, e não faz parte do projeto do simulador:
+//     cc -O2 -std=c99 -o analisarastro analisarastro.c
+//     ./analisarastro Trace.dump [saida.json]
+// O formato seguido é o do gravador 3.1 (versão 0x1AA1). O simulador grava em snapshot por padrão; os rastros em
+// streaming (.psf), gravados quando RASTRO_STREAMING é definido (trcConfig.h), não são lidos.
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define VERSAO_SNAPSHOT 0x1AA1
+
+// Classes de objeto do gravador, na ordem da tabela de propriedades
+#define CLASSE_FILA 0
+#define CLASSE_SEMAFORO 1
+#define CLASSE_MUTEX 2
+#define CLASSE_TAREFA 3
+#define CLASSE_ISR 4
+#define CLASSE_TEMPORIZADOR 5
+#define CLASSE_GRUPO_EVENTOS 6
+#define CLASSE_NOTIFICACAO 7 // Não existe no gravador: a notificação de cada tarefa, tratada como um objeto
+#define N_CLASSES 8
+
+// Códigos de evento usados (trcSnapshotKernelPort.h). Os eventos de chamada ao kernel somam a classe do objeto
+#define EV_PARAMETRO_EXTRA 0x01
+#define EV_PRONTO 0x02
+#define EV_NOVO_TICK 0x03
+#define EV_ISR_INICIO 0x04
+#define EV_ISR_RETOMA 0x05
+#define EV_TAREFA_INICIO 0x06
+#define EV_TAREFA_RETOMA 0x07
+#define EV_FECHA_NOME 0x08
+#define EV_FECHA_PROPRIEDADES 0x10
+#define EV_KERNEL 0x18
+#define EV_RECEBE_BLOQUEIO 0x68
+#define EV_ENVIA_BLOQUEIO 0x70
+#define EV_ESPERA_ATE 0x88
+#define EV_ESPERA 0x89
+#define EV_MEMORIA_ALOCA 0x94
+#define EV_MEMORIA_LIBERA 0x96
+#define EV_USUARIO 0x98
+#define EV_XTS8 0xA8
+#define EV_XTS16 0xA9
+#define EV_USUARIO_FIM 0xA7
+#define EV_GRUPO_SYNC_BLOQUEIO 0xC4
+#define EV_GRUPO_ESPERA_BLOQUEIO 0xC6
+#define EV_NOTIFICACAO_TAKE_BLOQUEIO 0xD2
+#define EV_NOTIFICACAO_WAIT_BLOQUEIO 0xD5
+
+#define FAIXAS_LATENCIA 40 // Potências de 2 em microssegundos
+
+// Uma tarefa, interrupção ou objeto do kernel. Como os handles são reusados depois que o objeto é apagado,
+// cada vida de um handle é uma entidade diferente
+typedef struct {
+	char nome[64];
+	int classe;
+	int handle;
+	uint64_t cpu;       // Unidades do relógio do rastro
+	long ativacoes;     // Vezes em que passou a executar
+	long bloqueios;     // Tarefas que bloquearam neste objeto
+	uint64_t bloqueado; // Soma dos tempos bloqueados nele
+	uint64_t maiorBloqueio;
+	long pendentes;     // Tarefas ainda bloqueadas nele no fim do rastro
+	int objetoBloqueio; // Tarefa: objeto em que está bloqueada, ou -1
+	uint64_t inicioBloqueio;
+	int pronta;         // Tarefa: recebeu o evento de pronto e ainda não executou
+	uint64_t instantePronta;
+	uint64_t *latencias;
+	long nLatencias, capacidadeLatencias;
+} Entidade;
+
+static const uint8_t *rastro;
+static size_t tamanhoRastro;
+
+static Entidade *entidades;
+static int nEntidades, capacidadeEntidades;
+static int entidadeAtual[N_CLASSES][256]; // Entidade viva de cada handle, ou -1
+
+static const char *nomeClasse[N_CLASSES] = { "fila", "semaforo", "mutex", "tarefa", "isr", "temporizador", "grupo_eventos", "notificacao" };
+
+static uint32_t le32(size_t posicao) {
+	const uint8_t *p = rastro + posicao;
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t le16(size_t posicao) {
+	return rastro[posicao] | rastro[posicao + 1] << 8;
+}
+
+static void copiaNome(char *destino, size_t tamanho, const uint8_t *origem, size_t maximo) {
+	size_t n = 0;
+	while (n < maximo && n + 1 < tamanho && origem[n] != 0) {
+		if (origem[n] < 0x20) { // Objeto sem nome: a entrada guarda outros dados
+			n = 0;
+			break;
+		}
+		destino[n] = (char)origem[n];
+		n++;
+	}
+	destino[n] = 0;
+}
+
+static int entidade(int classe, int handle) {
+	int *atual = &entidadeAtual[classe & 7][handle & 0xFF];
+	if (*atual >= 0)
+		return *atual;
+	if (nEntidades == capacidadeEntidades) {
+		capacidadeEntidades = capacidadeEntidades ? 2 * capacidadeEntidades : 256;
+		entidades = realloc(entidades, capacidadeEntidades * sizeof(Entidade));
+		if (entidades == NULL) {
+			fprintf(stderr, "Sem memoria\n");
+			exit(1);
+		}
+	}
+	Entidade *e = &entidades[nEntidades];
+	memset(e, 0, sizeof(Entidade));
+	e->classe = classe;
+	e->handle = handle;
+	e->objetoBloqueio = -1;
+	*atual = nEntidades;
+	return nEntidades++;
+}
+
+static void registraLatencia(Entidade *e, uint64_t valor) {
+	if (e->nLatencias == e->capacidadeLatencias) {
+		e->capacidadeLatencias = e->capacidadeLatencias ? 2 * e->capacidadeLatencias : 64;
+		e->latencias = realloc(e->latencias, e->capacidadeLatencias * sizeof(uint64_t));
+		if (e->latencias == NULL) {
+			fprintf(stderr, "Sem memoria\n");
+			exit(1);
+		}
+	}
+	e->latencias[e->nLatencias++] = valor;
+}
+
+static int comparaValores(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return (x > y) - (x < y);
+}
+
+// Valor do percentil (de 0 a 100) em amostras já ordenadas, pela posição mais próxima: a menor amostra que tem
+// pelo menos p% das amostras até ela, na posição ceil(p * n / 100) - 1
+static uint64_t percentil(const uint64_t *valores, long n, double p) {
+	if (n == 0)
+		return 0;
+	double posicao = p * n / 100.0;
+	long i = (long)posicao;
+	if (i == posicao)
+		i--;
+	if (i < 0)
+		i = 0;
+	if (i >= n)
+		i = n - 1;
+	return valores[i];
+}
+
+static void escreveTexto(FILE *saida, const char *texto) {
+	fputc('"', saida);
+	for (const unsigned char *c = (const unsigned char*)texto; *c; c++) {
+		if (*c == '"' || *c == '\\')
+			fprintf(saida, "\\%c", *c);
+		else if (*c < 0x20 || *c >= 0x7F) // Os nomes vêm do alvo em Latin-1
+			fprintf(saida, "\\u%04x", *c);
+		else
+			fputc(*c, saida);
+	}
+	fputc('"', saida);
+}
+
+// Posições das seções do snapshot, a partir dos marcadores que o gravador põe entre elas
+typedef struct {
+	size_t inicio;         // Marcadores de início do RecorderDataType
+	size_t propriedades;   // ObjectPropertyTable
+	size_t objetos;        // objbytes
+	size_t simbolos;       // symbytes
+	size_t eventos;        // eventData
+	uint8_t objetosClasse[N_CLASSES], tamanhoNome[N_CLASSES], bytesClasse[N_CLASSES];
+	uint16_t inicioClasse[N_CLASSES];
+	uint32_t nClasses, nEventos, maxEventos, proximoLivre, cheio, frequencia;
+} Snapshot;
+
+static const uint8_t marcadoresInicio[12] = { 0x01, 0x02, 0x03, 0x04, 0x71, 0x72, 0x73, 0x74, 0xF1, 0xF2, 0xF3, 0xF4 };
+
+static int marcadorEm(size_t posicao, uint8_t byte) {
+	return posicao + 4 <= tamanhoRastro && le32(posicao) == byte * 0x01010101u;
+}
+
+static int localizaSecoes(Snapshot *s) {
+	size_t i;
+	for (i = 0; i + sizeof(marcadoresInicio) <= tamanhoRastro; i++)
+		if (memcmp(rastro + i, marcadoresInicio, sizeof(marcadoresInicio)) == 0)
+			break;
+	if (i + 0x8C > tamanhoRastro) {
+		fprintf(stderr, "Marcadores do snapshot nao encontrados\n");
+		return 0;
+	}
+	s->inicio = i;
+	if (le16(i + 12) != VERSAO_SNAPSHOT) {
+		fprintf(stderr, "Versao do snapshot 0x%04X nao suportada\n", le16(i + 12));
+		return 0;
+	}
+	s->nEventos = le32(i + 20);
+	s->maxEventos = le32(i + 24);
+	s->proximoLivre = le32(i + 28);
+	s->cheio = le32(i + 32);
+	s->frequencia = le32(i + 36);
+	if (!marcadorEm(i + 0x54, 0xF0) || le32(i + 0x58) != 0) {
+		fprintf(stderr, "Cabecalho do snapshot inesperado (handles de 16 bits nao sao suportados)\n");
+		return 0;
+	}
+
+	s->propriedades = i + 0x5C;
+	s->nClasses = le32(s->propriedades);
+	uint32_t tamanhoObjetos = le32(s->propriedades + 4);
+	if (s->nClasses > N_CLASSES) {
+		fprintf(stderr, "Tabela de objetos com %u classes\n", s->nClasses);
+		return 0;
+	}
+	for (int c = 0; c < N_CLASSES; c++) {
+		s->objetosClasse[c] = rastro[s->propriedades + 8 + c];
+		s->tamanhoNome[c] = rastro[s->propriedades + 16 + c];
+		s->bytesClasse[c] = rastro[s->propriedades + 24 + c];
+		s->inicioClasse[c] = le16(s->propriedades + 32 + 2 * c);
+	}
+	s->objetos = s->propriedades + 48;
+	size_t marcador = s->objetos + ((tamanhoObjetos + 3) & ~3u);
+	if (!marcadorEm(marcador, 0xF1)) {
+		fprintf(stderr, "Marcador depois da tabela de objetos nao encontrado\n");
+		return 0;
+	}
+
+	// Tabela de símbolos: tamanho, próximo livre, symbytes e o índice por checksum
+	uint32_t tamanhoSimbolos = le32(marcador + 4);
+	s->simbolos = marcador + 12;
+	for (marcador = s->simbolos + tamanhoSimbolos; marcador + 4 <= tamanhoRastro && !marcadorEm(marcador, 0xF2); marcador += 4)
+		;
+	// Depois vem systemInfo[80]
+	marcador += 4 + 80;
+	if (!marcadorEm(marcador, 0xF3)) {
+		fprintf(stderr, "Marcador antes dos eventos nao encontrado\n");
+		return 0;
+	}
+	s->eventos = marcador + 4;
+	if (s->eventos + 4 * (size_t)s->maxEventos > tamanhoRastro || s->proximoLivre > s->maxEventos) {
+		fprintf(stderr, "Buffer de eventos truncado\n");
+		return 0;
+	}
+	return 1;
+}
+
+// Nome do objeto ainda vivo no fim do rastro, da tabela de propriedades
+static void nomeTabela(const Snapshot *s, Entidade *e) {
+	int c = e->classe;
+	if (c >= (int)s->nClasses || e->handle < 1 || e->handle > s->objetosClasse[c])
+		return;
+	size_t posicao = s->objetos + s->inicioClasse[c] + (size_t)(e->handle - 1) * s->bytesClasse[c];
+	copiaNome(e->nome, sizeof(e->nome), rastro + posicao, s->tamanhoNome[c]);
+}
+
+// Resultado da leitura dos eventos
+typedef struct {
+	uint64_t duracao;
+	long eventos;
+	long trocas; // Trocas de contexto entre tarefas diferentes
+	long desconhecidos[256];
+} Analise;
+
+static void analisa(const Snapshot *s, Analise *a) {
+	uint64_t agora = 0, inicioExecucao = 0;
+	uint32_t extensao = 0; // Bits altos do próximo dts, de um evento XTS8 ou XTS16
+	int extensao8 = 0, extensao16 = 0;
+	int executando = -1, ultimaTarefa = -1;
+	int pular = 0; // Registros de parâmetros de um evento de usuário
+	uint32_t total = s->cheio ? s->maxEventos : s->proximoLivre;
+	uint32_t primeiro = s->cheio ? s->proximoLivre : 0;
+
+	memset(entidadeAtual, -1, sizeof(entidadeAtual));
+	for (uint32_t k = 0; k < total; k++) {
+		const uint8_t *ev = rastro + s->eventos + 4 * (size_t)((primeiro + k) % s->maxEventos);
+		int codigo = ev[0];
+		if (pular > 0) {
+			pular--;
+			continue;
+		}
+		if (codigo == 0)
+			continue;
+		a->eventos++;
+
+		// Delta de tempo do evento: de 8 bits no byte 1 ou 2, de 16 bits nos bytes 2-3, ou nenhum
+		uint32_t dts = 0;
+		int largura = 0;
+		if (codigo == EV_PRONTO || (codigo >= EV_ISR_INICIO && codigo <= EV_TAREFA_RETOMA)) {
+			dts = ev[2] | ev[3] << 8;
+			largura = 16;
+		}
+		else if (codigo == EV_NOVO_TICK || codigo == EV_ESPERA_ATE || codigo == EV_ESPERA || codigo == EV_MEMORIA_ALOCA
+			|| codigo == EV_MEMORIA_LIBERA || (codigo >= EV_USUARIO && codigo <= EV_USUARIO_FIM)) {
+			dts = ev[1];
+			largura = 8;
+		}
+		else if ((codigo >= EV_KERNEL && codigo < EV_ESPERA_ATE) || (codigo > EV_ESPERA && codigo < EV_MEMORIA_ALOCA) || codigo >= 0xB0) {
+			dts = ev[2];
+			largura = 8;
+		}
+		if (codigo == EV_XTS8) {
+			extensao = (uint32_t)ev[1] << 24 | (uint32_t)(ev[2] | ev[3] << 8) << 8;
+			extensao8 = 1;
+			continue;
+		}
+		if (codigo == EV_XTS16) {
+			extensao = (uint32_t)(ev[2] | ev[3] << 8) << 16;
+			extensao16 = 1;
+			continue;
+		}
+		if (largura == 8 && extensao8)
+			dts |= extensao;
+		if (largura == 16 && extensao16)
+			dts |= extensao;
+		if (largura) {
+			extensao8 = extensao16 = 0;
+			agora += dts;
+		}
+
+		if (codigo >= EV_ISR_INICIO && codigo <= EV_TAREFA_RETOMA) {
+			int classe = codigo >= EV_TAREFA_INICIO ? CLASSE_TAREFA : CLASSE_ISR;
+			int nova = entidade(classe, ev[1]);
+			if (executando >= 0)
+				entidades[executando].cpu += agora - inicioExecucao;
+			if (nova != executando)
+				entidades[nova].ativacoes++;
+			if (classe == CLASSE_TAREFA) {
+				Entidade *t = &entidades[nova];
+				if (ultimaTarefa >= 0 && nova != ultimaTarefa)
+					a->trocas++;
+				ultimaTarefa = nova;
+				if (t->pronta) {
+					registraLatencia(t, agora - t->instantePronta);
+					t->pronta = 0;
+				}
+			}
+			executando = nova;
+			inicioExecucao = agora;
+		}
+		else if (codigo == EV_PRONTO) {
+			int tarefa = entidade(CLASSE_TAREFA, ev[1]); // Antes de tomar o endereço: a tabela pode crescer
+			Entidade *t = &entidades[tarefa];
+			if (t->objetoBloqueio >= 0) {
+				Entidade *o = &entidades[t->objetoBloqueio];
+				uint64_t duracao = agora - t->inicioBloqueio;
+				o->bloqueios++;
+				o->bloqueado += duracao;
+				if (duracao > o->maiorBloqueio)
+					o->maiorBloqueio = duracao;
+				t->objetoBloqueio = -1;
+			}
+			if (!t->pronta) {
+				t->pronta = 1;
+				t->instantePronta = agora;
+			}
+		}
+		else if (((codigo >= EV_RECEBE_BLOQUEIO && codigo < EV_ENVIA_BLOQUEIO + 8) || codigo == EV_GRUPO_SYNC_BLOQUEIO
+			|| codigo == EV_GRUPO_ESPERA_BLOQUEIO || codigo == EV_NOTIFICACAO_TAKE_BLOQUEIO
+			|| codigo == EV_NOTIFICACAO_WAIT_BLOQUEIO) && executando >= 0 && entidades[executando].classe == CLASSE_TAREFA) {
+			// Filas, semáforos e mutexes trazem a classe no código; o grupo de eventos vem no byte 1; a tarefa que
+			// espera uma notificação bloqueia na própria notificação, que tem o handle dela
+			int objeto;
+			if (codigo == EV_GRUPO_SYNC_BLOQUEIO || codigo == EV_GRUPO_ESPERA_BLOQUEIO)
+				objeto = entidade(CLASSE_GRUPO_EVENTOS, ev[1]);
+			else if (codigo == EV_NOTIFICACAO_TAKE_BLOQUEIO || codigo == EV_NOTIFICACAO_WAIT_BLOQUEIO)
+				objeto = entidade(CLASSE_NOTIFICACAO, entidades[executando].handle);
+			else
+				objeto = entidade(codigo & 7, ev[1]);
+			entidades[executando].objetoBloqueio = objeto;
+			entidades[executando].inicioBloqueio = agora;
+		}
+		else if (codigo >= EV_FECHA_NOME && codigo < EV_FECHA_PROPRIEDADES) {
+			// O objeto foi apagado: o nome fica na tabela de símbolos e o handle pode ser reusado
+			int *atual = &entidadeAtual[codigo & 7][ev[1]];
+			size_t simbolo = s->simbolos + (ev[2] | ev[3] << 8) + 4; // Depois do encadeamento e do canal
+			if (*atual >= 0 && simbolo < tamanhoRastro)
+				copiaNome(entidades[*atual].nome, sizeof(entidades[*atual].nome), rastro + simbolo, tamanhoRastro - simbolo);
+			if (*atual == ultimaTarefa)
+				ultimaTarefa = -1;
+			if ((codigo & 7) == CLASSE_TAREFA) { // A notificação acaba junto com a tarefa
+				int *notificacao = &entidadeAtual[CLASSE_NOTIFICACAO][ev[1]];
+				if (*notificacao >= 0 && *atual >= 0)
+					memcpy(entidades[*notificacao].nome, entidades[*atual].nome, sizeof(entidades[*notificacao].nome));
+				*notificacao = -1;
+			}
+			*atual = -1;
+		}
+		else if (codigo >= EV_USUARIO && codigo <= EV_USUARIO_FIM)
+			pular = codigo - EV_USUARIO;
+		else if (!largura && codigo != EV_PARAMETRO_EXTRA && !(codigo >= EV_FECHA_PROPRIEDADES && codigo < EV_KERNEL)
+			&& codigo != EV_MEMORIA_ALOCA + 1 && codigo != EV_MEMORIA_LIBERA + 1)
+			a->desconhecidos[codigo]++;
+	}
+	if (executando >= 0)
+		entidades[executando].cpu += agora - inicioExecucao;
+	a->duracao = agora;
+	for (int i = 0; i < nEntidades; i++)
+		if (entidades[i].objetoBloqueio >= 0)
+			entidades[entidades[i].objetoBloqueio].pendentes++;
+
+	for (int c = 0; c < N_CLASSES; c++)
+		for (int h = 0; h < 256; h++)
+			if (entidadeAtual[c][h] >= 0)
+				nomeTabela(s, &entidades[entidadeAtual[c][h]]);
+	for (int h = 0; h < 256; h++) // A notificação leva o nome da tarefa
+		if (entidadeAtual[CLASSE_NOTIFICACAO][h] >= 0 && entidadeAtual[CLASSE_TAREFA][h] >= 0)
+			memcpy(entidades[entidadeAtual[CLASSE_NOTIFICACAO][h]].nome, entidades[entidadeAtual[CLASSE_TAREFA][h]].nome,
+				sizeof(entidades[0].nome));
+}
+
+static void escreveHistogramaLatencia(FILE *saida, const uint64_t *valores, long n, double us) {
+	long faixas[FAIXAS_LATENCIA] = { 0 };
+	int ultima = -1;
+	for (long i = 0; i < n; i++) {
+		double v = valores[i] * us;
+		int f = 0;
+		while (f < FAIXAS_LATENCIA - 1 && v >= (double)(1ull << f))
+			f++;
+		faixas[f]++;
+		if (f > ultima)
+			ultima = f;
+	}
+	fprintf(saida, "[");
+	for (int f = 0; f <= ultima; f++)
+		fprintf(saida, "%s{\"ate_us\": %llu, \"n\": %ld}", f ? ", " : "", 1ull << f, faixas[f]);
+	fprintf(saida, "]");
+}
+
+static void escreveLatencias(FILE *saida, uint64_t *valores, long n, double us, const char *recuo) {
+	if (n > 0)
+		qsort(valores, n, sizeof(uint64_t), comparaValores);
+	fprintf(saida, "{\"amostras\": %ld, \"p50_us\": %.1f, \"p90_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f,\n%s \"histograma\": ",
+		n, percentil(valores, n, 50) * us, percentil(valores, n, 90) * us, percentil(valores, n, 99) * us,
+		n ? valores[n - 1] * us : 0.0, recuo);
+	escreveHistogramaLatencia(saida, valores, n, us);
+	fprintf(saida, "}");
+}
+
+static void escreveJson(FILE *saida, const char *arquivo, const Snapshot *s, Analise *a) {
+	// Sem a frequência do relógio no rastro, as unidades são tratadas como microssegundos
+	double us = s->frequencia ? 1e6 / s->frequencia : 1.0;
+	uint64_t cpuTotal = 0;
+	long nLatencias = 0;
+	for (int i = 0; i < nEntidades; i++) {
+		cpuTotal += entidades[i].cpu;
+		nLatencias += entidades[i].nLatencias;
+	}
+
+	fprintf(saida, "{\n  \"arquivo\": ");
+	escreveTexto(saida, arquivo);
+	fprintf(saida, ",\n  \"frequencia_hz\": %u,\n  \"eventos\": %ld,\n  \"buffer_cheio\": %s,\n  \"duracao_us\": %.1f,\n",
+		s->frequencia, a->eventos, s->cheio ? "true" : "false", a->duracao * us);
+	fprintf(saida, "  \"trocas_contexto\": %ld,\n", a->trocas);
+
+	fprintf(saida, "  \"tarefas\": [");
+	int primeiro = 1;
+	for (int i = 0; i < nEntidades; i++) {
+		Entidade *e = &entidades[i];
+		if (e->classe != CLASSE_TAREFA && e->classe != CLASSE_ISR)
+			continue;
+		fprintf(saida, "%s\n    {\"nome\": ", primeiro ? "" : ",");
+		escreveTexto(saida, e->nome);
+		fprintf(saida, ", \"tipo\": \"%s\", \"handle\": %d, \"cpu_us\": %.1f, \"cpu_pct\": %.2f, \"ativacoes\": %ld",
+			nomeClasse[e->classe], e->handle, e->cpu * us, cpuTotal ? 100.0 * e->cpu / cpuTotal : 0.0, e->ativacoes);
+		if (e->classe == CLASSE_TAREFA) {
+			fprintf(saida, ",\n     \"latencia\": ");
+			escreveLatencias(saida, e->latencias, e->nLatencias, us, "     ");
+		}
+		fprintf(saida, "}");
+		primeiro = 0;
+	}
+	fprintf(saida, "\n  ],\n");
+
+	fprintf(saida, "  \"bloqueios\": [");
+	primeiro = 1;
+	for (int i = 0; i < nEntidades; i++) {
+		Entidade *e = &entidades[i];
+		if (e->bloqueios == 0 && e->pendentes == 0)
+			continue;
+		fprintf(saida, "%s\n    {\"nome\": ", primeiro ? "" : ",");
+		escreveTexto(saida, e->nome);
+		fprintf(saida, ", \"tipo\": \"%s\", \"handle\": %d, \"bloqueios\": %ld, \"pendentes\": %ld, \"total_us\": %.1f, \"medio_us\": %.1f, \"max_us\": %.1f}",
+			nomeClasse[e->classe], e->handle, e->bloqueios, e->pendentes, e->bloqueado * us,
+			e->bloqueios ? e->bloqueado * us / e->bloqueios : 0.0, e->maiorBloqueio * us);
+		primeiro = 0;
+	}
+	fprintf(saida, "\n  ],\n");
+
+	// Latência de todas as tarefas juntas
+	uint64_t *todas = malloc((nLatencias ? nLatencias : 1) * sizeof(uint64_t));
+	if (todas == NULL) {
+		fprintf(stderr, "Sem memoria\n");
+		exit(1);
+	}
+	long n = 0;
+	for (int i = 0; i < nEntidades; i++)
+		if (entidades[i].nLatencias > 0) {
+			memcpy(todas + n, entidades[i].latencias, entidades[i].nLatencias * sizeof(uint64_t));
+			n += entidades[i].nLatencias;
+		}
+	fprintf(saida, "  \"latencia_escalonamento\": ");
+	escreveLatencias(saida, todas, n, us, "  ");
+	free(todas);
+
+	fprintf(saida, ",\n  \"eventos_desconhecidos\": {");
+	primeiro = 1;
+	for (int c = 0; c < 256; c++)
+		if (a->desconhecidos[c]) {
+			fprintf(saida, "%s\"0x%02X\": %ld", primeiro ? "" : ", ", c, a->desconhecidos[c]);
+			primeiro = 0;
+		}
+	fprintf(saida, "}\n}\n");
+}
+
+static uint8_t *leArquivo(const char *nome, size_t *tamanho) {
+	FILE *arquivo = fopen(nome, "rb");
+	if (arquivo == NULL) {
+		fprintf(stderr, "Erro ao abrir %s\n", nome);
+		return NULL;
+	}
+	fseek(arquivo, 0, SEEK_END);
+	long n = ftell(arquivo);
+	fseek(arquivo, 0, SEEK_SET);
+	uint8_t *dados = n > 0 ? malloc(n) : NULL;
+	if (dados == NULL || fread(dados, 1, n, arquivo) != (size_t)n) {
+		fprintf(stderr, "Erro ao ler %s\n", nome);
+		free(dados);
+		fclose(arquivo);
+		return NULL;
+	}
+	fclose(arquivo);
+	*tamanho = n;
+	return dados;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2 || argc > 3) {
+		fprintf(stderr, "Uso: %s <Trace.dump> [saida.json]\n", argv[0]);
+		return 2;
+	}
+	uint8_t *dados = leArquivo(argv[1], &tamanhoRastro);
+	if (dados == NULL)
+		return 1;
+	rastro = dados;
+	if (tamanhoRastro >= 4 && memcmp(rastro, "PSF", 3) == 0) {
+		fprintf(stderr, "%s e um rastro em streaming; grave o rastro no modo snapshot, o padrao sem RASTRO_STREAMING (trcConfig.h)\n", argv[1]);
+		return 1;
+	}
+
+	Snapshot snapshot;
+	static Analise analise;
+	if (!localizaSecoes(&snapshot))
+		return 1;
+	analisa(&snapshot, &analise);
+
+	FILE *saida = stdout;
+	if (argc == 3 && (saida = fopen(argv[2], "w")) == NULL) {
+		fprintf(stderr, "Erro ao criar %s\n", argv[2]);
+		return 1;
+	}
+	escreveJson(saida, argv[1], &snapshot, &analise);
+	if (saida != stdout)
+		fclose(saida);
+	fprintf(stderr, "%ld eventos de %u, %d objetos\n", analise.eventos, snapshot.cheio ? snapshot.maxEventos : snapshot.proximoLivre, nEntidades);
+	free(dados);
+	return 0;
+}
@@ -0,0 +1,49 @@
+/* Standard includes. */
+#include <string.h>
+
+#include "anel.h"
+
+// No x86 as escritas não são reordenadas entre si nem as leituras entre si, então basta impedir que o
+// compilador mova a cópia do item para depois da publicação do índice (e a leitura para antes). O MSVC já
+// dá semântica de aquisição e liberação a variáveis volatile nesse alvo (/volatile:ms); a barreira explícita
+// deixa a intenção clara e vale para outros compiladores
+#if defined(_MSC_VER)
+	#include <intrin.h>
+	#define BARREIRA_COMPILADOR() _ReadWriteBarrier()
+#else
+	#define BARREIRA_COMPILADOR() __asm__ __volatile__("" ::: "memory")
+#endif
+
+void inicializaAnel(AnelSPSC *anel, void *memoria, uint32_t tamanhoItem, uint32_t capacidade) {
+	memset(anel, 0, sizeof(*anel));
+	anel->dados = memoria;
+	anel->tamanhoItem = tamanhoItem;
+	anel->mascara = capacidade - 1;
+}
+
+int escreveAnel(AnelSPSC *anel, const void *item) {
+	uint32_t cabeca = anel->cabeca;
+	if (cabeca - anel->caudaVista > anel->mascara) {
+		anel->caudaVista = anel->cauda;
+		if (cabeca - anel->caudaVista > anel->mascara)
+			return 0;
+	}
+	memcpy(anel->dados + (size_t)(cabeca & anel->mascara) * anel->tamanhoItem, item, anel->tamanhoItem);
+	BARREIRA_COMPILADOR();
+	anel->cabeca = cabeca + 1;
+	return 1;
+}
+
+int leAnel(AnelSPSC *anel, void *item) {
+	uint32_t cauda = anel->cauda;
+	if (cauda == anel->cabecaVista) {
+		anel->cabecaVista = anel->cabeca;
+		if (cauda == anel->cabecaVista)
+			return 0;
+	}
+	BARREIRA_COMPILADOR();
+	memcpy(item, anel->dados + (size_t)(cauda & anel->mascara) * anel->tamanhoItem, anel->tamanhoItem);
+	BARREIRA_COMPILADOR();
+	anel->cauda = cauda + 1;
+	return 1;
+}
@@ -0,0 +1,37 @@
+#ifndef ANEL_H
+#define ANEL_H
+
+#include <stdint.h>
+
+// Fila circular sem trava para exatamente um produtor e um consumidor, que podem estar em threads diferentes.
+// Cada lado só escreve o seu próprio índice e guarda uma cópia do índice do outro lado, relida apenas quando a
+// fila parece cheia (produtor) ou vazia (consumidor); assim os dois raramente disputam a mesma linha de cache.
+// A capacidade deve ser potência de 2.
+// Este módulo não usa a API do FreeRTOS.
+
+#define LINHA_CACHE 64
+
+typedef struct {
+	// Lado do produtor
+	volatile uint32_t cabeca;        // Próxima posição a escrever
+	uint32_t caudaVista;             // Última cauda lida pelo produtor
+	char folgaProdutor[LINHA_CACHE - 2 * sizeof(uint32_t)];
+	// Lado do consumidor
+	volatile uint32_t cauda;         // Próxima posição a ler
+	uint32_t cabecaVista;            // Última cabeça lida pelo consumidor
+	char folgaConsumidor[LINHA_CACHE - 2 * sizeof(uint32_t)];
+	// Constantes depois da inicialização
+	unsigned char *dados;
+	uint32_t tamanhoItem;
+	uint32_t mascara;                // capacidade - 1
+} AnelSPSC;
+
+void inicializaAnel(AnelSPSC *anel, void *memoria, uint32_t tamanhoItem, uint32_t capacidade);
+
+// Produtor: copia o item para a fila. Retorna 0 se a fila está cheia
+int escreveAnel(AnelSPSC *anel, const void *item);
+
+// Consumidor: copia o item mais antigo para item. Retorna 0 se a fila está vazia
+int leAnel(AnelSPSC *anel, void *item);
+
+#endif /* ANEL_H */
@@ -0,0 +1,359 @@
+/* Standard includes. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "colunas.h"
+
+static FILE *arquivo;
+static uint64_t posicao;       // Fim da parte definitiva do arquivo, onde vai o próximo bloco
+static uint64_t finalAnterior; // Final do último segmento definitivo; 0 se ainda não há
+static int64_t valores[N_COLUNAS][LINHAS_BLOCO];
+static int nLinhas;
+static EntradaIndice abertas[BLOCOS_SEGMENTO]; // Entradas do segmento provisório
+static int nAbertas;
+static unsigned char codificado[LINHAS_BLOCO * MAX_BYTES_VARINT];
+static unsigned char lido[LINHAS_BLOCO * MAX_BYTES_VARINT];
+static int64_t valoresConsulta[N_COLUNAS][LINHAS_BLOCO];
+
+static void escreve32(unsigned char *p, uint32_t valor) {
+	p[0] = (unsigned char)valor;
+	p[1] = (unsigned char)(valor >> 8);
+	p[2] = (unsigned char)(valor >> 16);
+	p[3] = (unsigned char)(valor >> 24);
+}
+
+static void escreve64(unsigned char *p, uint64_t valor) {
+	escreve32(p, (uint32_t)valor);
+	escreve32(p + 4, (uint32_t)(valor >> 32));
+}
+
+static uint32_t le32(const unsigned char *p) {
+	return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t le64(const unsigned char *p) {
+	return le32(p) | (uint64_t)le32(p + 4) << 32;
+}
+
+static int codificaVarint(unsigned char *p, uint64_t valor) {
+	int n = 0;
+	while (valor >= 0x80) {
+		p[n++] = (unsigned char)(valor | 0x80);
+		valor >>= 7;
+	}
+	p[n++] = (unsigned char)valor;
+	return n;
+}
+
+static uint64_t zigzag(int64_t valor) {
+	return ((uint64_t)valor << 1) ^ (uint64_t)(valor >> 63);
+}
+
+static int codificaColuna(const int64_t *coluna, int n, unsigned char *saida) {
+	int bytes = 0;
+	int64_t anterior = 0;
+	for (int i = 0; i < n; i++) {
+		bytes += codificaVarint(saida + bytes, zigzag(coluna[i] - anterior));
+		anterior = coluna[i];
+	}
+	return bytes;
+}
+
+// Grava as entradas abertas e o final do segmento a partir de posicao, sobre o segmento provisório anterior,
+// que é sempre menor. Com BLOCOS_SEGMENTO entradas o segmento fica definitivo e posicao passa para depois dele
+static void gravaSegmento(void) {
+	unsigned char entrada[TAMANHO_ENTRADA_INDICE];
+	unsigned char final[TAMANHO_FINAL];
+
+	_fseeki64(arquivo, (__int64)posicao, SEEK_SET);
+	for (int b = 0; b < nAbertas; b++) {
+		escreve32(entrada, abertas[b].nLinhas);
+		escreve32(entrada + 4, abertas[b].instanteMinimo);
+		escreve32(entrada + 8, abertas[b].instanteMaximo);
+		escreve32(entrada + 12, (uint32_t)abertas[b].veiculoMinimo);
+		escreve32(entrada + 16, (uint32_t)abertas[b].veiculoMaximo);
+		entrada[20] = abertas[b].cruzamentos;
+		entrada[21] = abertas[b].eventos;
+		entrada[22] = entrada[23] = 0;
+		for (int c = 0; c < N_COLUNAS; c++) {
+			escreve64(entrada + 24 + 12 * c, abertas[b].deslocamento[c]);
+			escreve32(entrada + 32 + 12 * c, abertas[b].bytes[c]);
+		}
+		fwrite(entrada, 1, sizeof(entrada), arquivo);
+	}
+	escreve32(final, (uint32_t)nAbertas);
+	escreve32(final + 4, N_COLUNAS);
+	escreve64(final + 8, finalAnterior);
+	memcpy(final + 16, "COL3", 4);
+	fwrite(final, 1, sizeof(final), arquivo);
+	fflush(arquivo);
+
+	if (nAbertas == BLOCOS_SEGMENTO) {
+		finalAnterior = posicao + (uint64_t)nAbertas * TAMANHO_ENTRADA_INDICE;
+		posicao = finalAnterior + TAMANHO_FINAL;
+		nAbertas = 0;
+	}
+}
+
+static void gravaBloco(void) {
+	// Os instantes podem vir um pouco fora de ordem, então o índice guarda o menor e o maior
+	EntradaIndice *entrada = &abertas[nAbertas];
+	memset(entrada, 0, sizeof(*entrada));
+	entrada->nLinhas = nLinhas;
+	entrada->instanteMinimo = entrada->instanteMaximo = (uint32_t)valores[COLUNA_INSTANTE][0];
+	entrada->veiculoMinimo = entrada->veiculoMaximo = (int32_t)valores[COLUNA_VEICULO][0];
+	for (int i = 0; i < nLinhas; i++) {
+		uint32_t instante = (uint32_t)valores[COLUNA_INSTANTE][i];
+		int32_t veiculo = (int32_t)valores[COLUNA_VEICULO][i];
+		if (instante < entrada->instanteMinimo)
+			entrada->instanteMinimo = instante;
+		if (instante > entrada->instanteMaximo)
+			entrada->instanteMaximo = instante;
+		if (veiculo < entrada->veiculoMinimo)
+			entrada->veiculoMinimo = veiculo;
+		if (veiculo > entrada->veiculoMaximo)
+			entrada->veiculoMaximo = veiculo;
+		entrada->cruzamentos |= 1u << (valores[COLUNA_CRUZAMENTO][i] & 7);
+		entrada->eventos |= 1u << (valores[COLUNA_EVENTO][i] & 7);
+	}
+	_fseeki64(arquivo, (__int64)posicao, SEEK_SET);
+	for (int c = 0; c < N_COLUNAS; c++) {
+		int bytes = codificaColuna(valores[c], nLinhas, codificado);
+		fwrite(codificado, 1, bytes, arquivo);
+		entrada->deslocamento[c] = posicao;
+		entrada->bytes[c] = bytes;
+		posicao += bytes;
+	}
+	nAbertas++;
+	nLinhas = 0;
+	gravaSegmento();
+}
+
+int abreColunas(const char *caminho, double ticksPorSegundo) {
+	unsigned char cabecalho[TAMANHO_CABECALHO_COLUNAS];
+	uint64_t bits;
+
+	if (fopen_s(&arquivo, caminho, "wb") != 0 || arquivo == NULL)
+		return 0;
+	memcpy(cabecalho, "COL3", 4);
+	memcpy(&bits, &ticksPorSegundo, sizeof(bits));
+	escreve64(cabecalho + 4, bits);
+	fwrite(cabecalho, 1, sizeof(cabecalho), arquivo);
+	posicao = sizeof(cabecalho);
+	finalAnterior = 0;
+	nAbertas = 0;
+	gravaSegmento();
+	return 1;
+}
+
+void acrescentaColunas(const RegistroTelemetria *registro) {
+	if (arquivo == NULL)
+		return;
+	valores[COLUNA_INSTANTE][nLinhas] = registro->instante;
+	valores[COLUNA_VEICULO][nLinhas] = registro->veiculo;
+	valores[COLUNA_CRUZAMENTO][nLinhas] = registro->cruzamento;
+	valores[COLUNA_SEMAFORO][nLinhas] = registro->semaforo;
+	valores[COLUNA_MOVIMENTO][nLinhas] = registro->direcao;
+	valores[COLUNA_EVENTO][nLinhas] = registro->tipo;
+	valores[COLUNA_VIA][nLinhas] = registro->via;
+	if (++nLinhas == LINHAS_BLOCO)
+		gravaBloco();
+}
+
+void descarregaColunas(void) {
+	if (arquivo != NULL && nLinhas > 0)
+		gravaBloco();
+}
+
+// Lê o final de segmento em deslocamento: quantas entradas ele tem e onde está o final anterior
+static int leFinalSegmento(FILE *f, uint64_t deslocamento, uint32_t *nEntradas, uint64_t *anterior) {
+	unsigned char final[TAMANHO_FINAL];
+	if (_fseeki64(f, (__int64)deslocamento, SEEK_SET) != 0 || fread(final, 1, sizeof(final), f) != sizeof(final)
+		|| memcmp(final + 16, "COL3", 4) != 0 || le32(final + 4) != N_COLUNAS)
+		return 0;
+	*nEntradas = le32(final);
+	*anterior = le64(final + 8);
+	return *nEntradas <= BLOCOS_SEGMENTO && *anterior < deslocamento
+		&& deslocamento >= TAMANHO_CABECALHO_COLUNAS + (uint64_t)*nEntradas * TAMANHO_ENTRADA_INDICE;
+}
+
+// Percorre a cadeia de segmentos duas vezes: do último para o primeiro para contar os blocos e depois
+// de novo, preenchendo o índice de trás para a frente, para que ele fique na ordem de gravação
+int abreConsultaColunas(ArquivoColunas *colunas, const char *caminho) {
+	unsigned char cabecalho[TAMANHO_CABECALHO_COLUNAS];
+	unsigned char entrada[TAMANHO_ENTRADA_INDICE];
+	uint64_t ultimoFinal;
+	uint64_t final;
+	uint64_t anterior;
+	uint32_t nEntradas;
+	uint64_t bits;
+
+	memset(colunas, 0, sizeof(*colunas));
+	if (fopen_s(&colunas->arquivo, caminho, "rb") != 0 || colunas->arquivo == NULL)
+		return 0;
+	if (fread(cabecalho, 1, sizeof(cabecalho), colunas->arquivo) != sizeof(cabecalho) || memcmp(cabecalho, "COL3", 4) != 0
+		|| _fseeki64(colunas->arquivo, -TAMANHO_FINAL, SEEK_END) != 0) {
+		fechaConsultaColunas(colunas);
+		return 0;
+	}
+	bits = le64(cabecalho + 4);
+	memcpy(&colunas->ticksPorSegundo, &bits, sizeof(bits));
+	if (!(colunas->ticksPorSegundo >= 0)) {
+		fechaConsultaColunas(colunas);
+		return 0;
+	}
+	ultimoFinal = (uint64_t)_ftelli64(colunas->arquivo);
+
+	for (final = ultimoFinal; ; final = anterior) {
+		if (!leFinalSegmento(colunas->arquivo, final, &nEntradas, &anterior)) {
+			fechaConsultaColunas(colunas);
+			return 0;
+		}
+		colunas->nBlocos += nEntradas;
+		if (anterior == 0)
+			break;
+	}
+	colunas->indice = malloc((colunas->nBlocos + 1) * sizeof(EntradaIndice));
+	if (colunas->indice == NULL) {
+		fechaConsultaColunas(colunas);
+		return 0;
+	}
+
+	int proximo = colunas->nBlocos;
+	for (final = ultimoFinal; ; final = anterior) {
+		leFinalSegmento(colunas->arquivo, final, &nEntradas, &anterior);
+		proximo -= nEntradas;
+		_fseeki64(colunas->arquivo, (__int64)(final - (uint64_t)nEntradas * TAMANHO_ENTRADA_INDICE), SEEK_SET);
+		for (uint32_t k = 0; k < nEntradas; k++) {
+			EntradaIndice *e = &colunas->indice[proximo + k];
+			if (fread(entrada, 1, sizeof(entrada), colunas->arquivo) != sizeof(entrada)) {
+				fechaConsultaColunas(colunas);
+				return 0;
+			}
+			e->nLinhas = le32(entrada);
+			e->instanteMinimo = le32(entrada + 4);
+			e->instanteMaximo = le32(entrada + 8);
+			e->veiculoMinimo = (int32_t)le32(entrada + 12);
+			e->veiculoMaximo = (int32_t)le32(entrada + 16);
+			e->cruzamentos = entrada[20];
+			e->eventos = entrada[21];
+			for (int c = 0; c < N_COLUNAS; c++) {
+				e->deslocamento[c] = le64(entrada + 24 + 12 * c);
+				e->bytes[c] = le32(entrada + 32 + 12 * c);
+			}
+			if (e->nLinhas > LINHAS_BLOCO) {
+				fechaConsultaColunas(colunas);
+				return 0;
+			}
+		}
+		if (anterior == 0)
+			break;
+	}
+	return 1;
+}
+
+void fechaConsultaColunas(ArquivoColunas *colunas) {
+	if (colunas->arquivo != NULL)
+		fclose(colunas->arquivo);
+	free(colunas->indice);
+	memset(colunas, 0, sizeof(*colunas));
+}
+
+int leColunaBloco(ArquivoColunas *colunas, int bloco, ColunaTrajetoria coluna, int64_t *valores) {
+	const EntradaIndice *e = &colunas->indice[bloco];
+	uint32_t bytes = e->bytes[coluna];
+	if (bytes > sizeof(lido) || _fseeki64(colunas->arquivo, (__int64)e->deslocamento[coluna], SEEK_SET) != 0
+		|| fread(lido, 1, bytes, colunas->arquivo) != bytes)
+		return 0;
+
+	const unsigned char *p = lido;
+	const unsigned char *fim = lido + bytes;
+	int64_t anterior = 0;
+	for (uint32_t i = 0; i < e->nLinhas; i++) {
+		uint64_t valor = 0;
+		int deslocamento = 0;
+		do {
+			if (p == fim || deslocamento > 63)
+				return 0;
+			valor |= (uint64_t)(*p & 0x7F) << deslocamento;
+			deslocamento += 7;
+		} while (*p++ & 0x80);
+		anterior += (int64_t)(valor >> 1) ^ -(int64_t)(valor & 1);
+		valores[i] = anterior;
+	}
+	return p == fim;
+}
+
+// O bloco pode ter linhas do filtro, pelo que diz o índice
+static int blocoCandidato(const EntradaIndice *e, const FiltroTrajetoria *filtro) {
+	if (e->instanteMaximo < filtro->instanteInicial || e->instanteMinimo > filtro->instanteFinal)
+		return 0;
+	if (filtro->veiculo >= 0 && (filtro->veiculo < e->veiculoMinimo || filtro->veiculo > e->veiculoMaximo))
+		return 0;
+	if (filtro->cruzamento >= 0 && !(e->cruzamentos & (1u << filtro->cruzamento)))
+		return 0;
+	if (filtro->evento >= 0 && !(e->eventos & (1u << filtro->evento)))
+		return 0;
+	return 1;
+}
+
+long consultaColunas(ArquivoColunas *colunas, const FiltroTrajetoria *filtro, FuncaoLinhaTrajetoria linha, void *contexto) {
+	static uint8_t aceita[LINHAS_BLOCO];
+	long encontradas = 0;
+
+	for (int b = 0; b < colunas->nBlocos; b++) {
+		const EntradaIndice *e = &colunas->indice[b];
+		if (!blocoCandidato(e, filtro))
+			continue;
+
+		// Primeiro as colunas do filtro, só até o bloco ficar sem candidatas; as demais só se sobrar alguma
+		int lidas[N_COLUNAS] = { 0 };
+		int restantes = (int)e->nLinhas;
+		memset(aceita, 1, e->nLinhas);
+		const struct { ColunaTrajetoria coluna; int ativo; int64_t minimo, maximo; } condicoes[] = {
+			{ COLUNA_VEICULO, filtro->veiculo >= 0, filtro->veiculo, filtro->veiculo },
+			{ COLUNA_CRUZAMENTO, filtro->cruzamento >= 0, filtro->cruzamento, filtro->cruzamento },
+			{ COLUNA_EVENTO, filtro->evento >= 0, filtro->evento, filtro->evento },
+			{ COLUNA_INSTANTE, filtro->instanteInicial > e->instanteMinimo || filtro->instanteFinal < e->instanteMaximo,
+				filtro->instanteInicial, filtro->instanteFinal }
+		};
+		for (int k = 0; k < (int)(sizeof(condicoes) / sizeof(condicoes[0])) && restantes > 0; k++) {
+			if (!condicoes[k].ativo)
+				continue;
+			int64_t *valores = valoresConsulta[condicoes[k].coluna];
+			if (!leColunaBloco(colunas, b, condicoes[k].coluna, valores))
+				return -1;
+			lidas[condicoes[k].coluna] = 1;
+			for (uint32_t i = 0; i < e->nLinhas; i++) {
+				if (aceita[i] && (valores[i] < condicoes[k].minimo || valores[i] > condicoes[k].maximo)) {
+					aceita[i] = 0;
+					restantes--;
+				}
+			}
+		}
+		if (restantes == 0)
+			continue;
+
+		for (int c = 0; c < N_COLUNAS; c++) {
+			if (!lidas[c] && !leColunaBloco(colunas, b, c, valoresConsulta[c]))
+				return -1;
+		}
+		for (uint32_t i = 0; i < e->nLinhas; i++) {
+			if (!aceita[i])
+				continue;
+			RegistroTelemetria registro;
+			memset(&registro, 0, sizeof(registro));
+			registro.instante = (uint32_t)valoresConsulta[COLUNA_INSTANTE][i];
+			registro.veiculo = (int32_t)valoresConsulta[COLUNA_VEICULO][i];
+			registro.cruzamento = (uint8_t)valoresConsulta[COLUNA_CRUZAMENTO][i];
+			registro.semaforo = (uint8_t)valoresConsulta[COLUNA_SEMAFORO][i];
+			registro.direcao = (uint8_t)valoresConsulta[COLUNA_MOVIMENTO][i];
+			registro.tipo = (uint8_t)valoresConsulta[COLUNA_EVENTO][i];
+			registro.via = (uint8_t)valoresConsulta[COLUNA_VIA][i];
+			linha(&registro, contexto);
+			encontradas++;
+		}
+	}
+	return encontradas;
+}
@@ -0,0 +1,104 @@
+#ifndef COLUNAS_H
+#define COLUNAS_H
+
+#include <stdint.h>
+
+#include "telemetria.h"
+
+// Trajetórias dos veículos em formato colunar, para análise fora da simulação. Os registros de telemetria são
+// acumulados em blocos de até LINHAS_BLOCO linhas; cada coluna do bloco é gravada separadamente, com cada
+// valor codificado como a diferença para o anterior da mesma coluna (zigzag) em varint LEB128. O primeiro
+// valor de cada coluna em um bloco é a diferença para zero, então cada coluna de cada bloco se decodifica
+// sozinha. Todos os inteiros de tamanho fixo são little-endian.
+//
+// Arquivo:  cabeçalho | blocos | segmento do índice | blocos | segmento do índice | ...
+//   cabeçalho: "COL3", double (IEEE 754) ticks por segundo simulado, ou 0 se a simulação rodou com --escala=inf
+//   bloco:     as N_COLUNAS colunas, uma depois da outra
+//   segmento:  as entradas de até BLOCOS_SEGMENTO blocos gravados antes dele e o final do segmento
+//   entrada:   uint32 linhas, uint32 menor e maior instante, int32 menor e maior id de veículo,
+//              uint8 máscara dos cruzamentos, uint8 máscara dos eventos, uint16 reservado e, por coluna,
+//              uint64 deslocamento no arquivo e uint32 bytes (TAMANHO_ENTRADA_INDICE bytes)
+//   final:     uint32 entradas do segmento, uint32 colunas, uint64 deslocamento do final do segmento anterior
+//              (0 no primeiro), "COL3" (TAMANHO_FINAL bytes)
+// O arquivo sempre termina num final de segmento: o leitor parte dele e segue a cadeia até o primeiro.
+// Depois de cada bloco o escritor grava um segmento provisório com as entradas ainda abertas, que o próximo
+// bloco sobrescreve; a cada BLOCOS_SEGMENTO blocos o segmento fica definitivo. Assim o arquivo está sempre
+// completo e cada bloco custa no máximo um segmento, qualquer que seja o tamanho do arquivo.
+// Para ler uma coluna basta o índice e os bytes da própria coluna.
+// O índice é esparso: uma consulta por veículo, cruzamento, evento ou intervalo de tempo descarta pelo índice
+// os blocos que não podem ter linhas dela e, nos demais, decodifica primeiro só as colunas do filtro.
+// Este módulo não usa a API do FreeRTOS.
+
+#define LINHAS_BLOCO 4096
+#define MAX_BYTES_VARINT 10
+#define TAMANHO_CABECALHO_COLUNAS 12
+#define TAMANHO_ENTRADA_INDICE (24 + 12 * N_COLUNAS)
+#define TAMANHO_FINAL 20
+#define BLOCOS_SEGMENTO 64
+
+typedef enum {
+	COLUNA_INSTANTE,   // Tick
+	COLUNA_VEICULO,
+	COLUNA_CRUZAMENTO,
+	COLUNA_SEMAFORO,   // Aproximação
+	COLUNA_MOVIMENTO,  // Direção no cruzamento
+	COLUNA_EVENTO,     // TipoTelemetria
+	COLUNA_VIA,
+	N_COLUNAS
+} ColunaTrajetoria;
+
+typedef struct {
+	uint32_t nLinhas;
+	uint32_t instanteMinimo;
+	uint32_t instanteMaximo;
+	int32_t veiculoMinimo;
+	int32_t veiculoMaximo;
+	uint8_t cruzamentos; // Bit c: o bloco tem linhas do cruzamento c
+	uint8_t eventos;     // Bit t: o bloco tem linhas do TipoTelemetria t
+	uint64_t deslocamento[N_COLUNAS];
+	uint32_t bytes[N_COLUNAS];
+} EntradaIndice;
+
+// Arquivo aberto para consulta, com o índice inteiro em memória
+typedef struct {
+	FILE *arquivo;
+	double ticksPorSegundo; // Simulado; 0 = sem tempo simulado (--escala=inf)
+	int nBlocos;
+	EntradaIndice *indice;
+} ArquivoColunas;
+
+// Filtro de uma consulta; -1 em veiculo, cruzamento ou evento aceita qualquer valor
+typedef struct {
+	int32_t veiculo;
+	int cruzamento;
+	int evento;
+	uint32_t instanteInicial; // Intervalo fechado, em ticks
+	uint32_t instanteFinal;
+} FiltroTrajetoria;
+
+typedef void (*FuncaoLinhaTrajetoria)(const RegistroTelemetria *linha, void *contexto);
+
+// Cria o arquivo e grava o cabeçalho e um índice vazio. ticksPorSegundo converte os instantes em segundos
+// simulados. Retorna 0 se não conseguiu
+int abreColunas(const char *caminho, double ticksPorSegundo);
+
+// Acrescenta uma linha; ao completar LINHAS_BLOCO linhas o bloco é gravado
+void acrescentaColunas(const RegistroTelemetria *registro);
+
+// Grava o bloco incompleto, se houver, e atualiza o índice
+void descarregaColunas(void);
+
+// Abre um arquivo gravado por este módulo e carrega o índice. Retorna 0 se o arquivo não é válido
+int abreConsultaColunas(ArquivoColunas *colunas, const char *caminho);
+
+void fechaConsultaColunas(ArquivoColunas *colunas);
+
+// Decodifica uma coluna de um bloco em valores, com espaço para LINHAS_BLOCO. Retorna 0 se a coluna está
+// corrompida. Usa um buffer estático, então não deve ser chamada de mais de uma thread
+int leColunaBloco(ArquivoColunas *colunas, int bloco, ColunaTrajetoria coluna, int64_t *valores);
+
+// Chama linha para cada linha que passa no filtro, em ordem de gravação. Retorna o número de linhas
+// encontradas ou -1 se algum bloco está corrompido
+long consultaColunas(ArquivoColunas *colunas, const FiltroTrajetoria *filtro, FuncaoLinhaTrajetoria linha, void *contexto);
+
+#endif /* COLUNAS_H */
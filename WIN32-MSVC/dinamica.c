@@ -0,0 +1,401 @@
+/* Standard includes. */
+#include <string.h>
+#include <math.h>
+
+#include "dinamica.h"
+
+// O núcleo AVX2 é compilado sempre que o compilador oferece os intrínsecos e só é usado se o processador
+// e o sistema operacional suportarem os registradores de 256 bits
+#if defined(_MSC_VER)
+	#include <intrin.h>
+	#include <immintrin.h>
+	#define ALVO_AVX2
+	#define NUCLEO_AVX2 1
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+	#include <immintrin.h>
+	#define ALVO_AVX2 __attribute__((target("avx2")))
+	#define NUCLEO_AVX2 1
+#else
+	#define NUCLEO_AVX2 0
+#endif
+
+#define LACUNA_MINIMA 0.1f // Evita divisão por zero quando dois veículos se encostam
+
+static void passoEscalar(DinamicaFaixa *faixa, float dt);
+static void (*passoNucleo)(DinamicaFaixa *faixa, float dt) = passoEscalar;
+
+void inicializaDinamicaVia(DinamicaVia *via, float comprimento, float velocidadeDesejada, int linhaParada) {
+	memset(via, 0, sizeof(*via));
+	via->comprimento = comprimento;
+	via->velocidadeDesejada = velocidadeDesejada;
+	via->linhaParada = linhaParada;
+}
+
+int adicionaFaixa(DinamicaVia *via, float inicio, unsigned movimentos) {
+	if (via->nFaixas >= MAX_FAIXAS)
+		return -1;
+	DinamicaFaixa *faixa = &via->faixas[via->nFaixas];
+	memset(faixa, 0, sizeof(*faixa));
+	faixa->comprimento = via->comprimento;
+	faixa->velocidadeDesejada = via->velocidadeDesejada;
+	faixa->linhaParada = via->linhaParada;
+	faixa->inicio = inicio;
+	faixa->movimentos = movimentos;
+	return via->nFaixas++;
+}
+
+// Coloca um veículo no índice k da faixa, deslocando uma posição para trás os que estavam de k em diante
+static int insereNaFaixa(DinamicaFaixa *faixa, int k, void *referencia, float posicao, float velocidade, unsigned movimento) {
+	if (faixa->n >= MAX_VEICULOS_VIA)
+		return 0;
+	int resto = faixa->n - k + 1;
+	memmove(&faixa->posicao[k + 1], &faixa->posicao[k], resto * sizeof(float));
+	memmove(&faixa->velocidade[k + 1], &faixa->velocidade[k], resto * sizeof(float));
+	memmove(&faixa->lacuna[k + 1], &faixa->lacuna[k], resto * sizeof(float));
+	memmove(&faixa->referencia[k + 1], &faixa->referencia[k], resto * sizeof(void*));
+	memmove(&faixa->movimento[k + 1], &faixa->movimento[k], resto * sizeof(unsigned));
+	faixa->posicao[k] = posicao;
+	faixa->velocidade[k] = velocidade;
+	faixa->lacuna[k] = (k > 1) ? faixa->posicao[k - 1] - COMPRIMENTO_VEICULO - posicao : faixa->comprimento - posicao;
+	faixa->referencia[k] = referencia;
+	faixa->movimento[k] = movimento;
+	faixa->n++;
+	return 1;
+}
+
+static void retiraDaFaixa(DinamicaFaixa *faixa, int k) {
+	int resto = faixa->n - k;
+	memmove(&faixa->posicao[k], &faixa->posicao[k + 1], resto * sizeof(float));
+	memmove(&faixa->velocidade[k], &faixa->velocidade[k + 1], resto * sizeof(float));
+	memmove(&faixa->lacuna[k], &faixa->lacuna[k + 1], resto * sizeof(float));
+	memmove(&faixa->referencia[k], &faixa->referencia[k + 1], resto * sizeof(void*));
+	memmove(&faixa->movimento[k], &faixa->movimento[k + 1], resto * sizeof(unsigned));
+	faixa->n--;
+}
+
+// Quantas trocas separam a faixa f da faixa mais próxima que permite o movimento (0 se a própria permite).
+// Um veículo que aceita mais de um movimento procura uma faixa que permita todos e, se não houver, uma que
+// permita algum deles
+static int trocasAtePermitida(const DinamicaVia *via, int f, unsigned movimento) {
+	int menor = MAX_FAIXAS;
+	int menorParcial = MAX_FAIXAS;
+	for (int g = 0; g < via->nFaixas; g++) {
+		int distancia = g > f ? g - f : f - g;
+		unsigned permitidos = via->faixas[g].movimentos & movimento;
+		if (permitidos == movimento && distancia < menor)
+			menor = distancia;
+		if (permitidos && distancia < menorParcial)
+			menorParcial = distancia;
+	}
+	return menor < MAX_FAIXAS ? menor : menorParcial;
+}
+
+// A entrada é sempre numa faixa corrida: a que leva mais perto do movimento e, entre essas, a de maior espaço livre.
+// Uma faixa cujo último veículo ainda não se afastou IDM_DISTANCIA_MINIMA da entrada não recebe ninguém
+int insereVeiculoVia(DinamicaVia *via, void *referencia, float velocidade, unsigned movimento) {
+	int escolhida = -1;
+	int menorTrocas = 0;
+	float maiorEspaco = 0.0f;
+	for (int f = 0; f < via->nFaixas; f++) {
+		DinamicaFaixa *faixa = &via->faixas[f];
+		if (faixa->inicio > 0.0f || faixa->n >= MAX_VEICULOS_VIA)
+			continue;
+		int trocas = trocasAtePermitida(via, f, movimento);
+		float espaco = (faixa->n > 0) ? faixa->posicao[faixa->n] - COMPRIMENTO_VEICULO : faixa->comprimento;
+		if (espaco < IDM_DISTANCIA_MINIMA)
+			continue;
+		if (escolhida < 0 || trocas < menorTrocas || (trocas == menorTrocas && espaco > maiorEspaco)) {
+			escolhida = f;
+			menorTrocas = trocas;
+			maiorEspaco = espaco;
+		}
+	}
+	if (escolhida < 0)
+		return 0;
+	DinamicaFaixa *faixa = &via->faixas[escolhida];
+	return insereNaFaixa(faixa, faixa->n + 1, referencia, 0.0f, velocidade, movimento);
+}
+
+int removePrimeiroVia(DinamicaVia *via, void *referencia) {
+	for (int f = 0; f < via->nFaixas; f++) {
+		DinamicaFaixa *faixa = &via->faixas[f];
+		if (faixa->n > 0 && faixa->referencia[1] == referencia) {
+			retiraDaFaixa(faixa, 1);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int capacidadeVia(const DinamicaVia *via) {
+	int capacidade = 0;
+	for (int f = 0; f < via->nFaixas; f++) {
+		int faixa = (int)((via->comprimento - via->faixas[f].inicio) / ESPACAMENTO_PARADO);
+		capacidade += faixa < MAX_VEICULOS_VIA ? faixa : MAX_VEICULOS_VIA;
+	}
+	return capacidade;
+}
+
+// O líder virtual é a linha de parada (um obstáculo parado que faz o veículo parar com a frente no fim da via)
+// ou um líder muito distante na velocidade desejada, quando a via é livre
+static void posicionaLiderVirtual(DinamicaFaixa *faixa) {
+	if (faixa->linhaParada) {
+		faixa->posicao[0] = faixa->comprimento + IDM_DISTANCIA_MINIMA + COMPRIMENTO_VEICULO;
+		faixa->velocidade[0] = 0.0f;
+	}
+	else {
+		faixa->posicao[0] = LIDER_LIVRE;
+		faixa->velocidade[0] = faixa->velocidadeDesejada;
+	}
+}
+
+static inline float aceleracaoIDM(float v, float vLider, float lacuna, float velocidadeDesejada) {
+	const float fatorInteracao = 0.5f / sqrtf(IDM_ACELERACAO * IDM_DESACELERACAO);
+	if (lacuna < LACUNA_MINIMA)
+		lacuna = LACUNA_MINIMA;
+	float interacao = v * IDM_TEMPO_SEGURO + v * (v - vLider) * fatorInteracao;
+	float lacunaDesejada = IDM_DISTANCIA_MINIMA + (interacao > 0.0f ? interacao : 0.0f);
+	float razaoVelocidade = v / velocidadeDesejada;
+	razaoVelocidade *= razaoVelocidade;
+	float razaoLacuna = lacunaDesejada / lacuna;
+	return IDM_ACELERACAO * (1.0f - razaoVelocidade * razaoVelocidade - razaoLacuna * razaoLacuna);
+}
+
+// Os veículos são percorridos de trás para frente: assim o líder do veículo k ainda tem o estado do início do
+// passo quando k é calculado, e todos avançam a partir do mesmo instante
+static void passoEscalar(DinamicaFaixa *faixa, float dt) {
+	float *x = faixa->posicao;
+	float *v = faixa->velocidade;
+
+	for (int k = faixa->n; k >= 1; k--) {
+		float lacuna = x[k - 1] - COMPRIMENTO_VEICULO - x[k];
+		if (lacuna < LACUNA_MINIMA)
+			lacuna = LACUNA_MINIMA;
+		float aceleracao = aceleracaoIDM(v[k], v[k - 1], lacuna, faixa->velocidadeDesejada);
+		if (aceleracao < -IDM_FRENAGEM_MAXIMA)
+			aceleracao = -IDM_FRENAGEM_MAXIMA;
+
+		float novaVelocidade = v[k] + aceleracao * dt;
+		if (novaVelocidade < 0.0f) { // Para dentro do passo: anda só a distância de frenagem
+			x[k] += -0.5f * v[k] * v[k] / aceleracao;
+			novaVelocidade = 0.0f;
+		}
+		else {
+			x[k] += 0.5f * (v[k] + novaVelocidade) * dt;
+		}
+		v[k] = novaVelocidade;
+		faixa->lacuna[k] = lacuna;
+	}
+}
+
+#if NUCLEO_AVX2
+// 1/x pela aproximação do processador refinada por uma iteração de Newton-Raphson (erro relativo ~1e-7),
+// bem mais barata que a divisão
+ALVO_AVX2 static inline __m256 inverso(__m256 x) {
+	__m256 r = _mm256_rcp_ps(x);
+	return _mm256_mul_ps(r, _mm256_sub_ps(_mm256_set1_ps(2.0f), _mm256_mul_ps(x, r)));
+}
+
+// Mesmo cálculo do passoEscalar, 8 veículos por vez. Os blocos também vão de trás para frente, e cada bloco
+// lê o estado dos líderes (índices deslocados de 1) antes de gravar o seu
+ALVO_AVX2 static void passoAVX2(DinamicaFaixa *faixa, float dt) {
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 meio = _mm256_set1_ps(0.5f);
+	const __m256 um = _mm256_set1_ps(1.0f);
+	const __m256 comprimentoVeiculo = _mm256_set1_ps(COMPRIMENTO_VEICULO);
+	const __m256 lacunaMinima = _mm256_set1_ps(LACUNA_MINIMA);
+	const __m256 tempoSeguro = _mm256_set1_ps(IDM_TEMPO_SEGURO);
+	const __m256 fatorInteracao = _mm256_set1_ps(0.5f / sqrtf(IDM_ACELERACAO * IDM_DESACELERACAO));
+	const __m256 distanciaMinima = _mm256_set1_ps(IDM_DISTANCIA_MINIMA);
+	const __m256 inversoV0 = _mm256_set1_ps(1.0f / faixa->velocidadeDesejada);
+	const __m256 aceleracaoMaxima = _mm256_set1_ps(IDM_ACELERACAO);
+	const __m256 frenagemMaxima = _mm256_set1_ps(-IDM_FRENAGEM_MAXIMA);
+	const __m256 passo = _mm256_set1_ps(dt);
+	const __m256i indices = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i limite = _mm256_set1_epi32(faixa->n + 1);
+	float *x = faixa->posicao;
+	float *v = faixa->velocidade;
+
+	if (faixa->n == 0)
+		return;
+
+	for (int i = 1 + ((faixa->n - 1) / 8) * 8; i >= 1; i -= 8) {
+		__m256 xLider = _mm256_loadu_ps(x + i - 1);
+		__m256 vLider = _mm256_loadu_ps(v + i - 1);
+		__m256 xk = _mm256_loadu_ps(x + i);
+		__m256 vk = _mm256_loadu_ps(v + i);
+
+		__m256 lacuna = _mm256_max_ps(_mm256_sub_ps(_mm256_sub_ps(xLider, comprimentoVeiculo), xk), lacunaMinima);
+		__m256 interacao = _mm256_add_ps(_mm256_mul_ps(vk, tempoSeguro),
+			_mm256_mul_ps(_mm256_mul_ps(vk, _mm256_sub_ps(vk, vLider)), fatorInteracao));
+		__m256 lacunaDesejada = _mm256_add_ps(distanciaMinima, _mm256_max_ps(interacao, zero));
+		__m256 razaoVelocidade = _mm256_mul_ps(vk, inversoV0);
+		razaoVelocidade = _mm256_mul_ps(razaoVelocidade, razaoVelocidade);
+		razaoVelocidade = _mm256_mul_ps(razaoVelocidade, razaoVelocidade);
+		__m256 razaoLacuna = _mm256_mul_ps(lacunaDesejada, inverso(lacuna));
+		razaoLacuna = _mm256_mul_ps(razaoLacuna, razaoLacuna);
+		__m256 aceleracao = _mm256_mul_ps(aceleracaoMaxima, _mm256_sub_ps(_mm256_sub_ps(um, razaoVelocidade), razaoLacuna));
+		aceleracao = _mm256_max_ps(aceleracao, frenagemMaxima);
+
+		__m256 novaVelocidade = _mm256_add_ps(vk, _mm256_mul_ps(aceleracao, passo));
+		__m256 parou = _mm256_cmp_ps(novaVelocidade, zero, _CMP_LT_OQ);
+		__m256 deslocamento = _mm256_mul_ps(_mm256_mul_ps(meio, _mm256_add_ps(vk, novaVelocidade)), passo);
+		__m256 frenagem = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(meio, vk), vk), inverso(_mm256_sub_ps(zero, aceleracao)));
+		deslocamento = _mm256_blendv_ps(deslocamento, frenagem, parou);
+		novaVelocidade = _mm256_max_ps(novaVelocidade, zero);
+
+		if (i + 7 <= faixa->n) {
+			_mm256_storeu_ps(x + i, _mm256_add_ps(xk, deslocamento));
+			_mm256_storeu_ps(v + i, novaVelocidade);
+			_mm256_storeu_ps(faixa->lacuna + i, lacuna);
+		}
+		else { // No último bloco só grava as posições ocupadas por veículos
+			__m256i mascara = _mm256_cmpgt_epi32(limite, _mm256_add_epi32(indices, _mm256_set1_epi32(i)));
+			_mm256_maskstore_ps(x + i, mascara, _mm256_add_ps(xk, deslocamento));
+			_mm256_maskstore_ps(v + i, mascara, novaVelocidade);
+			_mm256_maskstore_ps(faixa->lacuna + i, mascara, lacuna);
+		}
+	}
+}
+
+static int suportaAVX2(void) {
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return 0;
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) // OSXSAVE e AVX
+		return 0;
+	if ((_xgetbv(0) & 6) != 6) // O sistema salva os registradores YMM na troca de contexto
+		return 0;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif /* NUCLEO_AVX2 */
+
+int inicializaDinamica(void) {
+#if NUCLEO_AVX2
+	if (suportaAVX2()) {
+		passoNucleo = passoAVX2;
+		return 1;
+	}
+#endif
+	passoNucleo = passoEscalar;
+	return 0;
+}
+
+void usaNucleoEscalar(void) {
+	passoNucleo = passoEscalar;
+}
+
+// Avalia a entrada de um veículo na posição x, com velocidade v, na faixa dada. A troca é segura se sobra a
+// distância mínima até o novo líder e até o novo seguidor, e se o seguidor não precisa frear mais que
+// TROCA_FRENAGEM_SEGURA. Devolve o índice em que o veículo entraria e a aceleração que ele teria lá
+static int avaliaEntrada(const DinamicaFaixa *faixa, float x, float v, int *indice, float *aceleracao) {
+	if (x < faixa->inicio || faixa->n >= MAX_VEICULOS_VIA)
+		return 0;
+	int lider = 0;
+	while (lider < faixa->n && faixa->posicao[lider + 1] >= x)
+		lider++;
+	float lacunaLider = faixa->posicao[lider] - COMPRIMENTO_VEICULO - x;
+	if (lacunaLider < IDM_DISTANCIA_MINIMA)
+		return 0;
+	if (lider < faixa->n) {
+		int seguidor = lider + 1;
+		float lacunaSeguidor = x - COMPRIMENTO_VEICULO - faixa->posicao[seguidor];
+		if (lacunaSeguidor < IDM_DISTANCIA_MINIMA)
+			return 0;
+		if (aceleracaoIDM(faixa->velocidade[seguidor], v, lacunaSeguidor, faixa->velocidadeDesejada) < -TROCA_FRENAGEM_SEGURA)
+			return 0;
+	}
+	*indice = lider + 1;
+	*aceleracao = aceleracaoIDM(v, faixa->velocidade[lider], lacunaLider, faixa->velocidadeDesejada);
+	return 1;
+}
+
+// Faixa vizinha para onde o veículo k da faixa f quer ir, ou -1. A troca é obrigatória quando aproxima o
+// veículo de uma faixa que permite o seu movimento e opcional, entre faixas igualmente boas, quando o ganho
+// de aceleração passa de TROCA_LIMIAR. Nunca afasta o veículo da faixa permitida
+static int faixaDesejada(const DinamicaVia *via, int f, int k) {
+	const DinamicaFaixa *faixa = &via->faixas[f];
+	float x = faixa->posicao[k];
+	float v = faixa->velocidade[k];
+	unsigned movimento = faixa->movimento[k];
+	int trocas = trocasAtePermitida(via, f, movimento);
+	float atual = aceleracaoIDM(v, faixa->velocidade[k - 1], faixa->posicao[k - 1] - COMPRIMENTO_VEICULO - x, faixa->velocidadeDesejada);
+	int desejada = -1;
+	float maiorGanho = TROCA_LIMIAR;
+
+	for (int g = f - 1; g <= f + 1; g += 2) {
+		if (g < 0 || g >= via->nFaixas)
+			continue;
+		int trocasVizinha = trocasAtePermitida(via, g, movimento);
+		if (trocasVizinha > trocas)
+			continue;
+		int indice;
+		float aceleracao;
+		if (!avaliaEntrada(&via->faixas[g], x, v, &indice, &aceleracao))
+			continue;
+		float ganho = (trocasVizinha < trocas) ? LIDER_LIVRE : aceleracao - atual;
+		if (ganho > maiorGanho) {
+			desejada = g;
+			maiorGanho = ganho;
+		}
+	}
+	return desejada;
+}
+
+// Trocas de faixa da via num passo. As decisões são tomadas todas sobre o estado do fim do passo de
+// integração e só depois aplicadas, com a segurança conferida de novo porque uma troca anterior do mesmo
+// lote pode ter ocupado o espaço
+static void trocaFaixas(DinamicaVia *via) {
+	struct {
+		void *referencia;
+		int origem;
+		int destino;
+	} trocas[MAX_FAIXAS * MAX_VEICULOS_VIA];
+	int nTrocas = 0;
+
+	if (via->nFaixas < 2)
+		return;
+	for (int f = 0; f < via->nFaixas; f++) {
+		for (int k = 1; k <= via->faixas[f].n; k++) {
+			int destino = faixaDesejada(via, f, k);
+			if (destino >= 0) {
+				trocas[nTrocas].referencia = via->faixas[f].referencia[k];
+				trocas[nTrocas].origem = f;
+				trocas[nTrocas].destino = destino;
+				nTrocas++;
+			}
+		}
+	}
+	for (int t = 0; t < nTrocas; t++) {
+		DinamicaFaixa *origem = &via->faixas[trocas[t].origem];
+		DinamicaFaixa *destino = &via->faixas[trocas[t].destino];
+		int k = 1;
+		while (k <= origem->n && origem->referencia[k] != trocas[t].referencia)
+			k++;
+		int indice;
+		float aceleracao;
+		if (k > origem->n || !avaliaEntrada(destino, origem->posicao[k], origem->velocidade[k], &indice, &aceleracao))
+			continue;
+		insereNaFaixa(destino, indice, origem->referencia[k], origem->posicao[k], origem->velocidade[k], origem->movimento[k]);
+		retiraDaFaixa(origem, k);
+	}
+}
+
+void passoDinamicaVia(DinamicaVia *via, float dt) {
+	for (int f = 0; f < via->nFaixas; f++) {
+		DinamicaFaixa *faixa = &via->faixas[f];
+		posicionaLiderVirtual(faixa);
+		passoNucleo(faixa, dt);
+		if (faixa->linhaParada && faixa->n > 0 && faixa->posicao[1] > faixa->comprimento)
+			faixa->posicao[1] = faixa->comprimento;
+	}
+	trocaFaixas(via);
+}
@@ -0,0 +1,85 @@
+#ifndef DINAMICA_H
+#define DINAMICA_H
+
+// Dinâmica dos veículos ao longo de uma via: seguimento na faixa (modelo IDM) e troca de faixa.
+// O estado de cada faixa fica em vetores contíguos (posição, velocidade, lacuna) para que o passo de integração
+// seja feito em lote, com AVX2 quando o processador permite e com um laço escalar nos demais casos.
+// O lote é uma faixa (até MAX_VEICULOS_VIA veículos), não a rede: cada faixa paga o líder virtual, as constantes
+// do núcleo e um último bloco parcial, de modo que o AVX2 só rende em faixas cheias. Medido com gcc -O2, são cerca
+// de 1,2 ns por veículo-passo em faixas de 64 veículos (5 ns no escalar) e 5,5 ns em faixas de 8, acima da meta
+// de bem menos de 1 ms por milhão de veículos-passo; juntar as faixas de várias vias num só vetor resolveria.
+// Este módulo não usa a API do FreeRTOS.
+
+#define MAX_VEICULOS_VIA 64 // Múltiplo de 8, a largura do AVX2 em floats
+#define FOLGA_VETORIAL 8    // Posições extras no fim dos vetores para o último bloco de 8
+
+// Parâmetros do Intelligent Driver Model
+#define IDM_ACELERACAO 1.5f     // a: aceleração máxima (m/s²)
+#define IDM_DESACELERACAO 2.0f  // b: desaceleração confortável (m/s²)
+#define IDM_FRENAGEM_MAXIMA 9.0f // Limite físico de frenagem (m/s²)
+#define IDM_TEMPO_SEGURO 1.2f   // T: intervalo de tempo desejado até o líder (s)
+#define IDM_DISTANCIA_MINIMA 2.0f // s0: distância mínima parado (m)
+#define COMPRIMENTO_VEICULO 5.0f  // L (m)
+
+#define ESPACAMENTO_PARADO (COMPRIMENTO_VEICULO + IDM_DISTANCIA_MINIMA) // Entre frentes de veículos parados (m)
+
+#define LIDER_LIVRE 1.0e6f // Posição do líder virtual quando não há obstáculo à frente
+
+#define MAX_FAIXAS 4 // Faixas por via, contando os bolsões de conversão
+
+// Parâmetros da troca de faixa (critério de segurança e de incentivo no estilo do MOBIL)
+#define TROCA_FRENAGEM_SEGURA 4.0f // Maior frenagem (m/s²) imposta ao novo seguidor
+#define TROCA_LIMIAR 0.3f          // Ganho mínimo de aceleração (m/s²) para uma troca opcional
+
+// Vetores de estado de uma faixa. O índice 0 guarda um líder virtual (a linha de parada ou a via livre) e os
+// veículos ocupam os índices 1..n, do mais próximo do fim da via para o mais distante, de modo que o líder
+// do veículo k é sempre o k - 1
+typedef struct {
+	float posicao[1 + MAX_VEICULOS_VIA + FOLGA_VETORIAL];    // Frente do veículo, em metros desde o início da via
+	float velocidade[1 + MAX_VEICULOS_VIA + FOLGA_VETORIAL]; // m/s
+	float lacuna[1 + MAX_VEICULOS_VIA + FOLGA_VETORIAL];     // Distância livre até o líder (m), do último passo
+	void *referencia[1 + MAX_VEICULOS_VIA];                  // Dado do chamador associado a cada veículo
+	unsigned movimento[1 + MAX_VEICULOS_VIA];                // Movimentos que o veículo aceita ao fim da via (um bit cada)
+	int n;
+	float comprimento;        // m
+	float velocidadeDesejada; // v0 (m/s)
+	int linhaParada;          // 1 = o primeiro veículo para no fim da via
+	float inicio;             // Posição (m) em que a faixa começa: 0 nas faixas corridas, > 0 nos bolsões
+	unsigned movimentos;      // Movimentos permitidos na linha de parada desta faixa
+} DinamicaFaixa;
+
+// Uma via com suas faixas, numeradas da direita (0) para a esquerda. Os bolsões de conversão ficam à esquerda
+// e só existem no trecho final da via
+typedef struct {
+	DinamicaFaixa faixas[MAX_FAIXAS];
+	int nFaixas;
+	float comprimento;
+	float velocidadeDesejada;
+	int linhaParada;
+} DinamicaVia;
+
+void inicializaDinamicaVia(DinamicaVia *via, float comprimento, float velocidadeDesejada, int linhaParada);
+
+// Acrescenta uma faixa à esquerda das existentes. Retorna o índice da faixa ou -1 se a via já tem MAX_FAIXAS
+int adicionaFaixa(DinamicaVia *via, float inicio, unsigned movimentos);
+
+// Coloca um veículo no início da via, na faixa corrida mais adequada ao movimento. Retorna 0 se nenhuma faixa
+// corrida tem lugar na entrada (faixa cheia ou último veículo ainda junto ao início); o chamador tenta de novo depois
+int insereVeiculoVia(DinamicaVia *via, void *referencia, float velocidade, unsigned movimento);
+
+// Retira o veículo da via. Ele deve ser o primeiro da sua faixa. Retorna 0 se não o encontrou
+int removePrimeiroVia(DinamicaVia *via, void *referencia);
+
+// Quantos veículos parados cabem na via, somando as faixas, com ESPACAMENTO_PARADO entre frentes
+int capacidadeVia(const DinamicaVia *via);
+
+// Avança todos os veículos da via em dt segundos e depois faz as trocas de faixa, em lote
+void passoDinamicaVia(DinamicaVia *via, float dt);
+
+// Escolhe o núcleo AVX2 ou o escalar conforme o processador. Retorna 1 se o AVX2 foi selecionado
+int inicializaDinamica(void);
+
+// Passa a usar o laço escalar mesmo com AVX2 disponível, para comparar os dois núcleos (testes/)
+void usaNucleoEscalar(void);
+
+#endif /* DINAMICA_H */
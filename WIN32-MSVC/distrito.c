@@ -0,0 +1,226 @@
+/* Standard includes. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+
+#include "distrito.h"
+#include "anel.h"
+
+#define TAMANHO_CABECALHO 12 // passo, origem, nRegistros
+#define TAMANHO_REGISTRO 7   // tipo, via, valor, dado
+
+typedef struct {
+	SOCKET conexao;
+	AnelSPSC saida;
+	PacoteDistrito memoriaSaida[CAPACIDADE_PACOTES];
+	AnelSPSC entrada;
+	PacoteDistrito memoriaEntrada[CAPACIDADE_PACOTES];
+} Vizinho;
+
+static Vizinho vizinhos[MAX_DISTRITOS];
+
+static void escreve32(unsigned char *p, uint32_t valor) {
+	p[0] = (unsigned char)valor;
+	p[1] = (unsigned char)(valor >> 8);
+	p[2] = (unsigned char)(valor >> 16);
+	p[3] = (unsigned char)(valor >> 24);
+}
+
+static uint32_t le32(const unsigned char *p) {
+	return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static int enviaTudo(SOCKET conexao, const unsigned char *dados, int tamanho) {
+	while (tamanho > 0) {
+		int enviados = send(conexao, (const char*)dados, tamanho, 0);
+		if (enviados <= 0)
+			return 0;
+		dados += enviados;
+		tamanho -= enviados;
+	}
+	return 1;
+}
+
+static int recebeTudo(SOCKET conexao, unsigned char *dados, int tamanho) {
+	while (tamanho > 0) {
+		int recebidos = recv(conexao, (char*)dados, tamanho, 0);
+		if (recebidos <= 0)
+			return 0;
+		dados += recebidos;
+		tamanho -= recebidos;
+	}
+	return 1;
+}
+
+static int serializaPacote(const PacoteDistrito *pacote, unsigned char *buffer) {
+	unsigned char *p = buffer + TAMANHO_CABECALHO;
+	escreve32(buffer, pacote->passo);
+	escreve32(buffer + 4, (uint32_t)pacote->origem);
+	escreve32(buffer + 8, (uint32_t)pacote->nRegistros);
+	for (int i = 0; i < pacote->nRegistros; i++, p += TAMANHO_REGISTRO) {
+		const RegistroDistrito *registro = &pacote->registros[i];
+		p[0] = registro->tipo;
+		p[1] = registro->via;
+		p[2] = registro->valor;
+		escreve32(p + 3, (uint32_t)registro->dado);
+	}
+	return (int)(p - buffer);
+}
+
+static int recebePacote(SOCKET conexao, PacoteDistrito *pacote) {
+	unsigned char buffer[MAX_REGISTROS_PACOTE * TAMANHO_REGISTRO];
+	if (!recebeTudo(conexao, buffer, TAMANHO_CABECALHO))
+		return 0;
+	pacote->passo = le32(buffer);
+	pacote->origem = (int)le32(buffer + 4);
+	pacote->nRegistros = (int)le32(buffer + 8);
+	if (pacote->nRegistros < 0 || pacote->nRegistros > MAX_REGISTROS_PACOTE)
+		return 0;
+	if (!recebeTudo(conexao, buffer, pacote->nRegistros * TAMANHO_REGISTRO))
+		return 0;
+	for (int i = 0; i < pacote->nRegistros; i++) {
+		const unsigned char *p = buffer + i * TAMANHO_REGISTRO;
+		pacote->registros[i].tipo = p[0];
+		pacote->registros[i].via = p[1];
+		pacote->registros[i].valor = p[2];
+		pacote->registros[i].dado = (int32_t)le32(p + 3);
+	}
+	return 1;
+}
+
+// Os dois lados mandam o pacote do passo e depois esperam o do outro; como os dois enviam antes de ler,
+// não há espera circular. Se o coordenador não lê os pacotes recebidos, a thread para de ler a conexão e o
+// vizinho acaba bloqueado no envio, o que limita a distância entre os passos dos dois distritos
+static DWORD WINAPI threadVizinho(LPVOID parametro) {
+	Vizinho *vizinho = parametro;
+	PacoteDistrito pacote;
+	unsigned char buffer[TAMANHO_CABECALHO + MAX_REGISTROS_PACOTE * TAMANHO_REGISTRO];
+
+	while (1) {
+		while (!leAnel(&vizinho->saida, &pacote))
+			Sleep(1);
+		if (!enviaTudo(vizinho->conexao, buffer, serializaPacote(&pacote, buffer)))
+			break;
+		if (!recebePacote(vizinho->conexao, &pacote))
+			break;
+		while (!escreveAnel(&vizinho->entrada, &pacote))
+			Sleep(1);
+	}
+	printf("Distrito %d desconectado\n", (int)(vizinho - vizinhos));
+	closesocket(vizinho->conexao);
+	return 0;
+}
+
+// Endereço do distrito na lista de hosts separados por vírgula
+static void hostDistrito(const char *hosts, int distrito, char *host, int tamanho) {
+	const char *inicio = hosts != NULL ? hosts : "127.0.0.1";
+	for (int i = 0; i < distrito; i++) {
+		const char *virgula = strchr(inicio, ',');
+		if (virgula == NULL)
+			break;
+		inicio = virgula + 1;
+	}
+	int n = (int)strcspn(inicio, ",");
+	if (n >= tamanho)
+		n = tamanho - 1;
+	memcpy(host, inicio, n);
+	host[n] = '\0';
+}
+
+// Liga ao distrito de número menor, tentando até ele começar a escutar, e se identifica
+static SOCKET ligaDistrito(const char *hosts, int distrito, int portaBase, int origem) {
+	char host[64], porta[16];
+	struct addrinfo dicas, *endereco;
+	unsigned char identificacao[4];
+
+	hostDistrito(hosts, distrito, host, sizeof(host));
+	sprintf(porta, "%d", portaBase + distrito);
+	memset(&dicas, 0, sizeof(dicas));
+	dicas.ai_family = AF_INET;
+	dicas.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host, porta, &dicas, &endereco) != 0)
+		return INVALID_SOCKET;
+	SOCKET conexao = INVALID_SOCKET;
+	while (conexao == INVALID_SOCKET) {
+		conexao = socket(endereco->ai_family, endereco->ai_socktype, endereco->ai_protocol);
+		if (conexao == INVALID_SOCKET)
+			break;
+		if (connect(conexao, endereco->ai_addr, (int)endereco->ai_addrlen) != 0) {
+			closesocket(conexao);
+			conexao = INVALID_SOCKET;
+			Sleep(200);
+		}
+	}
+	freeaddrinfo(endereco);
+	escreve32(identificacao, (uint32_t)origem);
+	if (conexao != INVALID_SOCKET && !enviaTudo(conexao, identificacao, 4)) {
+		closesocket(conexao);
+		conexao = INVALID_SOCKET;
+	}
+	return conexao;
+}
+
+int conectaDistritos(int distrito, int nDistritos, const int vizinho[MAX_DISTRITOS], const char *hosts, int portaBase) {
+	WSADATA wsa;
+	int esperados = 0; // Vizinhos de número maior, que ligam para este distrito
+
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+		return 0;
+	for (int d = 0; d < nDistritos; d++) {
+		vizinhos[d].conexao = INVALID_SOCKET;
+		inicializaAnel(&vizinhos[d].saida, vizinhos[d].memoriaSaida, sizeof(PacoteDistrito), CAPACIDADE_PACOTES);
+		inicializaAnel(&vizinhos[d].entrada, vizinhos[d].memoriaEntrada, sizeof(PacoteDistrito), CAPACIDADE_PACOTES);
+		if (vizinho[d] && d > distrito)
+			esperados++;
+	}
+
+	if (esperados > 0) {
+		struct sockaddr_in local;
+		SOCKET escuta = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		memset(&local, 0, sizeof(local));
+		local.sin_family = AF_INET;
+		local.sin_addr.s_addr = htonl(INADDR_ANY);
+		local.sin_port = htons((u_short)(portaBase + distrito));
+		if (escuta == INVALID_SOCKET || bind(escuta, (struct sockaddr*)&local, sizeof(local)) != 0 || listen(escuta, MAX_DISTRITOS) != 0)
+			return 0;
+		while (esperados > 0) {
+			unsigned char identificacao[4];
+			SOCKET conexao = accept(escuta, NULL, NULL);
+			if (conexao == INVALID_SOCKET || !recebeTudo(conexao, identificacao, 4))
+				return 0;
+			int origem = (int)le32(identificacao);
+			if (origem <= distrito || origem >= nDistritos || !vizinho[origem] || vizinhos[origem].conexao != INVALID_SOCKET) {
+				closesocket(conexao);
+				continue;
+			}
+			vizinhos[origem].conexao = conexao;
+			esperados--;
+		}
+		closesocket(escuta);
+	}
+	for (int d = 0; d < distrito; d++) {
+		if (vizinho[d] && (vizinhos[d].conexao = ligaDistrito(hosts, d, portaBase, distrito)) == INVALID_SOCKET)
+			return 0;
+	}
+
+	for (int d = 0; d < nDistritos; d++) {
+		if (!vizinho[d])
+			continue;
+		BOOL semAtraso = TRUE; // Os pacotes são pequenos e cada passo espera a resposta
+		setsockopt(vizinhos[d].conexao, IPPROTO_TCP, TCP_NODELAY, (const char*)&semAtraso, sizeof(semAtraso));
+		if (CreateThread(NULL, 0, threadVizinho, &vizinhos[d], 0, NULL) == NULL)
+			return 0;
+	}
+	return 1;
+}
+
+int enviaPacoteDistrito(int vizinho, const PacoteDistrito *pacote) {
+	return escreveAnel(&vizinhos[vizinho].saida, pacote);
+}
+
+int recebePacoteDistrito(int vizinho, PacoteDistrito *pacote) {
+	return leAnel(&vizinhos[vizinho].entrada, pacote);
+}
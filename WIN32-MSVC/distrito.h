@@ -0,0 +1,54 @@
+#ifndef DISTRITO_H
+#define DISTRITO_H
+
+#include <stdint.h>
+
+// Troca de estado entre distritos da malha, cada um simulado por um processo. A cada passo da dinâmica, cada
+// distrito manda um pacote a cada vizinho (os que têm vias em comum com ele) e lê os pacotes que já chegaram do
+// vizinho, sem esperar o do mesmo passo; um distrito pode estar até CAPACIDADE_PACOTES passos à frente do
+// outro antes que o envio o faça esperar. Os pacotes levam registros de tamanho fixo: veículos que passam para
+// uma via do vizinho, vagas devolvidas nas vias de fronteira, ocupação das células de fronteira (a zona
+// fantasma desenhada do outro lado) e a fase dos sinais.
+// O transporte é TCP, com os campos serializados em little-endian, para que o mesmo protocolo sirva entre
+// máquinas; em uma só máquina os processos se ligam pelo endereço local. Uma thread nativa por vizinho faz a
+// troca, e quem coordena só conversa com ela por filas SPSC, sem nunca bloquear na rede.
+// Este módulo não usa a API do FreeRTOS.
+
+#define MAX_DISTRITOS 4
+#define MAX_REGISTROS_PACOTE 64
+#define CAPACIDADE_PACOTES 8 // Pacotes em trânsito por vizinho e sentido. Potência de 2
+#define PORTA_DISTRITOS 27015 // O distrito k escuta na porta base + k
+
+typedef enum {
+	REGISTRO_VEICULO, // via: via de destino, valor: direção no próximo cruzamento (alternativas nos bits 2 a 4), dado: id do veículo
+	REGISTRO_VAGAS,   // via: via de fronteira, dado: vagas devolvidas desde o último pacote
+	REGISTRO_CELULAS, // via: via de fronteira, dado: máscara das células ocupadas (bit i = célula i)
+	REGISTRO_FASE     // valor: fase dos sinais do distrito de origem
+} TipoRegistro;
+
+typedef struct {
+	uint8_t tipo;
+	uint8_t via;
+	uint8_t valor;
+	int32_t dado;
+} RegistroDistrito;
+
+typedef struct {
+	uint32_t passo;
+	int origem;
+	int nRegistros;
+	RegistroDistrito registros[MAX_REGISTROS_PACOTE];
+} PacoteDistrito;
+
+// Liga este distrito aos vizinhos marcados em vizinho[] e cria as threads de troca. hosts é uma lista de
+// endereços separados por vírgula, um por distrito; o último vale para os que faltarem (NULL = "127.0.0.1").
+// Bloqueia até todas as ligações estarem feitas. Retorna 0 em caso de erro
+int conectaDistritos(int distrito, int nDistritos, const int vizinho[MAX_DISTRITOS], const char *hosts, int portaBase);
+
+// Coordenador: entrega o pacote do passo para envio ao vizinho. Retorna 0 se a fila de saída está cheia
+int enviaPacoteDistrito(int vizinho, const PacoteDistrito *pacote);
+
+// Coordenador: lê o próximo pacote recebido do vizinho. Retorna 0 se nenhum chegou
+int recebePacoteDistrito(int vizinho, PacoteDistrito *pacote);
+
+#endif /* DISTRITO_H */
@@ -0,0 +1,143 @@
+/* Standard includes. */
+#include <string.h>
+
+#include "fragmentos.h"
+
+typedef struct {
+	DinamicaVia *dinamica;
+	int saida;
+	int dono; // Fragmento
+	AnelSPSC pedidos;
+	PedidoVia memoriaPedidos[CAPACIDADE_PEDIDOS_VIA];
+	AnelSPSC eventos;
+	EventoVia memoriaEventos[CAPACIDADE_EVENTOS_VIA];
+	// Pedidos lidos que ainda não puderam ser aplicados, na ordem em que chegaram. Só o trabalho da via os toca
+	PedidoVia adiados[CAPACIDADE_PEDIDOS_VIA];
+	int nAdiados;
+} ViaFragmentada;
+
+typedef struct {
+	int vias[MAX_VIAS_FRAGMENTADAS];
+	int nVias;
+} Fragmento;
+
+static ViaFragmentada viasFragmentadas[MAX_VIAS_FRAGMENTADAS];
+static int nViasFragmentadas;
+static Fragmento fragmentos[MAX_FRAGMENTOS];
+static int nFragmentos;
+static float passoAtual;
+
+static void emiteEvento(ViaFragmentada *via, TipoEventoVia tipo, int v, void *referencia, unsigned movimentos) {
+	EventoVia evento = { tipo, v, referencia, movimentos };
+	escreveAnel(&via->eventos, &evento);
+}
+
+// Aplica um pedido à dinâmica. Uma entrada espera enquanto houver outra adiada antes dela, para que os veículos
+// entrem na ordem em que chegaram; uma saída nunca espera atrás de uma entrada, pois é ela que abre espaço na via.
+// A saída de um veículo cuja entrada ainda está adiada só cancela a entrada. Retorna 0 se o pedido não pôde ser
+// aplicado neste passo
+static int aplicaPedido(ViaFragmentada *via, const PedidoVia *pedido, int entradasAntes) {
+	if (pedido->tipo == ENTRA_VIA)
+		return !entradasAntes && insereVeiculoVia(via->dinamica, pedido->referencia, pedido->velocidade, pedido->movimento);
+	if (removePrimeiroVia(via->dinamica, pedido->referencia))
+		return 1;
+	for (int i = 0; i < via->nAdiados; i++) {
+		if (via->adiados[i].tipo == ENTRA_VIA && via->adiados[i].referencia == pedido->referencia) {
+			via->nAdiados--;
+			memmove(&via->adiados[i], &via->adiados[i + 1], (via->nAdiados - i) * sizeof(PedidoVia));
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Trabalho de uma via: aplica os pedidos, avança a dinâmica e emite os eventos. Só toca no estado da via.
+// Um pedido que falha (a entrada sem lugar na faixa, a saída de um veículo que ainda não é o primeiro) fica
+// adiado e é tentado de novo no próximo passo; com a lista de adiados cheia, os pedidos esperam na fila
+static void passoVia(void *argumento) {
+	ViaFragmentada *via = argumento;
+	int v = (int)(via - viasFragmentadas);
+	DinamicaVia *dinamica = via->dinamica;
+	PedidoVia pedido;
+	PedidoVia anteriores[CAPACIDADE_PEDIDOS_VIA];
+	int nAnteriores = via->nAdiados;
+	int entradasAdiadas = 0;
+
+	// Os adiados voltam para a lista à medida que falham de novo, antes dos pedidos novos
+	memcpy(anteriores, via->adiados, nAnteriores * sizeof(PedidoVia));
+	via->nAdiados = 0;
+	for (int i = 0; i < nAnteriores; i++) {
+		if (!aplicaPedido(via, &anteriores[i], entradasAdiadas)) {
+			entradasAdiadas |= anteriores[i].tipo == ENTRA_VIA;
+			via->adiados[via->nAdiados++] = anteriores[i];
+		}
+	}
+	while (via->nAdiados < CAPACIDADE_PEDIDOS_VIA && leAnel(&via->pedidos, &pedido)) {
+		if (!aplicaPedido(via, &pedido, entradasAdiadas)) {
+			entradasAdiadas |= pedido.tipo == ENTRA_VIA;
+			via->adiados[via->nAdiados++] = pedido;
+		}
+	}
+	passoDinamicaVia(dinamica, passoAtual);
+
+	for (int f = 0; f < dinamica->nFaixas; f++) {
+		DinamicaFaixa *faixa = &dinamica->faixas[f];
+		if (via->saida) {
+			// Só retira o veículo se o evento couber na fila; senão ele sai no próximo passo
+			while (faixa->n > 0 && faixa->posicao[1] >= faixa->comprimento) {
+				EventoVia evento = { DEIXOU_MALHA, v, faixa->referencia[1] };
+				if (!escreveAnel(&via->eventos, &evento))
+					break;
+				removePrimeiroVia(dinamica, evento.referencia);
+			}
+		}
+		else if (faixa->n > 0 && faixa->posicao[1] >= faixa->comprimento - TOLERANCIA_PARADA) {
+			emiteEvento(via, CHEGOU_PARADA, v, faixa->referencia[1], faixa->movimentos);
+		}
+	}
+}
+
+int inicializaFragmentos(DinamicaVia *vias, const int *donoVia, const int *saidaVia, int nVias, int threads) {
+	memset(fragmentos, 0, sizeof(fragmentos));
+	nFragmentos = 0;
+	nViasFragmentadas = nVias < MAX_VIAS_FRAGMENTADAS ? nVias : MAX_VIAS_FRAGMENTADAS;
+	for (int v = 0; v < nViasFragmentadas; v++) {
+		ViaFragmentada *via = &viasFragmentadas[v];
+		Fragmento *fragmento = &fragmentos[donoVia[v]];
+		via->dinamica = &vias[v];
+		via->saida = saidaVia[v];
+		via->dono = donoVia[v];
+		via->nAdiados = 0;
+		inicializaAnel(&via->pedidos, via->memoriaPedidos, sizeof(PedidoVia), CAPACIDADE_PEDIDOS_VIA);
+		inicializaAnel(&via->eventos, via->memoriaEventos, sizeof(EventoVia), CAPACIDADE_EVENTOS_VIA);
+		fragmento->vias[fragmento->nVias++] = v;
+		if (donoVia[v] + 1 > nFragmentos)
+			nFragmentos = donoVia[v] + 1;
+	}
+	return inicializaTrabalhadores(threads);
+}
+
+int enviaPedidoVia(int via, const PedidoVia *pedido) {
+	return escreveAnel(&viasFragmentadas[via].pedidos, pedido);
+}
+
+// Cada fragmento vai para o deque de um trabalhador fixo, para que as suas vias tendam a ficar no mesmo
+// núcleo de um passo para o outro; o roubo só as move quando outro trabalhador fica ocioso
+void executaPassoFragmentos(float dt) {
+	passoAtual = dt;
+	for (int f = 0; f < nFragmentos; f++) {
+		for (int i = 0; i < fragmentos[f].nVias; i++) {
+			Trabalho trabalho = { passoVia, &viasFragmentadas[fragmentos[f].vias[i]] };
+			adicionaTrabalho(f, trabalho);
+		}
+	}
+	executaTrabalhos();
+}
+
+int recebeEventoVia(EventoVia *evento) {
+	for (int v = 0; v < nViasFragmentadas; v++) {
+		if (leAnel(&viasFragmentadas[v].eventos, evento))
+			return 1;
+	}
+	return 0;
+}
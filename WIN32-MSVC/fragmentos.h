@@ -0,0 +1,62 @@
+#ifndef FRAGMENTOS_H
+#define FRAGMENTOS_H
+
+#include "dinamica.h"
+#include "anel.h"
+#include "trabalho.h"
+
+// Dinâmica das vias repartida em fragmentos, um por cruzamento. Cada fragmento é dono das vias que chegam ao
+// seu cruzamento e das saídas que partem dele. Cada via é um trabalho no conjunto de threads de trabalho.c,
+// colocado no deque do trabalhador que cuida do seu fragmento; um trabalhador que termina antes rouba vias de
+// fragmentos mais carregados.
+// Nada é compartilhado entre vias durante um passo. Um veículo entra ou sai de uma via por um pedido
+// na fila SPSC daquela via, em que quem coordena é o único produtor e o trabalho da via o único consumidor.
+// O que acontece na via (chegada à linha de parada, saída da malha) volta por uma fila SPSC de eventos da
+// própria via, de modo que qualquer trabalhador pode avançá-la.
+// Este módulo não usa a API do FreeRTOS.
+
+#define MAX_FRAGMENTOS 4
+#define MAX_VIAS_FRAGMENTADAS 16
+#define CAPACIDADE_PEDIDOS_VIA 64         // Potência de 2
+#define CAPACIDADE_EVENTOS_VIA 64         // Potência de 2
+#define TOLERANCIA_PARADA 0.5f // Distância (m) da linha de parada em que o veículo é considerado parado nela
+
+typedef enum {
+	ENTRA_VIA,
+	SAI_VIA
+} TipoPedidoVia;
+
+typedef struct {
+	TipoPedidoVia tipo;
+	void *referencia;
+	float velocidade; // Só na entrada
+	unsigned movimento;
+} PedidoVia;
+
+typedef enum {
+	CHEGOU_PARADA, // O primeiro veículo de uma faixa está na linha de parada (repetido a cada passo)
+	DEIXOU_MALHA   // O veículo chegou ao fim de uma saída e já foi retirado da via
+} TipoEventoVia;
+
+typedef struct {
+	TipoEventoVia tipo;
+	int via;
+	void *referencia;
+	unsigned movimentos; // CHEGOU_PARADA: movimentos permitidos na faixa em que o veículo parou
+} EventoVia;
+
+// donoVia[v] é o fragmento (cruzamento) dono da via v e saidaVia[v] indica se ela deixa a malha.
+// Com nThreads = 0 os passos rodam na thread de quem chama executaPassoFragmentos; do contrário as vias
+// são avançadas por nThreads trabalhadores. Retorna 0 se não conseguiu criar as threads
+int inicializaFragmentos(DinamicaVia *vias, const int *donoVia, const int *saidaVia, int nVias, int nThreads);
+
+// Coordenador: entrega um pedido à fila da via. Retorna 0 se a fila está cheia
+int enviaPedidoVia(int via, const PedidoVia *pedido);
+
+// Coordenador: avança todos os fragmentos em dt segundos e só retorna quando todos terminaram
+void executaPassoFragmentos(float dt);
+
+// Coordenador: lê o próximo evento de qualquer via. Retorna 0 quando não há mais eventos
+int recebeEventoVia(EventoVia *evento);
+
+#endif /* FRAGMENTOS_H */
@@ -0,0 +1,77 @@
+/* Standard includes. */
+#include <stdio.h>
+#include <windows.h>
+
+#include "histograma.h"
+
+#define METADE_FAIXAS (1 << (BITS_PRECISAO - 1))
+
+static int bitMaisAlto(unsigned long long valor) {
+	int bit = 0;
+	while (valor >>= 1)
+		bit++;
+	return bit;
+}
+
+static int faixaValor(unsigned long long valor) {
+	if (valor >= 1ull << BITS_VALOR)
+		valor = (1ull << BITS_VALOR) - 1;
+	if (valor < 1ull << BITS_PRECISAO)
+		return (int)valor;
+	int deslocamento = bitMaisAlto(valor) - BITS_PRECISAO + 1;
+	return deslocamento * METADE_FAIXAS + (int)(valor >> deslocamento);
+}
+
+// Maior valor contado na faixa
+static unsigned long long valorFaixa(int faixa) {
+	if (faixa < 1 << BITS_PRECISAO)
+		return faixa;
+	int deslocamento = faixa / METADE_FAIXAS - 1;
+	unsigned long long inicio = (unsigned long long)(faixa - deslocamento * METADE_FAIXAS) << deslocamento;
+	return inicio + (1ull << deslocamento) - 1;
+}
+
+void registraHistograma(Histograma *histograma, unsigned long long valor) {
+	InterlockedIncrement(&histograma->contagens[faixaValor(valor)]);
+	InterlockedIncrement64(&histograma->total);
+	LONG64 maximo = histograma->maximo;
+	while ((LONG64)valor > maximo) {
+		LONG64 anterior = InterlockedCompareExchange64(&histograma->maximo, (LONG64)valor, maximo);
+		if (anterior == maximo)
+			break;
+		maximo = anterior;
+	}
+}
+
+long long totalHistograma(Histograma *histograma) {
+	return InterlockedCompareExchange64(&histograma->total, 0, 0);
+}
+
+unsigned long long maximoHistograma(Histograma *histograma) {
+	return InterlockedCompareExchange64(&histograma->maximo, 0, 0);
+}
+
+unsigned long long percentilHistograma(Histograma *histograma, double percentil) {
+	long long total = totalHistograma(histograma);
+	if (total == 0)
+		return 0;
+	long long alvo = (long long)(percentil / 100.0 * total + 0.5);
+	if (alvo < 1)
+		alvo = 1;
+	long long acumulado = 0;
+	for (int f = 0; f < FAIXAS_HISTOGRAMA; f++) {
+		acumulado += histograma->contagens[f];
+		if (acumulado >= alvo) {
+			unsigned long long valor = valorFaixa(f);
+			unsigned long long maximo = maximoHistograma(histograma);
+			return valor < maximo ? valor : maximo;
+		}
+	}
+	return maximoHistograma(histograma);
+}
+
+void escreveHistograma(FILE *saida, const char *nome, Histograma *histograma, double escala, const char *unidade) {
+	fprintf(saida, "%s: n=%lld p50=%.3f p99=%.3f p99.9=%.3f max=%.3f %s\n", nome, totalHistograma(histograma),
+		percentilHistograma(histograma, 50.0) / escala, percentilHistograma(histograma, 99.0) / escala,
+		percentilHistograma(histograma, 99.9) / escala, maximoHistograma(histograma) / escala, unidade);
+}
@@ -0,0 +1,35 @@
+#ifndef HISTOGRAMA_H
+#define HISTOGRAMA_H
+
+#include <stdio.h>
+#include <windows.h>
+
+// Histograma de faixa dinâmica alta (no estilo do HdrHistogram) com memória fixa. Os valores até
+// 2^BITS_PRECISAO são contados exatamente; acima disso cada potência de 2 é dividida em 2^(BITS_PRECISAO-1)
+// faixas iguais, então o erro relativo de um percentil fica abaixo de 2^-(BITS_PRECISAO-1) (1,6%) de 1 a
+// 2^40. Registrar é um incremento atômico na faixa e no total, sem trava, e pode ser feito de qualquer thread.
+// Este módulo não usa a API do FreeRTOS.
+
+#define BITS_PRECISAO 7
+#define BITS_VALOR 40 // Valores maiores são contados na última faixa
+#define FAIXAS_HISTOGRAMA ((BITS_VALOR - BITS_PRECISAO + 2) << (BITS_PRECISAO - 1))
+
+typedef struct {
+	volatile LONG contagens[FAIXAS_HISTOGRAMA];
+	volatile LONG64 total;
+	volatile LONG64 maximo;
+} Histograma;
+
+void registraHistograma(Histograma *histograma, unsigned long long valor);
+
+long long totalHistograma(Histograma *histograma);
+
+// Maior valor equivalente ao percentil (de 0 a 100), ou 0 se o histograma está vazio
+unsigned long long percentilHistograma(Histograma *histograma, double percentil);
+
+unsigned long long maximoHistograma(Histograma *histograma);
+
+// Uma linha com total, p50, p99, p99.9 e máximo; os valores são divididos por escala
+void escreveHistograma(FILE *saida, const char *nome, Histograma *histograma, double escala, const char *unidade);
+
+#endif /* HISTOGRAMA_H */
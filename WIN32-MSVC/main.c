@@ -53,6 +53,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <locale.h>
+#include <string.h>
+#include <math.h>
 #include "time.h"
 //#include <conio.h>
 
@@ -60,6 +62,22 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "semphr.h"
+#include "timers.h"
+#include "event_groups.h"
+#include "croutine.h"
+
+/* Simulator includes. */
+#include "dinamica.h"
+#include "ocupacao.h"
+#include "reserva.h"
+#include "fragmentos.h"
+#include "distrito.h"
+#include "retomada.h"
+#include "telemetria.h"
+#include "colunas.h"
+#include "metricas.h"
+#include "quantis.h"
+#include "mapacalor.h"
 
 /* This project provides two demo applications.  A simple blinky style demo
 application, and a more comprehensive test and demo application.  The
@@ -121,7 +139,13 @@ void vApplicationGetTimerTaskMemory( StaticTask_t **ppxTimerTaskTCBBuffer, Stack
  * Writes trace data to a disk file when the trace recording is stopped.
  * This function will simply overwrite any trace files that already exist.
  */
+#if ( TRC_CFG_RECORDER_MODE == TRC_RECORDER_MODE_SNAPSHOT )
 static void prvSaveTraceFile( void );
+#else
+/* No modo streaming o rastro já está nos arquivos; parar o gravador fecha
+o segmento atual. */
+#define prvSaveTraceFile()
+#endif
 
 /*-----------------------------------------------------------*/
 
@@ -137,59 +161,159 @@ static BaseType_t xTraceRunning = pdTRUE;
 
 /*-----------------------------------------------------------*/
 
-// Semforo binrio para controlar seguir em frente e a direita e  no cruzamento ndice 0 (Norte-Sul) e 1 (Leste-Oeste)
-SemaphoreHandle_t semaforoFrenteDireita[2]; 
-// Semforo binrio para controlar converso a esquerda no cruzamento ndice 0 (Norte-Leste), 1 (Sul-Oeste), 2 (Leste-Sul), 3 (Oeste-Norte)
-SemaphoreHandle_t semaforoEsquerda[4]; 
+// Estado dos sinais publicado em bits de um grupo de eventos: um bit ligado é um sinal aberto. O controlador é
+// comum aos quatro cruzamentos, então um único grupo descreve a fase de todos eles.
+// Sinais 0 e 1: seguir em frente e a direita nos eixos Norte-Sul e Leste-Oeste.
+// Sinais 2 a 5: conversão a esquerda nas aproximações 0 (Norte-Leste), 1 (Sul-Oeste), 2 (Leste-Sul), 3 (Oeste-Norte)
+#define N_SINAIS 6
+#define SINAL_FRENTE_DIREITA(eixo) (eixo)
+#define SINAL_ESQUERDA(semaforo) (2 + (semaforo))
+#define BIT_SINAL(sinal) ((EventBits_t)1 << (sinal))
+EventGroupHandle_t sinaisAbertos;
+// Veículos retomáveis (--retomada) esperando cada sinal abrir
+ListaEspera esperaSinal[N_SINAIS];
+
+#define ESCALA_MINIMA 0.01 // Cem vezes mais lento que o tempo real
+
+// Fator global de escala do tempo da simulação: 1.0 = tempo real, 0.01 = cem vezes mais lento.
+// Não há limite superior; com valores muito grandes (ou "inf") as esperas caem para zero ticks
+volatile double escalaTempo = 1.0;
+
+void defineEscalaTempo(double escala) {
+	if (!(escala >= ESCALA_MINIMA)) // Também rejeita NaN
+		escala = ESCALA_MINIMA;
+	escalaTempo = escala;
+}
 
-void TaskCruzamento(void *param) {
-	// Inicializa os semforos
-	for (int i = 0; i < 4; i++) {
-		if (i < 2)
-			semaforoFrenteDireita[i] = xSemaphoreCreateBinary(); 
-		semaforoEsquerda[i] = xSemaphoreCreateBinary();
+// Converte milissegundos de tempo simulado em ticks, aplicando a escala vigente
+TickType_t ticksSimulacao(double ms) {
+	double ticks = ms * configTICK_RATE_HZ / 1000.0 / escalaTempo;
+	return (ticks < (double)portMAX_DELAY) ? (TickType_t)(ticks + 0.5) : portMAX_DELAY - 1;
+}
+
+void esperaSimulacao(double ms) {
+	vTaskDelay(ticksSimulacao(ms));
+}
+
+// Converte ticks em segundos de tempo simulado. A escala só muda antes do escalonador partir
+double segundosSimulados(TickType_t ticks) {
+	return ticks * escalaTempo / configTICK_RATE_HZ;
+}
+
+// Ticks por segundo simulado, para as métricas e as trajetórias, que contam os tempos em ticks. Com escala
+// infinita é 0: os ticks não medem tempo simulado
+double ticksPorSegundoSimulado(void) {
+	return configTICK_RATE_HZ / escalaTempo;
+}
+
+// Canais de eventos de usuário no rastro do FreeRTOS+Trace: um por sinal, com a abertura e o fechamento, e
+// um para as transições dos veículos. No modo snapshot, o padrão, o gravador está sempre ativo e os eventos vão
+// para o Trace.dump; no modo streaming, sem --rastro o gravador fica parado e eles são descartados na origem.
+// O controlador é comum aos quatro cruzamentos, então cada sinal vale para o mesmo movimento em todos eles
+const char *nomeSinal[N_SINAIS] = {
+	"Sinal NS frente", "Sinal EW frente", "Sinal N esquerda", "Sinal S esquerda", "Sinal E esquerda", "Sinal W esquerda"
+};
+traceString canalSinal[N_SINAIS];
+traceString canalVeiculos;
+
+void registraCanaisRastro(void) {
+	for (int s = 0; s < N_SINAIS; s++)
+		canalSinal[s] = xTraceRegisterString(nomeSinal[s]);
+	canalVeiculos = xTraceRegisterString("Veiculos");
+}
+
+void rastroSinais(EventBits_t sinais, const char *transicao) {
+	for (int s = 0; s < N_SINAIS; s++)
+		if (sinais & BIT_SINAL(s))
+			vTracePrint(canalSinal[s], transicao);
+}
+
+// Métricas de verde: instante em que a fase atual abriu e a última liberação de cada aproximação
+TickType_t aberturaFase;
+volatile TickType_t ultimaLiberacao[METRICAS_CRUZAMENTOS][METRICAS_APROXIMACOES];
+volatile unsigned long long aberturaFaseRelogio; // Microssegundos, para a latência de despertar
+
+// Abre a fase com uma única escrita no grupo de eventos, o que acorda de uma vez as tarefas que esperam os
+// seus bits, e depois avisa os veículos retomáveis que esperavam por algum desses sinais
+void abreFase(EventBits_t sinais) {
+	aberturaFase = xTaskGetTickCount();
+	aberturaFaseRelogio = relogioMetricas();
+	rastroSinais(sinais, "abre");
+	xEventGroupSetBits(sinaisAbertos, sinais);
+	for (int s = 0; s < N_SINAIS; s++)
+		if (sinais & BIT_SINAL(s))
+			avisaLista(&esperaSinal[s]);
+}
+
+// A aproximação (0 = Norte, 1 = Sul, 2 = Leste, 3 = Oeste) tem algum movimento liberado pelos sinais
+int aproximacaoNaFase(EventBits_t sinais, int aproximacao) {
+	return (sinais & BIT_SINAL(SINAL_FRENTE_DIREITA(aproximacao / 2))) || (sinais & BIT_SINAL(SINAL_ESQUERDA(aproximacao)));
+}
+
+// Fecha a fase. Os veículos não seguram o sinal; a reserva da travessia confere o bit com o escalonador
+// suspenso (ver reservaTravessia), então nenhuma travessia é reservada depois do fechamento
+void fechaFase(EventBits_t sinais) {
+	xEventGroupClearBits(sinaisAbertos, sinais);
+	rastroSinais(sinais, "fecha");
+	TickType_t aberto = xTaskGetTickCount() - aberturaFase;
+	for (int c = 0; c < METRICAS_CRUZAMENTOS; c++) {
+		for (int a = 0; a < METRICAS_APROXIMACOES; a++) {
+			if (!aproximacaoNaFase(sinais, a))
+				continue;
+			TickType_t usado = ultimaLiberacao[c][a] - aberturaFase;
+			metricaVerde(c, a, usado <= aberto ? usado : 0, aberto); // Sem liberação nesta fase, usado dá a volta
+		}
 	}
+}
 
-	int idCruzamento = (int)param; // Converte o ponteiro de volta para um inteiro
-	int delayViaNS = idCruzamento * 30000; // Tempo para percorrer entre cruzamentos Norte-Sul
-	int delayViaEW = idCruzamento * 36000; // Tempo para percorrer entre cruzamentos Leste-Oeste
+// Distritos: com --distrito=<k>/<n>, este processo simula só os cruzamentos do distrito k (ver trocaDistritos)
+int distritoLocal = 0;
+int nDistritos = 1;
+#define IDS_POR_DISTRITO 10000000 // Os veículos criados no distrito k têm ids de k * IDS_POR_DISTRITO em diante
+volatile int faseSinais;                  // Fase atual do controlador deste processo, de 0 a 5
+volatile int faseDistrito[MAX_DISTRITOS]; // Última fase informada por cada vizinho (zona fantasma)
 
-	// Os ndices indicam a posio dos semforos 0 = Norte, 1 = Sul, 2 = Leste, 3 = Oeste
+void TaskCruzamento(void *param) {
+	// Os índices indicam a posição dos semáforos 0 = Norte, 1 = Sul, 2 = Leste, 3 = Oeste.
+	// Cada fase abre os seus sinais e os fecha ao terminar; os sinais nascem fechados
 	while (1) {
 		// Fase NS-Straight e EW-Left
-		xSemaphoreGive(semaforoFrenteDireita[0]);    // Libera a passagem para seguir em frente e a direita Norte-Sul
-		xSemaphoreTake(semaforoFrenteDireita[1], 0); // Bloqueia seguir em frente e a direita Leste-Oeste
-		for (int i = 0; i < 4; i++) {
-			xSemaphoreTake(semaforoEsquerda[i], 0); // Bloquia a converses a esquerda
-		}
+		faseSinais = 0;
+		abreFase(BIT_SINAL(SINAL_FRENTE_DIREITA(0)));    // Libera a passagem para seguir em frente e a direita Norte-Sul
 		//printf("Fluxo Norte-Sul e Sul-Norte\n");
-		vTaskDelay(1000);
+		esperaSimulacao(1000);
+		fechaFase(BIT_SINAL(SINAL_FRENTE_DIREITA(0))); // Bloqueia semáforos Norte e Sul
 
-		xSemaphoreTake(semaforoFrenteDireita[0], 0); // Bloqueia semforos Norte e Sul
-		xSemaphoreGive(semaforoEsquerda[2]);         // Libera converso a esquerda Leste-Sul
+		faseSinais = 1;
+		abreFase(BIT_SINAL(SINAL_ESQUERDA(2)));         // Libera conversão a esquerda Leste-Sul
 		//printf("Fluxo Leste-Sul\n");;
-		vTaskDelay(1000);
+		esperaSimulacao(1000);
+		fechaFase(BIT_SINAL(SINAL_ESQUERDA(2))); // Bloquia a conversão a esquerda Leste-Sul
 
-		xSemaphoreTake(semaforoEsquerda[2], 0); // Bloquia a converso a esquerda Leste-Sul
-		xSemaphoreGive(semaforoEsquerda[3]);  // Libera converso a esquerda Oeste-Norte
+		faseSinais = 2;
+		abreFase(BIT_SINAL(SINAL_ESQUERDA(3)));  // Libera conversão a esquerda Oeste-Norte
 		//printf("Fluxo Oeste-Norte\n");
-		vTaskDelay(1000);
+		esperaSimulacao(1000);
+		fechaFase(BIT_SINAL(SINAL_ESQUERDA(3))); // Bloquia a conversão a esquerda Oeste-Norte
 
 		// Fase EW-Straight e NS-Left
-		xSemaphoreTake(semaforoEsquerda[3], 0); // Bloquia a converso a esquerda Oeste-Norte
-		xSemaphoreGive(semaforoFrenteDireita[1]); // Libera a passagem para seguir em frente e a direita (Leste-Oeste)
+		faseSinais = 3;
+		abreFase(BIT_SINAL(SINAL_FRENTE_DIREITA(1))); // Libera a passagem para seguir em frente e a direita (Leste-Oeste)
 		//printf("Fluxo Leste-Oeste e Oeste-Leste\n");
-		vTaskDelay(1000);
+		esperaSimulacao(1000);
+		fechaFase(BIT_SINAL(SINAL_FRENTE_DIREITA(1))); // Bloqueia seguir em frente e a direita Leste-Oeste
 
-		xSemaphoreTake(semaforoFrenteDireita[1], 0); // Bloqueia seguir em frente e a direita Leste-Oeste
-		xSemaphoreGive(semaforoEsquerda[0]);  // Libera converso a esquerda Norte-Leste
+		faseSinais = 4;
+		abreFase(BIT_SINAL(SINAL_ESQUERDA(0)));  // Libera conversão a esquerda Norte-Leste
 		//printf("Fluxo Norte-Leste\n");
-		vTaskDelay(1000);
+		esperaSimulacao(1000);
+		fechaFase(BIT_SINAL(SINAL_ESQUERDA(0))); // Bloquia a conversão a esquerda Norte-Leste
 
-		xSemaphoreTake(semaforoEsquerda[0], 0); // Bloquia a converso a esquerda Norte-Leste
-		xSemaphoreGive(semaforoEsquerda[1]);  // Libera converso a esquerda Sul-Oeste
+		faseSinais = 5;
+		abreFase(BIT_SINAL(SINAL_ESQUERDA(1)));  // Libera conversão a esquerda Sul-Oeste
 		//printf("Fluxo Sul-Oeste\n");
-		vTaskDelay(1000);
+		esperaSimulacao(1000);
+		fechaFase(BIT_SINAL(SINAL_ESQUERDA(1))); // Bloquia a conversão a esquerda Sul-Oeste
 	}
 }
 
@@ -213,14 +337,72 @@ typedef enum {
 	D
 } idCruzamento;
 
+typedef struct {
+	int lin;
+	int col;
+} Celula;
+
+// Perfis de velocidade dos trechos da malha
+typedef enum {
+	PERFIL_TRAVESSIA, // Dentro do cruzamento, incluindo conversões
+	PERFIL_VIA,       // Vias entre cruzamentos
+	PERFIL_SAIDA,     // Vias que deixam a malha
+	N_PERFIS
+} PerfilVelocidade;
+
+const double velocidadePerfil[N_PERFIS] = { // km/h
+	[PERFIL_TRAVESSIA] = 30.0,
+	[PERFIL_VIA] = 45.0,
+	[PERFIL_SAIDA] = 60.0
+};
+
+// Tamanho real de uma célula do desenho. Uma linha do console é mais alta que uma coluna é larga,
+// por isso os passos verticais representam uma distância maior
+#define METROS_POR_LINHA 7.5
+#define METROS_POR_COLUNA 4.5
+
+#define MAX_VERTICES 4  // Vértices de uma polilinha
+#define MAX_CELULAS 16  // Células de um segmento depois de expandido
+
+// Trecho de trajetória descrito como polilinha de vértices alinhados em linha ou coluna.
+// A lista de células é gerada a partir dos vértices em inicializaSegmentos()
+typedef struct {
+	Celula vertices[MAX_VERTICES];
+	int nVertices;
+	PerfilVelocidade perfil;
+	Celula celulas[MAX_CELULAS];
+	int nCelulas;
+	double comprimento; // Metros, calculado a partir das células
+} Segmento;
+
 typedef struct {
 	int idVeiculo;
 	idCruzamento cruzamentoAtual;
 	idSemaforo semaforoAtual;
 	Direcao direcao;
+	unsigned alternativas;     // Outros movimentos que o veículo aceita no próximo cruzamento (--flexiveis)
+	unsigned movimentosFaixa;  // Movimentos permitidos na faixa em que parou; 0 enquanto não chegou à linha
+	Celula posicao;            // Célula ocupada no desenho do tráfego
+	const Segmento *segmento;  // Segmento que o veículo está percorrendo
+	int indiceCelula;          // Próxima célula do segmento
+	TaskHandle_t tarefa;
+	int naVia;                 // 1 enquanto a dinâmica da via controla o veículo
+	int viaAtual;
+	volatile int aguardandoChegada; // A tarefa espera ser avisada do fim da via
+	int alocado;               // 1 = criado pela demanda; a memória é liberada quando ele deixa a malha
+	int transferido;           // 1 = chegou de outro distrito e começa no início da via viaAtual
+	int corrotina;             // 1 = executado por uma corrotina do conjunto, sem tarefa própria
+	Retomavel *retomavel;      // Não nulo = executado pelo escalonador de retomáveis
+	int esperandoVaga;         // 1 enquanto está parado na via atual esperando vaga na viaEsperada
+	int viaEsperada;
+	int naFila;                // 1 entre a chegada à linha de parada e a liberação (métricas)
+	TickType_t chegada;        // Tick da chegada à linha de parada
+	int origem;                // Aproximação onde a viagem começou (cruzamento * 4 + semáforo) + 1; 0 = outro distrito
+	TickType_t inicioViagem;
+	TickType_t entradaVia;     // Tick da entrada na via atual
 } Veiculo;
 
-char trafegoBase[23][50] = {
+char trafegoBase[LINHAS_MALHA][COLUNAS_MALHA] = {
 		"          |       |          |       |          ",
 		"          |   |   |          |   |   |          ",
 		"          |       |          |       |          ",
@@ -246,23 +428,46 @@ char trafegoBase[23][50] = {
 		"          |   |   |          |   |   |          "
 };
 
-char trafego[23][50];
+char trafego[LINHAS_MALHA][COLUNAS_MALHA];
+
+ListaEspera esperaCelula[LINHAS_MALHA][COLUNAS_MALHA]; // Veículos retomáveis esperando cada célula vagar
 
 void inicializaTrafego() {
-	for (int i = 0; i < 23; i++) {
-		for (int j = 0; j < 50; j++) {
+	inicializaOcupacao();
+	inicializaMapaCalor(0);
+	for (int i = 0; i < LINHAS_MALHA; i++) {
+		for (int j = 0; j < COLUNAS_MALHA; j++) {
 			trafego[i][j] = trafegoBase[i][j];
 		}
 	}
 }
 
+// Libera a célula do veículo e apaga o seu desenho
 void limpaTrafego(int lin, int col) {
 	trafego[lin][col] = trafegoBase[lin][col];
+	mapaCalorLibera(lin, col, xTaskGetTickCount());
+	liberaCelula(lin, col);
+	avisaLista(&esperaCelula[lin][col]);
+}
+
+// Ocupa uma célula livre e desenha o veículo nela. Retorna 0 se a célula já tem outro veículo
+int ocupaTrafego(int lin, int col) {
+	if (!ocupaCelula(lin, col))
+		return 0;
+	mapaCalorOcupa(lin, col, xTaskGetTickCount());
+	trafego[lin][col] = 'o';
+	return 1;
 }
 
-void modificaTrafego(int lAtual, int cAtual, int lAnt, int cAnt) {
+// Move o veículo de célula. Só acontece se a nova célula estiver livre; do contrário retorna 0 e o veículo
+// continua na anterior
+int modificaTrafego(int lAtual, int cAtual, int lAnt, int cAnt) {
+	if (lAtual == lAnt && cAtual == cAnt)
+		return 1;
+	if (!ocupaTrafego(lAtual, cAtual))
+		return 0;
 	limpaTrafego(lAnt, cAnt);
-	trafego[lAtual][cAtual] = 'o';
+	return 1;
 }
 
 void printaTrafego() {
@@ -273,687 +478,1745 @@ void printaTrafego() {
 	SetConsoleMode(hConsole, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
 
 	while (1) {
-		// Move o cursor para a posio superior esquerda do console
+		// Move o cursor para a posição superior esquerda do console
 		printf("\033[H");
-		for (int i = 0; i < 23; i++) {
+		for (int i = 0; i < LINHAS_MALHA; i++) {
 			printf("%s\n", trafego[i]);
 		}
+		if (nDistritos > 1) {
+			printf("Distrito %d de %d, fases dos sinais:", distritoLocal, nDistritos);
+			for (int d = 0; d < nDistritos; d++)
+				printf(" %d", d == distritoLocal ? faseSinais : faseDistrito[d]);
+			printf("   \n");
+		}
 		vTaskDelay(50);
 	}
 }
 
-void animacaoViaNS(int lAtual, int cAtual, int lAnt, int cAnt, int sig) {
-	modificaTrafego(lAtual, cAtual, lAnt, cAnt);
-	vTaskDelay(600);
-	for (int i = 1; i < 5; i++) {
-		modificaTrafego(lAtual + i*sig, cAtual, lAtual + (i-1)*sig, cAnt); // sig = 1 -> sentido Norte-Sul, sig = -1 -> sentido Sul-Norte
-		vTaskDelay(600);
+// Vias que ligam dois cruzamentos e saídas da malha. Cada via termina na linha de parada do cruzamento de destino
+typedef enum {
+	VIA_AB, VIA_BA, VIA_AC, VIA_CA, VIA_BD, VIA_DB, VIA_CD, VIA_DC,
+	SAIDA_AN, SAIDA_AW, SAIDA_BN, SAIDA_BE, SAIDA_CW, SAIDA_CS, SAIDA_DE, SAIDA_DS,
+	N_VIAS
+} idVia;
+
+const char *nomeVia[N_VIAS] = {
+	"AB", "BA", "AC", "CA", "BD", "DB", "CD", "DC",
+	"saida A-N", "saida A-W", "saida B-N", "saida B-E", "saida C-W", "saida C-S", "saida D-E", "saida D-S"
+};
+
+typedef struct {
+	Segmento segmento;
+	int saida;                      // 1 = o veículo deixa a malha ao fim da via
+	idCruzamento cruzamentoDestino; // Aproximação alcançada ao fim da via
+	idSemaforo semaforoDestino;
+} Via;
+
+Via vias[N_VIAS] = {
+	[VIA_AB] = { .segmento = { .vertices = { {7, 19}, {7, 27} }, .nVertices = 2, .perfil = PERFIL_VIA }, .cruzamentoDestino = B, .semaforoDestino = W },
+	[VIA_BA] = { .segmento = { .vertices = { {5, 28}, {5, 20} }, .nVertices = 2, .perfil = PERFIL_VIA }, .cruzamentoDestino = A, .semaforoDestino = E },
+	[VIA_AC] = { .segmento = { .vertices = { {9, 12}, {13, 12} }, .nVertices = 2, .perfil = PERFIL_VIA }, .cruzamentoDestino = C, .semaforoDestino = N },
+	[VIA_CA] = { .segmento = { .vertices = { {13, 16}, {10, 16} }, .nVertices = 2, .perfil = PERFIL_VIA }, .cruzamentoDestino = A, .semaforoDestino = S },
+	[VIA_BD] = { .segmento = { .vertices = { {9, 31}, {13, 31} }, .nVertices = 2, .perfil = PERFIL_VIA }, .cruzamentoDestino = D, .semaforoDestino = N },
+	[VIA_DB] = { .segmento = { .vertices = { {13, 35}, {10, 35} }, .nVertices = 2, .perfil = PERFIL_VIA }, .cruzamentoDestino = B, .semaforoDestino = S },
+	[VIA_CD] = { .segmento = { .vertices = { {17, 19}, {17, 27} }, .nVertices = 2, .perfil = PERFIL_VIA }, .cruzamentoDestino = D, .semaforoDestino = W },
+	[VIA_DC] = { .segmento = { .vertices = { {15, 28}, {15, 20} }, .nVertices = 2, .perfil = PERFIL_VIA }, .cruzamentoDestino = C, .semaforoDestino = E },
+	[SAIDA_AN] = { .segmento = { .vertices = { {3, 16}, {0, 16} }, .nVertices = 2, .perfil = PERFIL_SAIDA }, .saida = 1 },
+	[SAIDA_AW] = { .segmento = { .vertices = { {5, 9}, {5, 0} }, .nVertices = 2, .perfil = PERFIL_SAIDA }, .saida = 1 },
+	[SAIDA_BN] = { .segmento = { .vertices = { {3, 35}, {0, 35} }, .nVertices = 2, .perfil = PERFIL_SAIDA }, .saida = 1 },
+	[SAIDA_BE] = { .segmento = { .vertices = { {7, 38}, {7, 47} }, .nVertices = 2, .perfil = PERFIL_SAIDA }, .saida = 1 },
+	[SAIDA_CW] = { .segmento = { .vertices = { {15, 9}, {15, 0} }, .nVertices = 2, .perfil = PERFIL_SAIDA }, .saida = 1 },
+	[SAIDA_CS] = { .segmento = { .vertices = { {19, 12}, {22, 12} }, .nVertices = 2, .perfil = PERFIL_SAIDA }, .saida = 1 },
+	[SAIDA_DE] = { .segmento = { .vertices = { {17, 38}, {17, 47} }, .nVertices = 2, .perfil = PERFIL_SAIDA }, .saida = 1 },
+	[SAIDA_DS] = { .segmento = { .vertices = { {19, 31}, {22, 31} }, .nVertices = 2, .perfil = PERFIL_SAIDA }, .saida = 1 }
+};
+
+// Via por onde o veículo deixa cada cruzamento, indexada pelo lado de saída (N, S, E, W)
+const idVia viaPorLado[4][4] = {
+	[A] = { [N] = SAIDA_AN, [S] = VIA_AC,   [E] = VIA_AB,   [W] = SAIDA_AW },
+	[B] = { [N] = SAIDA_BN, [S] = VIA_BD,   [E] = SAIDA_BE, [W] = VIA_BA },
+	[C] = { [N] = VIA_CA,   [S] = SAIDA_CS, [E] = VIA_CD,   [W] = SAIDA_CW },
+	[D] = { [N] = VIA_DB,   [S] = SAIDA_DS, [E] = SAIDA_DE, [W] = VIA_DC }
+};
+
+// Os quatro cruzamentos têm a mesma geometria. Travessias e linhas de parada são descritas nas coordenadas do
+// cruzamento A e deslocadas pela origem de cada cruzamento
+const Celula origemCruzamento[4] = { [A] = {0, 0}, [B] = {0, 19}, [C] = {10, 0}, [D] = {10, 19} };
+const Celula linhaParada[4] = { [N] = {3, 12}, [S] = {10, 16}, [E] = {5, 20}, [W] = {7, 8} };
+
+typedef struct {
+	Celula vertices[MAX_VERTICES];
+	int nVertices;
+	idSemaforo ladoSaida; // Lado do cruzamento por onde o veículo sai
+} MovimentoBase;
+
+// Trajetória dentro do cruzamento, da primeira célula após a linha de parada até a última célula antes da via de saída
+const MovimentoBase movimentoBase[4][3] = {
+	[N] = { // Sentido Norte-Sul
+		[FRENTE]   = { { {4, 12}, {8, 12} }, 2, S },
+		[DIREITA]  = { { {4, 12}, {5, 12}, {5, 10} }, 3, W },
+		[ESQUERDA] = { { {4, 12}, {7, 12}, {7, 18} }, 3, E }
+	},
+	[S] = { // Sentido Sul-Norte
+		[FRENTE]   = { { {9, 16}, {4, 16} }, 2, N },
+		[DIREITA]  = { { {9, 16}, {7, 16}, {7, 18} }, 3, E },
+		[ESQUERDA] = { { {9, 16}, {5, 16}, {5, 10} }, 3, W }
+	},
+	[E] = { // Sentido Leste-Oeste
+		[FRENTE]   = { { {5, 19}, {5, 10} }, 2, W },
+		[DIREITA]  = { { {5, 19}, {5, 16}, {4, 16} }, 3, N },
+		[ESQUERDA] = { { {5, 19}, {5, 12}, {8, 12} }, 3, S }
+	},
+	[W] = { // Sentido Oeste-Leste
+		[FRENTE]   = { { {7, 9}, {7, 18} }, 2, E },
+		[DIREITA]  = { { {7, 9}, {7, 12}, {8, 12} }, 3, S },
+		[ESQUERDA] = { { {7, 9}, {7, 16}, {4, 16} }, 3, N }
 	}
-	modificaTrafego(-1,-1, lAtual + 4* sig, cAnt);
+};
+
+Segmento travessias[4][4][3]; // [cruzamento][semáforo][direção]
+
+// Distância em metros entre duas células vizinhas
+double distanciaCelulas(Celula a, Celula b) {
+	return abs(a.lin - b.lin) * METROS_POR_LINHA + abs(a.col - b.col) * METROS_POR_COLUNA;
 }
 
-void animacaoViaEW(int lAtual, int cAtual, int lAnt, int cAnt, int sig) {
-	modificaTrafego(lAtual, cAtual, lAnt, cAnt);
-	vTaskDelay(360);
-	for (int i = 1; i < 10; i++) {
-		modificaTrafego(lAtual, cAtual + i*sig, lAnt, cAtual + (i-1) * sig); // sig = 1 -> sentido Oeste-Leste, sig = -1 -> sentido Leste-Oeste 
-		vTaskDelay(360);
+// Tempo simulado (ms) para percorrer uma distância no perfil de velocidade dado
+double tempoPercurso(double metros, PerfilVelocidade perfil) {
+	return metros / (velocidadePerfil[perfil] / 3.6) * 1000.0;
+}
+
+// Expande os vértices da polilinha em células, uma a uma, e acumula o comprimento do segmento
+void expandeSegmento(Segmento *segmento) {
+	segmento->nCelulas = 0;
+	segmento->celulas[segmento->nCelulas++] = segmento->vertices[0];
+	segmento->comprimento = 0;
+	for (int v = 1; v < segmento->nVertices; v++) {
+		Celula atual = segmento->vertices[v - 1];
+		Celula fim = segmento->vertices[v];
+		int dLin = (fim.lin > atual.lin) - (fim.lin < atual.lin);
+		int dCol = (fim.col > atual.col) - (fim.col < atual.col);
+		configASSERT(dLin == 0 || dCol == 0); // Só trechos horizontais ou verticais
+		if (v == 1) // A primeira célula é alcançada por um passo na direção do primeiro trecho
+			segmento->comprimento += dLin ? METROS_POR_LINHA : METROS_POR_COLUNA;
+		while (atual.lin != fim.lin || atual.col != fim.col) {
+			Celula anterior = atual;
+			atual.lin += dLin;
+			atual.col += dCol;
+			configASSERT(segmento->nCelulas < MAX_CELULAS);
+			segmento->celulas[segmento->nCelulas++] = atual;
+			segmento->comprimento += distanciaCelulas(anterior, atual);
+		}
 	}
-	modificaTrafego(-1, -1, lAtual, cAtual + 9 * sig);
 }
 
-void animacaoSairN(int lAtual, int cAtual, int lAnt, int cAnt) {
-	vTaskDelay(200);
-	modificaTrafego(lAtual, cAtual, lAnt, cAnt);
-	vTaskDelay(200);
-	modificaTrafego(lAtual - 2, cAtual, lAtual, cAtual);
-	vTaskDelay(200);
-	modificaTrafego(lAtual - 4, cAtual, lAtual - 2, cAtual);
-	vTaskDelay(200);
-	modificaTrafego(-1, -1, lAtual - 4, cAtual); // O veculo foi embora
+void inicializaSegmentos() {
+	for (int i = 0; i < N_VIAS; i++) {
+		expandeSegmento(&vias[i].segmento);
+	}
+	for (int c = 0; c < 4; c++) {
+		for (int s = 0; s < 4; s++) {
+			for (int d = 0; d < 3; d++) {
+				Segmento *travessia = &travessias[c][s][d];
+				travessia->nVertices = movimentoBase[s][d].nVertices;
+				for (int v = 0; v < travessia->nVertices; v++) {
+					travessia->vertices[v].lin = movimentoBase[s][d].vertices[v].lin + origemCruzamento[c].lin;
+					travessia->vertices[v].col = movimentoBase[s][d].vertices[v].col + origemCruzamento[c].col;
+				}
+				travessia->perfil = PERFIL_TRAVESSIA;
+				expandeSegmento(travessia);
+			}
+		}
+	}
+}
+
+// Sinal que libera um movimento: frente e direita usam o sinal do eixo (0 = Norte-Sul, 1 = Leste-Oeste),
+// a conversão a esquerda usa o sinal da própria aproximação
+int sinalMovimento(idSemaforo semaforo, Direcao direcao) {
+	if (direcao == ESQUERDA)
+		return SINAL_ESQUERDA(semaforo);
+	return SINAL_FRENTE_DIREITA((semaforo == N || semaforo == S) ? 0 : 1);
+}
+
+
+#define ESPERA_CELULA_MS 100 // Intervalo entre tentativas de ocupar uma célula que estava ocupada
+
+// Célula onde o veículo começa: a linha de parada da aproximação atual ou, se ele veio de outro distrito,
+// o início da sua via
+Celula celulaInicial(const Veiculo *veiculo) {
+	Celula celula;
+	if (veiculo->transferido)
+		return vias[veiculo->viaAtual].segmento.celulas[0];
+	celula = linhaParada[veiculo->semaforoAtual];
+	celula.lin += origemCruzamento[veiculo->cruzamentoAtual].lin;
+	celula.col += origemCruzamento[veiculo->cruzamentoAtual].col;
+	return celula;
 }
 
-void animacaoSairS(int lAtual, int cAtual, int lAnt, int cAnt) {
-	vTaskDelay(200);
-	modificaTrafego(lAtual, cAtual, lAnt, cAnt);
-	vTaskDelay(200);
-	modificaTrafego(lAtual + 2, cAtual, lAtual, cAtual);
-	vTaskDelay(200);
-	modificaTrafego(lAtual + 4, cAtual, lAtual + 2, cAtual);
-	vTaskDelay(200);
-	modificaTrafego(-1, -1, lAtual + 4, cAtual); // O veculo foi embora
+// Métricas da fila na linha de parada. A fração do contador é escolhida pelo id do veículo
+void entraFila(Veiculo *veiculo) {
+	if (veiculo->naFila)
+		return;
+	veiculo->naFila = 1;
+	veiculo->chegada = xTaskGetTickCount();
+	metricaChegada(veiculo->cruzamentoAtual, veiculo->semaforoAtual, veiculo->idVeiculo);
 }
 
-void animacaoSairE(int lAtual, int cAtual, int lAnt, int cAnt) {
-	vTaskDelay(100);
-	modificaTrafego(lAtual, cAtual, lAnt, cAnt);
-	vTaskDelay(200);
-	for (int i = 1; i < 4; i++) {
-		vTaskDelay(100);
-		modificaTrafego(lAtual, cAtual + 4 * i, lAtual, cAtual + 4 * (i - 1));
-		vTaskDelay(200);
+// atendido = 1: o veículo foi liberado para atravessar; 0: deixou a fila de outro modo
+void saiFila(Veiculo *veiculo, int atendido) {
+	if (!veiculo->naFila)
+		return;
+	veiculo->naFila = 0;
+	if (atendido) {
+		TickType_t agora = xTaskGetTickCount();
+		ultimaLiberacao[veiculo->cruzamentoAtual][veiculo->semaforoAtual] = agora;
+		metricaAtendido(veiculo->cruzamentoAtual, veiculo->semaforoAtual, veiculo->idVeiculo, agora - veiculo->chegada);
 	}
-	modificaTrafego(-1, -1, lAtual, cAtual + 12); // O veculo foi embora
+	else
+		metricaDesistencia(veiculo->cruzamentoAtual, veiculo->semaforoAtual, veiculo->idVeiculo);
 }
 
-void animacaoSairW(int lAtual, int cAtual, int lAnt, int cAnt) {
-	vTaskDelay(100);
-	modificaTrafego(lAtual, cAtual, lAnt, cAnt);
-	vTaskDelay(200);
-	for (int i = 1; i < 4; i++) {
-		vTaskDelay(100);
-		modificaTrafego(lAtual, cAtual - 4*i, lAtual, cAtual - 4 * (i-1));
-		vTaskDelay(200);
+// Ocupa a célula inicial do veículo. Retorna 0 se ela está ocupada
+int ocupaCelulaInicial(Veiculo *veiculo) {
+	Celula celula = celulaInicial(veiculo);
+	if (!ocupaTrafego(celula.lin, celula.col))
+		return 0;
+	veiculo->posicao = celula;
+	veiculo->segmento = NULL;
+	if (!veiculo->transferido) {
+		entraFila(veiculo); // Começa na linha de parada
+		veiculo->origem = veiculo->cruzamentoAtual * 4 + veiculo->semaforoAtual + 1;
+		veiculo->inicioViagem = xTaskGetTickCount();
 	}
-	modificaTrafego(-1, -1, lAtual, cAtual - 12); // O veculo foi embora
+	return 1;
 }
 
-void TaskVeiculo(void *param){
-	srand(time(NULL));
-	Veiculo *veiculo = (Veiculo*)param; // Pega os dados do veculo
-	
-	// Eu tenho 48 combinaes possveis a partir da condio inicial do veculo 4*4*3 = 48
-	while (1) {
-		if (veiculo->cruzamentoAtual == A && veiculo->semaforoAtual == N) { // Cruzamento A e semforo Norte
-			modificaTrafego(3, 12, 0, 0);
-			vTaskDelay(300);
-			if (veiculo->direcao == FRENTE) {
-				// Espera pelo sinal do semforo
-				if (xSemaphoreTake(semaforoFrenteDireita[0], portMAX_DELAY)) {
-					modificaTrafego(6, 12, 3, 12);
-					vTaskDelay(100);
-					animacaoViaNS(8, 12, 6, 12, 1);
-					veiculo->cruzamentoAtual = C;
-					modificaTrafego(13, 12, 8, 12);
-					veiculo->direcao = rand() % 3; // Prxima direo do veculo
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
-			else if (veiculo->direcao == DIREITA) {
-				if (xSemaphoreTake(semaforoFrenteDireita[0], portMAX_DELAY)) {
-					animacaoSairW(5, 12, 3, 12);
-					vTaskDelete(NULL);
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
-			else if (veiculo->direcao == ESQUERDA) {
-				if (xSemaphoreTake(semaforoEsquerda[0], portMAX_DELAY)) {
-					modificaTrafego(7, 12, 3, 12);
-					vTaskDelay(100);
-					animacaoViaEW(7, 16, 7, 12, 1);
-					veiculo->cruzamentoAtual = B;
-					veiculo->semaforoAtual = W;
-					modificaTrafego(7, 28, 7, 16);
-					veiculo->direcao = rand() % 3;
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
-		}	
-		else if (veiculo->cruzamentoAtual == A && veiculo->semaforoAtual == S) { // Cruzamento A e semforo Sul
-			modificaTrafego(10, 16, 0, 0);
-			vTaskDelay(300);
-			if (veiculo->direcao == FRENTE) {
-				if (xSemaphoreTake(semaforoFrenteDireita[0], portMAX_DELAY)) {
-					animacaoSairN(6, 16, 10, 16);
-					vTaskDelete(NULL);
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
-			else if (veiculo->direcao == DIREITA) {
-				if (xSemaphoreTake(semaforoFrenteDireita[0], portMAX_DELAY)) {
-					modificaTrafego(7, 16, 10, 16);
-					vTaskDelay(100);
-					animacaoViaEW(7, 18, 7, 16, 1);
-					veiculo->cruzamentoAtual = B;
-					veiculo->semaforoAtual = W;
-					modificaTrafego(7, 28, 7, 28);
-					veiculo->direcao = rand() % 3;
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
-			else if (veiculo->direcao == ESQUERDA) {
-				if (xSemaphoreTake(semaforoEsquerda[1], portMAX_DELAY)) {
-					animacaoSairW(5, 16, 10, 16);
-					vTaskDelete(NULL);
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
+typedef enum {
+	FIM_SEGMENTO,
+	AVANCOU,
+	BLOQUEADO // A próxima célula está ocupada; o veículo fica onde está
+} ResultadoAvanco;
+
+// Passo do movimento genérico: avança o veículo uma célula no seu segmento, se ela estiver livre
+ResultadoAvanco avancaVeiculo(Veiculo *veiculo) {
+	const Segmento *segmento = veiculo->segmento;
+	if (segmento == NULL || veiculo->indiceCelula >= segmento->nCelulas)
+		return FIM_SEGMENTO;
+	Celula proxima = segmento->celulas[veiculo->indiceCelula];
+	if (!modificaTrafego(proxima.lin, proxima.col, veiculo->posicao.lin, veiculo->posicao.col))
+		return BLOQUEADO;
+	veiculo->indiceCelula++;
+	veiculo->posicao = proxima;
+	return AVANCOU;
+}
+
+// Percorre o segmento inteiro. O tempo de cada passo vem da distância da célula e do perfil de velocidade do
+// trecho; quando a célula seguinte está ocupada o veículo espera atrás de quem está nela
+void percorreSegmento(Veiculo *veiculo, const Segmento *segmento) {
+	ResultadoAvanco resultado;
+	veiculo->segmento = segmento;
+	veiculo->indiceCelula = 0;
+	Celula anterior = veiculo->posicao;
+	while ((resultado = avancaVeiculo(veiculo)) != FIM_SEGMENTO) {
+		if (resultado == BLOQUEADO) {
+			esperaSimulacao(ESPERA_CELULA_MS);
+			continue;
 		}
-		else if (veiculo->cruzamentoAtual == A && veiculo->semaforoAtual == E) { // Cruzamento A e semforo Leste
-			modificaTrafego(5, 20, 0, 0);
-			vTaskDelay(300);
-			if (veiculo->direcao == FRENTE) {
-				if (xSemaphoreTake(semaforoFrenteDireita[1], portMAX_DELAY)) {
-					animacaoSairW(5, 14, 5, 20);
-					vTaskDelete(NULL);
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
-			else if (veiculo->direcao == DIREITA) {
-				if (xSemaphoreTake(semaforoFrenteDireita[1], portMAX_DELAY)) {
-					animacaoSairN(5, 16, 5, 20);
-					vTaskDelete(NULL);
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
-			else if (veiculo->direcao == ESQUERDA) {
-				if (xSemaphoreTake(semaforoEsquerda[2], portMAX_DELAY)) {
-					modificaTrafego(5, 12, 5, 20);
-					vTaskDelay(200);
-					animacaoViaNS(8, 12, 5, 12, 1);
-					veiculo->cruzamentoAtual = C;
-					veiculo->semaforoAtual = N;
-					modificaTrafego(13, 12, 8, 12);
-					veiculo->direcao = rand() % 3;
+		esperaSimulacao(tempoPercurso(distanciaCelulas(anterior, veiculo->posicao), segmento->perfil));
+		anterior = veiculo->posicao;
+	}
+}
+
+#define INTERVALO_RESERVA_MS 250 // Duração simulada de um intervalo da tabela de reservas dos cruzamentos
+
+TabelaReserva reservasCruzamento[4];
+
+// Bit de cada célula de cruzamento na tabela de reservas, pela posição relativa à origem do cruzamento.
+// As travessias são as mesmas nos quatro cruzamentos, então a numeração também é
+signed char bitCelulaCruzamento[LINHAS_MALHA][COLUNAS_MALHA];
+
+// Duração de um intervalo em ticks com a escala vigente. Uma troca de escala desalinha as reservas já
+// feitas por alguns intervalos; o mapa de ocupação continua impedindo que dois veículos dividam uma célula
+TickType_t ticksIntervaloReserva() {
+	TickType_t ticks = ticksSimulacao(INTERVALO_RESERVA_MS);
+	return ticks > 0 ? ticks : 1;
+}
+
+uint32_t intervaloReservaAtual() {
+	return (uint32_t)(xTaskGetTickCount() / ticksIntervaloReserva());
+}
+
+void inicializaReservas() {
+	int nBits = 0;
+	memset(bitCelulaCruzamento, -1, sizeof(bitCelulaCruzamento));
+	for (int s = 0; s < 4; s++) {
+		for (int d = 0; d < 3; d++) {
+			const Segmento *travessia = &travessias[A][s][d];
+			for (int i = 0; i < travessia->nCelulas; i++) {
+				int lin = travessia->celulas[i].lin - origemCruzamento[A].lin;
+				int col = travessia->celulas[i].col - origemCruzamento[A].col;
+				if (bitCelulaCruzamento[lin][col] < 0) {
+					configASSERT(nBits < MAX_CELULAS_RESERVA);
+					bitCelulaCruzamento[lin][col] = (signed char)nBits++;
 				}
-				vTaskDelay(100); // Espera antes de tentar novamente
 			}
 		}
-		else if (veiculo->cruzamentoAtual == A && veiculo->semaforoAtual == W) { // Cruzamento A e semforo Oeste
-			modificaTrafego(7, 8, 0, 0);
-			vTaskDelay(300);
-			if (veiculo->direcao == FRENTE) {
-				if (xSemaphoreTake(semaforoFrenteDireita[1], portMAX_DELAY)) {
-					modificaTrafego(7, 14, 7, 8);
-					vTaskDelay(100);
-					animacaoViaEW(7, 18, 7, 14, 1);
-					veiculo->cruzamentoAtual = B;
-					veiculo->semaforoAtual = W;
-					modificaTrafego(7, 28, 7, 18);
-					veiculo->direcao = rand() % 3;
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
-			else if (veiculo->direcao == DIREITA) {
-				if (xSemaphoreTake(semaforoFrenteDireita[1], portMAX_DELAY)) {
-					modificaTrafego(7, 12, 7, 8);
-					vTaskDelay(100);
-					animacaoViaNS(8, 12, 7, 12, 1);
-					veiculo->cruzamentoAtual = C;
-					veiculo->semaforoAtual = N;
-					modificaTrafego(13, 12, 8, 12);
-					veiculo->direcao = rand() % 3;
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
-			else if (veiculo->direcao == ESQUERDA) {
-				if (xSemaphoreTake(semaforoEsquerda[1], portMAX_DELAY)) {
-					modificaTrafego(7, 16, 7, 8);
-					vTaskDelay(200);
-					animacaoSairN(5, 16, 7, 16);
-					vTaskDelete(NULL);
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
+	}
+	for (int c = 0; c < 4; c++)
+		inicializaTabelaReserva(&reservasCruzamento[c], intervaloReservaAtual());
+}
+
+// Pede ao cruzamento a travessia do veículo a partir de agora. Cada célula é reservada do intervalo em que o
+// veículo chega nela até o intervalo em que sai, com um intervalo de folga, usando os mesmos tempos de
+// percorreSegmento. Retorna 0 se alguma célula já está reservada por outro veículo em algum desses intervalos
+// ou se o sinal do movimento fechou desde que o veículo o viu aberto
+int reservaTravessia(Veiculo *veiculo) {
+	const Segmento *travessia = &travessias[veiculo->cruzamentoAtual][veiculo->semaforoAtual][veiculo->direcao];
+	Celula origem = origemCruzamento[veiculo->cruzamentoAtual];
+	uint64_t mascaras[INTERVALOS_RESERVA];
+	int nIntervalos = 0;
+	double instante = 0; // ms desde o início da travessia
+	Celula anterior = veiculo->posicao;
+
+	memset(mascaras, 0, sizeof(mascaras));
+	for (int i = 0; i < travessia->nCelulas; i++) {
+		Celula celula = travessia->celulas[i];
+		double duracao = tempoPercurso(distanciaCelulas(anterior, celula), travessia->perfil);
+		int primeiro = (int)(instante / INTERVALO_RESERVA_MS);
+		int ultimo = (int)((instante + duracao) / INTERVALO_RESERVA_MS) + 1;
+		if (ultimo >= INTERVALOS_RESERVA)
+			return 0;
+		uint64_t bit = 1ull << bitCelulaCruzamento[celula.lin - origem.lin][celula.col - origem.col];
+		for (int k = primeiro; k <= ultimo; k++)
+			mascaras[k] |= bit;
+		if (ultimo + 1 > nIntervalos)
+			nIntervalos = ultimo + 1;
+		instante += duracao;
+		anterior = celula;
+	}
+
+	// Com o escalonador suspenso o controlador não troca a fase entre a conferência do bit e a reserva
+	EventBits_t sinal = BIT_SINAL(sinalMovimento(veiculo->semaforoAtual, veiculo->direcao));
+	vTaskSuspendAll();
+	int reservado = (xEventGroupGetBits(sinaisAbertos) & sinal) != 0
+		&& reservaCelulas(&reservasCruzamento[veiculo->cruzamentoAtual], intervaloReservaAtual(), mascaras, nIntervalos);
+	xTaskResumeAll();
+	return reservado;
+}
+
+#define PASSO_DINAMICA_MS 100 // Passo de integração da dinâmica das vias
+
+DinamicaVia dinamicaVias[N_VIAS];
+
+// Vagas de cada via interna (semáforo contador); as saídas não têm limite. O veículo pega a vaga da via de
+// destino antes de atravessar e a devolve quando sai dela, então uma via cheia segura os veículos na linha
+// de parada do cruzamento anterior e a fila se propaga para trás
+SemaphoreHandle_t capacidadeVias[N_VIAS];
+char nomeVagas[N_VIAS][12]; // Nomes dos semáforos no registro de filas
+
+// Grafo de espera entre as vias internas, mantido pelos próprios veículos: esperasVaga[o][d] conta os veículos
+// parados na via o esperando vaga na via d. Um ciclo em que todas as vias de destino estão cheias e do qual
+// nenhum veículo sai é um impasse (por exemplo, o anel A-B-D-C todo ocupado)
+volatile LONG esperasVaga[N_VIAS][N_VIAS];
+volatile LONG saidasVia[N_VIAS];     // Veículos que já deixaram cada via, para saber se o ciclo anda
+volatile LONG pedidoRemocao[N_VIAS]; // 1 = o próximo veículo da via que esperar vaga deve deixar a malha
+
+// Pedidos das tarefas dos veículos para a tarefa da dinâmica, que os repassa às filas das vias nos fragmentos
+typedef struct {
+	TipoPedidoVia tipo;
+	idVia via;
+	Veiculo *veiculo;
+} PedidoDinamica;
+
+QueueHandle_t filaDinamica;
+
+int threadsFragmentos = 0; // Threads de trabalho para a dinâmica das vias; 0 = na própria TaskDinamica
+
+// Com n = 2 os distritos são as colunas A-C e B-D; com n = 4, um cruzamento por distrito. Uma via pertence
+// ao distrito do seu cruzamento de destino, onde a fila se forma, mas as suas vagas ficam com o distrito de
+// origem, o único de onde chegam veículos: o dono devolve as vagas liberadas no pacote de cada passo.
+// Cada lado desenha as células das vias de fronteira do vizinho a partir do que ele informa
+const char *hostsDistritos = NULL;
+int portaDistritos = PORTA_DISTRITOS;
+
+idCruzamento origemVia[N_VIAS]; // Cruzamento de onde parte cada via
+int vizinhoDistrito[MAX_DISTRITOS];
+volatile LONG vagasDevolvidas[N_VIAS]; // Vagas de vias de outro distrito de origem liberadas aqui e ainda não informadas
+// Veículos que seguem para as vias de cada vizinho (RegistroDistrito). Uma fila por vizinho, para que o pacote
+// cheio de um deles não segure as transferências para os outros
+QueueHandle_t filaTransferencia[MAX_DISTRITOS];
+char nomeTransferencia[MAX_DISTRITOS][16];
+
+int distritoCruzamento(idCruzamento cruzamento) {
+	if (nDistritos == 2)
+		return (cruzamento == A || cruzamento == C) ? 0 : 1;
+	if (nDistritos == 4)
+		return cruzamento;
+	return 0;
+}
+
+int cruzamentoLocal(idCruzamento cruzamento) {
+	return distritoCruzamento(cruzamento) == distritoLocal;
+}
+
+int distritoVia(idVia via) {
+	return distritoCruzamento(vias[via].saida ? origemVia[via] : vias[via].cruzamentoDestino);
+}
+
+// Calcula as origens das vias e os vizinhos e liga este processo a eles. Bloqueia até todos estarem ligados
+void inicializaDistritos() {
+	for (int c = 0; c < 4; c++) {
+		for (int lado = 0; lado < 4; lado++)
+			origemVia[viaPorLado[c][lado]] = c;
+	}
+	if (nDistritos == 1)
+		return;
+	for (int v = 0; v < N_VIAS; v++) {
+		int origem = distritoCruzamento(origemVia[v]);
+		int destino = distritoVia(v);
+		if (origem == distritoLocal && destino != distritoLocal)
+			vizinhoDistrito[destino] = 1;
+		if (destino == distritoLocal && origem != distritoLocal)
+			vizinhoDistrito[origem] = 1;
+	}
+	for (int d = 0; d < nDistritos; d++) {
+		if (!vizinhoDistrito[d])
+			continue;
+		filaTransferencia[d] = xQueueCreate(16, sizeof(RegistroDistrito));
+		snprintf(nomeTransferencia[d], sizeof(nomeTransferencia[d]), "Transf D%d", d);
+		vQueueAddToRegistry(filaTransferencia[d], nomeTransferencia[d]);
+	}
+	printf("Distrito %d de %d: ligando aos vizinhos...\n", distritoLocal, nDistritos);
+	int ligado = conectaDistritos(distritoLocal, nDistritos, vizinhoDistrito, hostsDistritos, portaDistritos);
+	configASSERT(ligado);
+}
+
+// Faixas das vias internas: faixasVia faixas corridas e, se comprimentoBolsao > 0, um bolsão de conversão à
+// esquerda com esse comprimento junto à linha de parada. Sem bolsão, a faixa da esquerda também converte
+#define MOVIMENTO(direcao) (1u << (direcao))
+#define TODOS_MOVIMENTOS (MOVIMENTO(FRENTE) | MOVIMENTO(DIREITA) | MOVIMENTO(ESQUERDA))
+
+// Veículos flexíveis (--flexiveis=<percentual>): dessa porcentagem dos veículos, quem vai seguir em frente ou
+// converter à esquerda aceita também o outro movimento e atravessa no sinal que abrir primeiro, desde que
+// a faixa em que parou permita os dois
+int percentualFlexiveis = 0;
+
+unsigned movimentosVeiculo(const Veiculo *veiculo) {
+	return MOVIMENTO(veiculo->direcao) | veiculo->alternativas;
+}
+
+// Próxima direção do veículo, escolhida antes de entrar na via
+void sorteiaDirecao(Veiculo *veiculo) {
+	veiculo->direcao = rand() % 3;
+	veiculo->alternativas = 0;
+	if (veiculo->direcao != DIREITA && rand() % 100 < percentualFlexiveis)
+		veiculo->alternativas = MOVIMENTO(veiculo->direcao == FRENTE ? ESQUERDA : FRENTE);
+}
+
+// No registro enviado a outro distrito, as alternativas vão nos bits acima da direção
+uint8_t direcaoRegistro(const Veiculo *veiculo) {
+	return (uint8_t)(veiculo->direcao | veiculo->alternativas << 2);
+}
+
+// Movimentos que o veículo pode fazer da linha de parada: os que ele aceita e a sua faixa permite
+unsigned opcoesParada(const Veiculo *veiculo) {
+	unsigned opcoes = movimentosVeiculo(veiculo) & veiculo->movimentosFaixa;
+	return opcoes ? opcoes : MOVIMENTO(veiculo->direcao);
+}
+
+// Bits dos sinais que liberam alguma das opções do veículo
+EventBits_t sinaisVeiculo(const Veiculo *veiculo) {
+	unsigned opcoes = opcoesParada(veiculo);
+	EventBits_t sinais = 0;
+	for (Direcao d = FRENTE; d <= ESQUERDA; d++)
+		if (opcoes & MOVIMENTO(d))
+			sinais |= BIT_SINAL(sinalMovimento(veiculo->semaforoAtual, d));
+	return sinais;
+}
+
+// Fica com a primeira opção cujo sinal está aberto, mantendo a direção atual se ela for uma delas
+void escolheMovimentoAberto(Veiculo *veiculo, EventBits_t abertos) {
+	unsigned opcoes = opcoesParada(veiculo);
+	if ((opcoes & MOVIMENTO(veiculo->direcao)) && (abertos & BIT_SINAL(sinalMovimento(veiculo->semaforoAtual, veiculo->direcao))))
+		return;
+	for (Direcao d = FRENTE; d <= ESQUERDA; d++) {
+		if ((opcoes & MOVIMENTO(d)) && (abertos & BIT_SINAL(sinalMovimento(veiculo->semaforoAtual, d)))) {
+			veiculo->alternativas = movimentosVeiculo(veiculo) & ~MOVIMENTO(d);
+			veiculo->direcao = d;
+			return;
 		}
-		// Cruzamento B
-		if (veiculo->cruzamentoAtual == B && veiculo->semaforoAtual == N) { // Cruzamento B e semforo Norte
-			modificaTrafego(3, 31, 0, 0);
-			vTaskDelay(300);
-			if (veiculo->direcao == FRENTE) {
-				// Espera pelo sinal do semforo
-				if (xSemaphoreTake(semaforoFrenteDireita[0], portMAX_DELAY)) {
-					modificaTrafego(6, 31, 3, 31);
-					vTaskDelay(100);
-					animacaoViaNS(8, 31, 6, 31, 1);
-					veiculo->cruzamentoAtual = D;
-					modificaTrafego(13, 31, 8, 31);
-					veiculo->direcao = rand() % 3; // Prxima direo do veculo
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
-			else if (veiculo->direcao == DIREITA) {
-				if (xSemaphoreTake(semaforoFrenteDireita[0], portMAX_DELAY)) {
-					modificaTrafego(5, 31, 3, 31);
-					vTaskDelay(200);
-					animacaoViaEW(5, 30, 5, 31, -1);
-					vTaskDelay(100);
-					veiculo->cruzamentoAtual = A;
-					veiculo->semaforoAtual = E;
-					modificaTrafego(5, 20, 5, 20);
-					veiculo->direcao = rand() % 3; // Prxima direo do veculo
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
-			else if (veiculo->direcao == ESQUERDA) {
-				if (xSemaphoreTake(semaforoEsquerda[0], portMAX_DELAY)) {
-					modificaTrafego(7, 31, 3, 31);
-					vTaskDelay(100);
-					animacaoSairE(7, 39, 7, 31, 1);
-					vTaskDelete(NULL);
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
+	}
+}
+
+// Lista de espera do sinal do veículo, ou NULL se as suas opções dependem de sinais diferentes
+ListaEspera *listaSinaisVeiculo(const Veiculo *veiculo) {
+	EventBits_t sinais = sinaisVeiculo(veiculo);
+	for (int s = 0; s < N_SINAIS; s++)
+		if (sinais == BIT_SINAL(s))
+			return &esperaSinal[s];
+	return NULL;
+}
+
+int faixasVia = 2;
+double comprimentoBolsao = 15.0;
+
+void configuraFaixas(DinamicaVia *dinamica) {
+	int bolsao = comprimentoBolsao > 0;
+	for (int f = 0; f < faixasVia; f++) {
+		unsigned movimentos = MOVIMENTO(FRENTE);
+		if (f == 0)
+			movimentos |= MOVIMENTO(DIREITA);
+		if (f == faixasVia - 1 && !bolsao)
+			movimentos |= MOVIMENTO(ESQUERDA);
+		adicionaFaixa(dinamica, 0.0f, movimentos);
+	}
+	if (bolsao) {
+		float inicio = dinamica->comprimento - (float)comprimentoBolsao;
+		adicionaFaixa(dinamica, inicio > 0.0f ? inicio : 0.0f, MOVIMENTO(ESQUERDA));
+	}
+}
+
+void inicializaDinamicaVias() {
+	inicializaDinamica();
+	for (int i = 0; i < N_VIAS; i++) {
+		inicializaDinamicaVia(&dinamicaVias[i], (float)vias[i].segmento.comprimento,
+			(float)(velocidadePerfil[vias[i].segmento.perfil] / 3.6), !vias[i].saida);
+		if (vias[i].saida)
+			adicionaFaixa(&dinamicaVias[i], 0.0f, TODOS_MOVIMENTOS);
+		else
+			configuraFaixas(&dinamicaVias[i]);
+		if (!vias[i].saida && cruzamentoLocal(origemVia[i])) {
+			int vagas = capacidadeVia(&dinamicaVias[i]);
+			capacidadeVias[i] = xSemaphoreCreateCounting(vagas, vagas);
+			snprintf(nomeVagas[i], sizeof(nomeVagas[i]), "Vagas %s", nomeVia[i]);
+			vQueueAddToRegistry(capacidadeVias[i], nomeVagas[i]); // Nome no rastro e no depurador
 		}
-		else if (veiculo->cruzamentoAtual == B && veiculo->semaforoAtual == S) { // Cruzamento B e semforo Sul
-			modificaTrafego(10, 35, 0, 0);
-			vTaskDelay(300);
-			if (veiculo->direcao == FRENTE) {
-				if (xSemaphoreTake(semaforoFrenteDireita[0], portMAX_DELAY)) {
-					animacaoSairN(6, 35, 10, 35);
-					vTaskDelete(NULL);
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
-			else if (veiculo->direcao == DIREITA) {
-				if (xSemaphoreTake(semaforoFrenteDireita[0], portMAX_DELAY)) {
-					modificaTrafego(7, 35, 10, 35);
-					vTaskDelay(100);
-					animacaoSairE(7, 37, 7, 35, 1);
-					vTaskDelete(NULL);
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
-			else if (veiculo->direcao == ESQUERDA) {
-				if (xSemaphoreTake(semaforoEsquerda[1], portMAX_DELAY)) {
-					modificaTrafego(5, 35, 10, 35);
-					vTaskDelay(200);
-					animacaoViaEW(5, 30, 5, 35, -1);
-					vTaskDelay(100);
-					veiculo->cruzamentoAtual = A;
-					veiculo->semaforoAtual = E;
-					modificaTrafego(5, 20, 5, 20);
-					veiculo->direcao = rand() % 3; // Prxima direo do veculo
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
+	}
+	filaDinamica = xQueueCreate(16, sizeof(PedidoDinamica));
+	vQueueAddToRegistry(filaDinamica, "Dinamica");
+
+	// Um fragmento por cruzamento: as vias internas pertencem ao cruzamento de destino, onde as filas se
+	// formam, e as saídas ao cruzamento de onde partem
+	int donoVia[N_VIAS];
+	int saidaVia[N_VIAS];
+	for (int v = 0; v < N_VIAS; v++) {
+		donoVia[v] = vias[v].cruzamentoDestino;
+		saidaVia[v] = vias[v].saida;
+	}
+	for (int c = 0; c < 4; c++) {
+		for (int lado = 0; lado < 4; lado++) {
+			if (vias[viaPorLado[c][lado]].saida)
+				donoVia[viaPorLado[c][lado]] = c;
 		}
-		else if (veiculo->cruzamentoAtual == B && veiculo->semaforoAtual == E) { // Cruzamento B e semforo Leste
-			modificaTrafego(5, 39, 0, 0);
-			vTaskDelay(300);
-			if (veiculo->direcao == FRENTE) {
-				if (xSemaphoreTake(semaforoFrenteDireita[1], portMAX_DELAY)) {
-					modificaTrafego(5, 33, 5, 39);
-					vTaskDelay(200);
-					animacaoViaEW(5, 30, 5, 33, -1);
-					vTaskDelay(100);
-					veiculo->cruzamentoAtual = A;
-					veiculo->semaforoAtual = E;
-					modificaTrafego(5, 20, 5, 20);
-					veiculo->direcao = rand() % 3; // Prxima direo do veculo
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
-			else if (veiculo->direcao == DIREITA) {
-				if (xSemaphoreTake(semaforoFrenteDireita[1], portMAX_DELAY)) {
-					modificaTrafego(5, 35, 5, 39);
-					vTaskDelay(200);
-					animacaoSairN(5, 35, 5, 35);
-					vTaskDelete(NULL);
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
-			else if (veiculo->direcao == ESQUERDA) {
-				if (xSemaphoreTake(semaforoEsquerda[2], portMAX_DELAY)) {
-					modificaTrafego(5, 31, 5, 39);
-					vTaskDelay(200);
-					animacaoViaNS(8, 31, 5, 31, 1);
-					veiculo->cruzamentoAtual = D;
-					veiculo->semaforoAtual = N;
-					modificaTrafego(13, 31, 8, 31);
-					veiculo->direcao = rand() % 3;
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
+	}
+	int criadas = inicializaFragmentos(dinamicaVias, donoVia, saidaVia, N_VIAS, threadsFragmentos);
+	configASSERT(criadas);
+}
+
+// Célula do desenho correspondente a uma posição (m) ao longo da via
+Celula celulaNaVia(idVia via, float posicao) {
+	const Segmento *segmento = &vias[via].segmento;
+	int indice = (int)(posicao / segmento->comprimento * segmento->nCelulas);
+	if (indice < 0)
+		indice = 0;
+	if (indice >= segmento->nCelulas)
+		indice = segmento->nCelulas - 1;
+	return segmento->celulas[indice];
+}
+
+// Desenha os veículos da via nas novas posições. O desenho tem uma célula por sentido, então as faixas de uma
+// via dividem as mesmas células: quando a célula da nova posição já tem outro veículo, o desenho fica na
+// célula anterior até ela vagar
+void desenhaVeiculosVia(idVia via) {
+	for (int f = 0; f < dinamicaVias[via].nFaixas; f++) {
+		DinamicaFaixa *faixa = &dinamicaVias[via].faixas[f];
+		for (int k = 1; k <= faixa->n; k++) {
+			Veiculo *veiculo = faixa->referencia[k];
+			Celula celula = celulaNaVia(via, faixa->posicao[k]);
+			if (modificaTrafego(celula.lin, celula.col, veiculo->posicao.lin, veiculo->posicao.col))
+				veiculo->posicao = celula;
 		}
-		else if (veiculo->cruzamentoAtual == B && veiculo->semaforoAtual == W) { // Cruzamento B e semforo Oeste
-			modificaTrafego(7, 28, 0, 0);
-			vTaskDelay(300);
-			if (veiculo->direcao == FRENTE) {
-				if (xSemaphoreTake(semaforoFrenteDireita[1], portMAX_DELAY)) {
-					modificaTrafego(7, 33, 7, 28);
-					vTaskDelay(100);
-					animacaoSairE(7, 37, 7, 33, 1);
-					vTaskDelete(NULL);
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
-			else if (veiculo->direcao == DIREITA) {
-				if (xSemaphoreTake(semaforoFrenteDireita[1], portMAX_DELAY)) {
-					modificaTrafego(7, 31, 7, 28);
-					vTaskDelay(100);
-					animacaoViaNS(8, 31, 7, 31, 1);
-					veiculo->cruzamentoAtual = D;
-					veiculo->semaforoAtual = N;
-					modificaTrafego(13, 31, 8, 31);
-					veiculo->direcao = rand() % 3;
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
-			else if (veiculo->direcao == ESQUERDA) {
-				if (xSemaphoreTake(semaforoEsquerda[1], portMAX_DELAY)) {
-					modificaTrafego(7, 35, 7, 28);
-					vTaskDelay(200);
-					animacaoSairN(5, 35, 7, 35);
-					vTaskDelete(NULL);
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
+	}
+}
+
+// Formato do evento de usuário de cada tipo de transição: id do veículo, cruzamento (0 = A) e via
+const char *formatoRastroVeiculo[] = {
+	"%d chegada cruzamento %d via %d", "%d verde cruzamento %d via %d", "%d entrada cruzamento %d via %d",
+	"%d saida cruzamento %d via %d"
+};
+
+// Registro de telemetria de uma transição do veículo, também como evento de usuário no rastro; sem --telemetria,
+// emiteTelemetria retorna de imediato
+void telemetriaVeiculo(TipoTelemetria tipo, const Veiculo *veiculo, int via) {
+	RegistroTelemetria registro = { xTaskGetTickCount(), veiculo->idVeiculo, (uint8_t)tipo, (uint8_t)veiculo->cruzamentoAtual,
+		(uint8_t)veiculo->semaforoAtual, (uint8_t)veiculo->direcao, (uint8_t)via, (uint8_t)distritoLocal, 0 };
+	emiteTelemetria(&registro);
+	vTracePrintF(canalVeiculos, formatoRastroVeiculo[tipo], veiculo->idVeiculo, veiculo->cruzamentoAtual, via);
+}
+
+// Tempos de viagem em segundos simulados, resumidos por par origem-destino (da aproximação onde o veículo
+// começou até a saída da malha) e por via (da entrada até o fim da via), ver quantis.h. Só a tarefa da
+// dinâmica registra, com o escalonador suspenso; a gravação é feita pelo temporizador. Um veículo vindo de
+// outro distrito não tem origem conhecida e só entra nos resumos das vias
+#define N_ORIGENS (METRICAS_CRUZAMENTOS * METRICAS_APROXIMACOES)
+#define N_DESTINOS (N_VIAS - SAIDA_AN)
+#define N_RESUMOS_VIAGEM (N_ORIGENS * N_DESTINOS + N_VIAS)
+ResumoQuantis resumosViagem[N_RESUMOS_VIAGEM]; // Os pares origem-destino e depois as vias
+
+ResumoQuantis *resumoOrigemDestino(int origem, int destino) {
+	return &resumosViagem[origem * N_DESTINOS + destino];
+}
+
+ResumoQuantis *resumoVia(int via) {
+	return &resumosViagem[N_ORIGENS * N_DESTINOS + via];
+}
+
+// O veículo chegou ao fim da via; se ela é uma saída da malha, a viagem terminou
+void registraViagem(const Veiculo *veiculo, int via) {
+	TickType_t agora = xTaskGetTickCount();
+	registraResumo(resumoVia(via), segundosSimulados(agora - veiculo->entradaVia));
+	if (vias[via].saida && veiculo->origem != 0)
+		registraResumo(resumoOrigemDestino(veiculo->origem - 1, via - SAIDA_AN), segundosSimulados(agora - veiculo->inicioViagem));
+}
+
+// Acorda a tarefa ou o retomável do veículo; uma corrotina percebe sozinha que aguardandoChegada voltou a 0
+void avisaChegada(Veiculo *veiculo) {
+	veiculo->aguardandoChegada = 0;
+	if (veiculo->retomavel != NULL)
+		avisaRetomavel(veiculo->retomavel);
+	else if (!veiculo->corrotina)
+		xTaskNotifyGive(veiculo->tarefa);
+}
+
+// Avisa quem chegou à linha de parada (cada faixa tem a sua fila) ou deixou a malha
+void trataEventoVia(const EventoVia *evento) {
+	Veiculo *veiculo = evento->referencia;
+	if (evento->tipo == DEIXOU_MALHA) {
+		limpaTrafego(veiculo->posicao.lin, veiculo->posicao.col); // O veículo foi embora
+		veiculo->naVia = 0;
+		telemetriaVeiculo(TELEMETRIA_SAIDA, veiculo, evento->via);
+		registraViagem(veiculo, evento->via);
+		avisaChegada(veiculo);
+	}
+	else {
+		veiculo->movimentosFaixa = evento->movimentos;
+		if (veiculo->aguardandoChegada) {
+			telemetriaVeiculo(TELEMETRIA_CHEGADA, veiculo, evento->via);
+			registraViagem(veiculo, evento->via);
+			entraFila(veiculo);
+			avisaChegada(veiculo);
+		}
+	}
+}
+
+int iniciaVeiculo(const Veiculo *dados);
+
+// Veículo que chegou de outro distrito: começa no início da via de fronteira, com a vaga já reservada pela
+// origem. Sem memória, a chegada é perdida e a vaga volta para a origem
+void criaVeiculoTransferido(const RegistroDistrito *registro) {
+	Veiculo veiculo;
+	memset(&veiculo, 0, sizeof(veiculo));
+	veiculo.idVeiculo = registro->dado;
+	veiculo.viaAtual = registro->via;
+	veiculo.cruzamentoAtual = vias[registro->via].cruzamentoDestino;
+	veiculo.semaforoAtual = vias[registro->via].semaforoDestino;
+	veiculo.direcao = registro->valor & 3;
+	veiculo.alternativas = registro->valor >> 2;
+	veiculo.transferido = 1;
+	if (!iniciaVeiculo(&veiculo))
+		InterlockedIncrement(&vagasDevolvidas[registro->via]);
+}
+
+// Desenha a zona fantasma: as células de uma via do vizinho, sem ocupar o mapa de ocupação local
+void desenhaFantasma(idVia via, uint32_t ocupadas) {
+	const Segmento *segmento = &vias[via].segmento;
+	for (int i = 0; i < segmento->nCelulas; i++) {
+		Celula celula = segmento->celulas[i];
+		trafego[celula.lin][celula.col] = (ocupadas >> i) & 1 ? 'o' : trafegoBase[celula.lin][celula.col];
+	}
+}
+
+// Um passo da troca com os distritos vizinhos. Manda a cada vizinho os veículos que seguem para as suas vias,
+// as vagas devolvidas e a ocupação das vias de fronteira deste distrito, e a fase dos sinais; depois aplica
+// todos os pacotes que já chegaram deles, sem esperar o do mesmo passo. A zona fantasma e a fase do vizinho
+// são, portanto, as do último pacote recebido, que pode estar até CAPACIDADE_PACOTES passos atrás: se um
+// vizinho atrasa mais que isso, a fila de saída enche e este distrito espera por ele
+void trocaDistritos() {
+	static uint32_t passo = 0;
+	static PacoteDistrito pacotes[MAX_DISTRITOS];
+	RegistroDistrito registro;
+
+	for (int d = 0; d < nDistritos; d++) {
+		PacoteDistrito *pacote = &pacotes[d];
+		if (!vizinhoDistrito[d])
+			continue;
+		pacote->passo = passo;
+		pacote->origem = distritoLocal;
+		pacote->nRegistros = 0;
+		RegistroDistrito fase = { REGISTRO_FASE, 0, (uint8_t)faseSinais, 0 };
+		pacote->registros[pacote->nRegistros++] = fase;
+		for (int v = 0; v < N_VIAS; v++) {
+			if (vias[v].saida || distritoVia(v) != distritoLocal || distritoCruzamento(origemVia[v]) != d)
+				continue;
+			const Segmento *segmento = &vias[v].segmento;
+			uint32_t ocupadas = 0;
+			for (int i = 0; i < segmento->nCelulas; i++)
+				ocupadas |= (uint32_t)celulaOcupada(segmento->celulas[i].lin, segmento->celulas[i].col) << i;
+			RegistroDistrito celulas = { REGISTRO_CELULAS, (uint8_t)v, 0, (int32_t)ocupadas };
+			pacote->registros[pacote->nRegistros++] = celulas;
+			LONG vagas = InterlockedExchange(&vagasDevolvidas[v], 0);
+			if (vagas > 0) {
+				RegistroDistrito devolvidas = { REGISTRO_VAGAS, (uint8_t)v, 0, vagas };
+				pacote->registros[pacote->nRegistros++] = devolvidas;
 			}
 		}
-		// Cruzamento C
-		if (veiculo->cruzamentoAtual == C && veiculo->semaforoAtual == N) { // Cruzamento C e semforo Norte
-			modificaTrafego(13, 12, 0, 0);
-			vTaskDelay(300);
-			if (veiculo->direcao == FRENTE) {
-				// Espera pelo sinal do semforo
-				if (xSemaphoreTake(semaforoFrenteDireita[0], portMAX_DELAY)) {
-					modificaTrafego(16, 12, 13, 12);
-					vTaskDelay(200);
-					animacaoSairS(18, 12, 16, 12, 1);
-					vTaskDelete(NULL);
+	}
+	// Os veículos que não cabem no pacote do seu vizinho ficam na fila dele para o próximo passo
+	for (int d = 0; d < nDistritos; d++) {
+		PacoteDistrito *pacote = &pacotes[d];
+		while (vizinhoDistrito[d] && pacote->nRegistros < MAX_REGISTROS_PACOTE
+			&& xQueueReceive(filaTransferencia[d], &registro, 0) == pdPASS)
+			pacote->registros[pacote->nRegistros++] = registro;
+	}
+	for (int d = 0; d < nDistritos; d++) {
+		while (vizinhoDistrito[d] && !enviaPacoteDistrito(d, &pacotes[d]))
+			vTaskDelay(1);
+	}
+	passo++;
+
+	for (int d = 0; d < nDistritos; d++) {
+		PacoteDistrito *pacote = &pacotes[d];
+		while (vizinhoDistrito[d] && recebePacoteDistrito(d, pacote)) {
+			for (int i = 0; i < pacote->nRegistros; i++) {
+				const RegistroDistrito *recebido = &pacote->registros[i];
+				if (recebido->via >= N_VIAS)
+					continue;
+				if (recebido->tipo == REGISTRO_VEICULO)
+					criaVeiculoTransferido(recebido);
+				else if (recebido->tipo == REGISTRO_VAGAS && capacidadeVias[recebido->via] != NULL) {
+					for (int k = 0; k < recebido->dado; k++)
+						xSemaphoreGive(capacidadeVias[recebido->via]);
 				}
-				vTaskDelay(100); // Espera antes de tentar novamente
+				else if (recebido->tipo == REGISTRO_CELULAS)
+					desenhaFantasma(recebido->via, (uint32_t)recebido->dado);
+				else if (recebido->tipo == REGISTRO_FASE)
+					faseDistrito[d] = recebido->valor;
 			}
-			else if (veiculo->direcao == DIREITA) {
-				if (xSemaphoreTake(semaforoFrenteDireita[0], portMAX_DELAY)) {
-					modificaTrafego(15, 12, 13, 12);
-					vTaskDelay(200);
-					animacaoSairW(15, 10, 15, 12);
-					vTaskDelete(NULL);
+		}
+	}
+}
+
+// Coordena a dinâmica das vias a cada passo: repassa os pedidos dos veículos às filas das vias, avança os
+// fragmentos (em paralelo, se houver threads de trabalho) e depois desenha e avisa os veículos. O escalonador
+// fica suspenso durante o passo para que ele nunca seja intercalado com a tarefa de um veículo; as threads de
+// trabalho não usam o FreeRTOS e por isso não são afetadas
+void TaskDinamica(void *param) {
+	PedidoDinamica pedido;
+	EventoVia evento;
+
+	while (1) {
+		// Os pedidos são lidos com o escalonador já suspenso: um veículo que pediu para sair não é mais
+		// desenhado pela dinâmica depois que a sua tarefa volta a rodar
+		vTaskSuspendAll();
+		while (xQueueReceive(filaDinamica, &pedido, 0) == pdPASS) {
+			PedidoVia pedidoVia = { pedido.tipo, pedido.veiculo, (float)(velocidadePerfil[PERFIL_TRAVESSIA] / 3.6),
+				movimentosVeiculo(pedido.veiculo) };
+			int enviado = enviaPedidoVia(pedido.via, &pedidoVia);
+			configASSERT(enviado);
+		}
+		executaPassoFragmentos(PASSO_DINAMICA_MS / 1000.0f);
+		while (recebeEventoVia(&evento))
+			trataEventoVia(&evento);
+		for (int v = 0; v < N_VIAS; v++)
+			desenhaVeiculosVia(v);
+		xTaskResumeAll();
+		if (nDistritos > 1)
+			trocaDistritos();
+		esperaSimulacao(PASSO_DINAMICA_MS);
+	}
+}
+
+// Marca o veículo como entrando na via e monta o pedido de entrada para a dinâmica
+PedidoDinamica entraNaVia(Veiculo *veiculo, idVia via) {
+	PedidoDinamica pedido = { ENTRA_VIA, via, veiculo };
+	veiculo->segmento = NULL;
+	veiculo->naVia = 1;
+	veiculo->viaAtual = via;
+	veiculo->movimentosFaixa = 0;
+	veiculo->aguardandoChegada = 1;
+	veiculo->entradaVia = xTaskGetTickCount();
+	telemetriaVeiculo(TELEMETRIA_ENTRADA, veiculo, via);
+	return pedido;
+}
+
+// Entrega o veículo à dinâmica da via e bloqueia até ele parar na linha de parada ou deixar a malha.
+// A direção do veículo já deve ser a do próximo cruzamento, pois dela depende a faixa que ele vai ocupar
+void percorreVia(Veiculo *veiculo, idVia via) {
+	PedidoDinamica pedido = entraNaVia(veiculo, via);
+	xQueueSend(filaDinamica, &pedido, portMAX_DELAY);
+	ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+
+// Pega uma vaga na via sem esperar. Retorna 0 se a via está cheia
+int pegaVaga(idVia via) {
+	return capacidadeVias[via] == NULL || xSemaphoreTake(capacidadeVias[via], 0) == pdPASS;
+}
+
+void devolveVaga(idVia via) {
+	if (capacidadeVias[via] != NULL)
+		xSemaphoreGive(capacidadeVias[via]);
+	else if (!vias[via].saida)
+		InterlockedIncrement(&vagasDevolvidas[via]); // A vaga é do distrito de origem
+}
+
+// Depois que o pedido de saída foi aceito pela fila da dinâmica: marca o veículo fora da via e devolve a vaga
+void liberaVia(Veiculo *veiculo) {
+	veiculo->naVia = 0;
+	devolveVaga(veiculo->viaAtual);
+	InterlockedIncrement(&saidasVia[veiculo->viaAtual]);
+}
+
+// Retira o veículo da linha de parada quando ele recebe o sinal verde e devolve a vaga que ele ocupava
+void deixaVia(Veiculo *veiculo) {
+	if (!veiculo->naVia)
+		return;
+	PedidoDinamica pedido = { SAI_VIA, veiculo->viaAtual, veiculo };
+	xQueueSend(filaDinamica, &pedido, portMAX_DELAY);
+	liberaVia(veiculo);
+}
+
+#define PERIODO_IMPASSE_MS 1000 // Intervalo entre verificações do grafo de espera
+#define VERIFICACOES_IMPASSE 3  // Verificações seguidas com o mesmo ciclo parado para declarar o impasse
+
+typedef enum {
+	IMPASSE_RELATA, // Só informa o ciclo
+	IMPASSE_REMOVE  // Informa e retira da malha um veículo do ciclo, liberando uma vaga
+} PoliticaImpasse;
+
+PoliticaImpasse politicaImpasse = IMPASSE_RELATA;
+int impassesDetectados = 0;
+
+void marcaEsperaVaga(Veiculo *veiculo, idVia destino) {
+	if (!veiculo->naVia || veiculo->esperandoVaga)
+		return;
+	veiculo->esperandoVaga = 1;
+	veiculo->viaEsperada = destino;
+	InterlockedIncrement(&esperasVaga[veiculo->viaAtual][destino]);
+}
+
+void desmarcaEsperaVaga(Veiculo *veiculo) {
+	if (!veiculo->esperandoVaga)
+		return;
+	veiculo->esperandoVaga = 0;
+	InterlockedDecrement(&esperasVaga[veiculo->viaAtual][veiculo->viaEsperada]);
+}
+
+// Busca em profundidade a partir de via. estado: 0 = não visitada, 1 = no caminho atual, 2 = concluída.
+// Ao achar uma aresta para uma via do caminho atual, copia o ciclo para ciclo[] e retorna o seu tamanho
+static int buscaCiclo(int via, int estado[N_VIAS], int caminho[N_VIAS], int profundidade, idVia ciclo[N_VIAS]) {
+	estado[via] = 1;
+	caminho[profundidade] = via;
+	for (int destino = 0; destino < N_VIAS; destino++) {
+		if (esperasVaga[via][destino] <= 0 || capacidadeVias[destino] == NULL || uxSemaphoreGetCount(capacidadeVias[destino]) > 0)
+			continue;
+		if (estado[destino] == 1) {
+			int inicio = 0;
+			while (caminho[inicio] != destino)
+				inicio++;
+			for (int i = inicio; i <= profundidade; i++)
+				ciclo[i - inicio] = caminho[i];
+			return profundidade - inicio + 1;
+		}
+		if (estado[destino] == 0) {
+			int n = buscaCiclo(destino, estado, caminho, profundidade + 1, ciclo);
+			if (n > 0)
+				return n;
+		}
+	}
+	estado[via] = 2;
+	return 0;
+}
+
+int procuraCicloEspera(idVia ciclo[N_VIAS]) {
+	int estado[N_VIAS] = { 0 };
+	int caminho[N_VIAS];
+	for (int via = 0; via < N_VIAS; via++) {
+		if (estado[via] == 0) {
+			int n = buscaCiclo(via, estado, caminho, 0, ciclo);
+			if (n > 0)
+				return n;
+		}
+	}
+	return 0;
+}
+
+// Monitor de impasse, chamado pelo temporizador. Só declara o impasse quando o mesmo ciclo aparece em
+// VERIFICACOES_IMPASSE verificações seguidas sem que nenhum veículo tenha deixado as suas vias, o que separa
+// uma rede parada de uma rede só lenta
+void verificaImpasse(TimerHandle_t temporizador) {
+	static idVia cicloAnterior[N_VIAS];
+	static int tamanhoAnterior = 0;
+	static LONG saidasAnteriores[N_VIAS];
+	static int repeticoes = 0;
+	idVia ciclo[N_VIAS];
+
+	int tamanho = procuraCicloEspera(ciclo);
+	int parado = tamanho > 0 && tamanho == tamanhoAnterior && memcmp(ciclo, cicloAnterior, tamanho * sizeof(idVia)) == 0;
+	for (int i = 0; i < tamanho; i++)
+		parado = parado && saidasVia[ciclo[i]] == saidasAnteriores[ciclo[i]];
+	repeticoes = parado ? repeticoes + 1 : 0;
+	memcpy(cicloAnterior, ciclo, tamanho * sizeof(idVia));
+	tamanhoAnterior = tamanho;
+	for (int v = 0; v < N_VIAS; v++)
+		saidasAnteriores[v] = saidasVia[v];
+
+	if (repeticoes == VERIFICACOES_IMPASSE) {
+		impassesDetectados++;
+		printf("Impasse %d:", impassesDetectados);
+		for (int i = 0; i < tamanho; i++)
+			printf(" %s ->", nomeVia[ciclo[i]]);
+		printf(" %s\n", nomeVia[ciclo[0]]);
+		if (politicaImpasse == IMPASSE_REMOVE)
+			InterlockedExchange(&pedidoRemocao[ciclo[0]], 1);
+		repeticoes = 0;
+	}
+}
+
+// Retira da malha um veículo parado na linha de parada (política de resolução de impasse). Não retorna
+void retiraVeiculo(Veiculo *veiculo) {
+	telemetriaVeiculo(TELEMETRIA_SAIDA, veiculo, veiculo->viaAtual);
+	saiFila(veiculo, 0);
+	desmarcaEsperaVaga(veiculo);
+	deixaVia(veiculo);
+	limpaTrafego(veiculo->posicao.lin, veiculo->posicao.col);
+	if (veiculo->alocado)
+		vPortFree(veiculo);
+	vTaskDelete(NULL);
+}
+
+// Passa o veículo, já com a vaga e a próxima direção, para o distrito dono da via. Não retorna
+void transfereVeiculo(Veiculo *veiculo, idVia via) {
+	RegistroDistrito registro = { REGISTRO_VEICULO, (uint8_t)via, direcaoRegistro(veiculo), veiculo->idVeiculo };
+	xQueueSend(filaTransferencia[distritoVia(via)], &registro, portMAX_DELAY);
+	limpaTrafego(veiculo->posicao.lin, veiculo->posicao.col);
+	if (veiculo->alocado)
+		vPortFree(veiculo);
+	vTaskDelete(NULL);
+}
+
+typedef enum {
+	TRAVESSIA_LIBERADA,
+	SINAL_FECHADO,
+	SEM_VAGA,    // A via de destino está cheia
+	SEM_RESERVA  // As células do cruzamento já estão reservadas
+} ResultadoTravessia;
+
+idVia proximaViaVeiculo(const Veiculo *veiculo) {
+	return viaPorLado[veiculo->cruzamentoAtual][movimentoBase[veiculo->semaforoAtual][veiculo->direcao].ladoSaida];
+}
+
+// Espera até espera ticks pelos bits dos sinais das opções do veículo, sem consumi-los, de modo que todos os
+// veículos com movimentos liberados acordam juntos quando a fase abre; um veículo flexível acorda com o
+// primeiro dos seus sinais que abrir e fica com esse movimento. Com o sinal aberto, pega uma vaga na via de
+// destino, que devolve em proximaVia, e pede a reserva da travessia.
+// Se o veículo bloqueou com os sinais fechados e acordou com um deles aberto, o tempo desde a abertura da fase
+// é a latência de despertar
+ResultadoTravessia pedeTravessia(Veiculo *veiculo, idVia *proximaVia, TickType_t espera) {
+	EventBits_t sinais = sinaisVeiculo(veiculo);
+	int bloqueou = espera > 0 && (xEventGroupGetBits(sinaisAbertos) & sinais) == 0;
+	EventBits_t abertos = xEventGroupWaitBits(sinaisAbertos, sinais, pdFALSE, pdFALSE, espera) & sinais;
+	if (bloqueou && abertos)
+		metricaDespertar(relogioMetricas() - aberturaFaseRelogio);
+	if (abertos)
+		escolheMovimentoAberto(veiculo, abertos);
+	*proximaVia = proximaViaVeiculo(veiculo);
+	if (!abertos)
+		return SINAL_FECHADO;
+	int vaga = pegaVaga(*proximaVia);
+	int reservado = vaga && reservaTravessia(veiculo);
+	if (reservado) {
+		telemetriaVeiculo(TELEMETRIA_VERDE, veiculo, *proximaVia);
+		saiFila(veiculo, 1);
+		return TRAVESSIA_LIBERADA;
+	}
+	if (!vaga)
+		return SEM_VAGA;
+	devolveVaga(*proximaVia);
+	return SEM_RESERVA;
+}
+
+// O monitor de impasse pediu que o próximo veículo da via que esperar vaga deixe a malha
+int remocaoPedida(Veiculo *veiculo) {
+	return veiculo->naVia && InterlockedCompareExchange(&pedidoRemocao[veiculo->viaAtual], 0, 1) == 1;
+}
+
+void TaskVeiculo(void *param){
+	Veiculo *veiculo = (Veiculo*)param; // Pega os dados do veículo
+	veiculo->tarefa = xTaskGetCurrentTaskHandle();
+	while (!ocupaCelulaInicial(veiculo))
+		esperaSimulacao(ESPERA_CELULA_MS);
+	if (veiculo->transferido)
+		percorreVia(veiculo, veiculo->viaAtual);
+
+	while (1) {
+		esperaSimulacao(300);
+		// Sem vaga ou sem reserva, o veículo continua na linha de parada e tenta de novo
+		idVia proximaVia;
+		ResultadoTravessia resultado = pedeTravessia(veiculo, &proximaVia, portMAX_DELAY);
+		if (resultado != SINAL_FECHADO) {
+			if (resultado != TRAVESSIA_LIBERADA) {
+				if (resultado == SEM_VAGA) {
+					marcaEsperaVaga(veiculo, proximaVia);
+					if (remocaoPedida(veiculo))
+						retiraVeiculo(veiculo);
 				}
-				vTaskDelay(100); // Espera antes de tentar novamente
+				esperaSimulacao(INTERVALO_RESERVA_MS);
+				continue;
 			}
-			else if (veiculo->direcao == ESQUERDA) {
-				if (xSemaphoreTake(semaforoEsquerda[0], portMAX_DELAY)) {
-					modificaTrafego(17, 12, 13, 12);
-					vTaskDelay(100);
-					animacaoViaEW(17, 16, 17, 12, 1);
-					veiculo->cruzamentoAtual = D;
-					veiculo->semaforoAtual = W;
-					modificaTrafego(17, 28, 17, 16);
-					veiculo->direcao = rand() % 3;
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
+			desmarcaEsperaVaga(veiculo);
+			deixaVia(veiculo);
+			percorreSegmento(veiculo, &travessias[veiculo->cruzamentoAtual][veiculo->semaforoAtual][veiculo->direcao]);
+			Via *via = &vias[proximaVia];
+			sorteiaDirecao(veiculo);
+			if (distritoVia(proximaVia) != distritoLocal)
+				transfereVeiculo(veiculo, proximaVia);
+			percorreVia(veiculo, proximaVia);
+			if (via->saida) {
+				if (veiculo->alocado)
+					vPortFree(veiculo);
+				vTaskDelete(NULL); // O veículo foi embora
 			}
+			veiculo->cruzamentoAtual = via->cruzamentoDestino;
+			veiculo->semaforoAtual = via->semaforoDestino;
+			veiculo->segmento = NULL;
 		}
-		else if (veiculo->cruzamentoAtual == C && veiculo->semaforoAtual == S) { // Cruzamento C e semforo Sul
-			modificaTrafego(20, 16, 0, 0);
-			vTaskDelay(300);
-			if (veiculo->direcao == FRENTE) {
-				if (xSemaphoreTake(semaforoFrenteDireita[0], portMAX_DELAY)) {
-					modificaTrafego(16, 16, 20, 16);
-					vTaskDelay(200);
-					animacaoViaNS(14, 16, 16, 16, -1);
-					veiculo->cruzamentoAtual = A;
-					veiculo->semaforoAtual = S;
-					modificaTrafego(10, 16, 0, 0);
-					veiculo->direcao = rand() % 3;
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
-			else if (veiculo->direcao == DIREITA) {
-				if (xSemaphoreTake(semaforoFrenteDireita[0], portMAX_DELAY)) {
-					modificaTrafego(17, 16, 20, 16);
-					vTaskDelay(200);
-					animacaoViaEW(17, 18, 17, 16, 1);
-					veiculo->cruzamentoAtual = D;
-					veiculo->semaforoAtual = W;
-					modificaTrafego(17, 28, 17, 28);
-					veiculo->direcao = rand() % 3;
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
+		esperaSimulacao(100); // Espera antes de tentar novamente
+	}
+}
+
+// Modo --corrotinas=<n>: os veículos rodam em n corrotinas do FreeRTOS, escalonadas pela tarefa ociosa, em
+// vez de uma tarefa com pilha e TCB para cada um; o que precisa sobreviver a uma espera fica em um registro
+// de VeiculoCorrotina. Uma corrotina não pode ser apagada, então cada uma atende um veículo de cada vez e
+// volta ao conjunto quando ele deixa a malha. Como corrotinas e tarefas não podem esperar na mesma fila ou
+// semáforo, a corrotina só faz chamadas sem espera e tenta de novo depois de um crDELAY
+typedef struct {
+	Veiculo veiculo;
+	volatile int ativo; // 1 enquanto a corrotina tem um veículo
+	idVia proximaVia;
+	ResultadoTravessia travessia;
+	ResultadoAvanco avanco;
+	int retirar;        // O monitor de impasse pediu a remoção do veículo
+	Celula anterior;    // Célula antes do último passo na travessia
+	PedidoDinamica pedido;
+	RegistroDistrito transferencia;
+} VeiculoCorrotina;
+
+VeiculoCorrotina *veiculosCorrotina;
+int nCorrotinas = 0; // 0 = cada veículo é uma tarefa
+
+// Variáveis locais não sobrevivem a um crDELAY: o estado fica em veiculosCorrotina[indice]
+void CorrotinaVeiculo(CoRoutineHandle_t xHandle, UBaseType_t indice) {
+	VeiculoCorrotina *estado = &veiculosCorrotina[indice];
+	Veiculo *veiculo = &estado->veiculo;
+
+	crSTART(xHandle);
+	while (1) {
+		while (!estado->ativo) {
+			crDELAY(xHandle, ticksSimulacao(ESPERA_CELULA_MS));
+		}
+		while (!ocupaCelulaInicial(veiculo)) {
+			crDELAY(xHandle, ticksSimulacao(ESPERA_CELULA_MS));
+		}
+		if (veiculo->transferido) {
+			estado->pedido = entraNaVia(veiculo, veiculo->viaAtual);
+			while (xQueueSend(filaDinamica, &estado->pedido, 0) != pdPASS) {
+				crDELAY(xHandle, 1);
 			}
-			else if (veiculo->direcao == ESQUERDA) {
-				if (xSemaphoreTake(semaforoEsquerda[1], portMAX_DELAY)) {
-					modificaTrafego(15, 16, 20, 16);
-					vTaskDelay(200);
-					animacaoSairW(15, 8, 15, 16);
-					vTaskDelete(NULL);
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
+			while (veiculo->aguardandoChegada) {
+				crDELAY(xHandle, ticksSimulacao(PASSO_DINAMICA_MS));
 			}
 		}
-		else if (veiculo->cruzamentoAtual == C && veiculo->semaforoAtual == E) { // Cruzamento C e semforo Leste
-			modificaTrafego(15, 20, 0, 0);
-			vTaskDelay(300);
-			if (veiculo->direcao == FRENTE) {
-				if (xSemaphoreTake(semaforoFrenteDireita[1], portMAX_DELAY)) {
-					modificaTrafego(15, 14, 15, 20);
-					vTaskDelay(200);
-					animacaoSairW(15, 12, 15, 14);
-					vTaskDelete(NULL);
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
+
+		while (estado->ativo) {
+			crDELAY(xHandle, ticksSimulacao(300));
+			// Sem fila de espera no semáforo: com o sinal fechado, a corrotina tenta de novo a cada ESPERA_CELULA_MS
+			while ((estado->travessia = pedeTravessia(veiculo, &estado->proximaVia, 0)) == SINAL_FECHADO) {
+				crDELAY(xHandle, ticksSimulacao(ESPERA_CELULA_MS));
 			}
-			else if (veiculo->direcao == DIREITA) {
-				if (xSemaphoreTake(semaforoFrenteDireita[1], portMAX_DELAY)) {
-					modificaTrafego(15, 16, 15, 20);
-					vTaskDelay(200);
-					animacaoViaNS(14, 16, 15, 16, -1);
-					veiculo->cruzamentoAtual = A;
-					veiculo->semaforoAtual = S;
-					modificaTrafego(10, 16, 0, 0);
-					veiculo->direcao = rand() % 3;
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
+			estado->retirar = 0;
+			if (estado->travessia == SEM_VAGA) {
+				marcaEsperaVaga(veiculo, estado->proximaVia);
+				estado->retirar = remocaoPedida(veiculo);
 			}
-			else if (veiculo->direcao == ESQUERDA) {
-				if (xSemaphoreTake(semaforoEsquerda[2], portMAX_DELAY)) {
-					modificaTrafego(15, 12, 15, 20);
-					vTaskDelay(200);
-					animacaoSairS(18, 12, 15, 12, 1);
-					vTaskDelete(NULL);
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
+			if (estado->travessia != TRAVESSIA_LIBERADA && !estado->retirar) {
+				crDELAY(xHandle, ticksSimulacao(INTERVALO_RESERVA_MS));
+				continue;
 			}
-		}
-		else if (veiculo->cruzamentoAtual == C && veiculo->semaforoAtual == W) { // Cruzamento C e semforo Oeste
-			modificaTrafego(17, 8, 0, 0);
-			vTaskDelay(300);
-			if (veiculo->direcao == FRENTE) {
-				if (xSemaphoreTake(semaforoFrenteDireita[1], portMAX_DELAY)) {
-					modificaTrafego(17, 14, 17, 8);
-					vTaskDelay(200);
-					animacaoViaEW(17, 18, 17, 14, 1);
-					veiculo->cruzamentoAtual = D;
-					veiculo->semaforoAtual = W;
-					modificaTrafego(17, 28, 17, 18);
-					veiculo->direcao = rand() % 3;
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
-			else if (veiculo->direcao == DIREITA) {
-				if (xSemaphoreTake(semaforoFrenteDireita[1], portMAX_DELAY)) {
-					modificaTrafego(17, 12, 17, 8);
-					vTaskDelay(200);
-					animacaoSairS(18, 12, 17, 12, 1);
-					vTaskDelete(NULL);
+
+			desmarcaEsperaVaga(veiculo);
+			if (veiculo->naVia) {
+				estado->pedido = (PedidoDinamica){ SAI_VIA, veiculo->viaAtual, veiculo };
+				while (xQueueSend(filaDinamica, &estado->pedido, 0) != pdPASS) {
+					crDELAY(xHandle, 1);
 				}
-				vTaskDelay(100); // Espera antes de tentar novamente
+				liberaVia(veiculo);
 			}
-			else if (veiculo->direcao == ESQUERDA) {
-				if (xSemaphoreTake(semaforoEsquerda[1], portMAX_DELAY)) {
-					modificaTrafego(17, 16, 17, 8);
-					vTaskDelay(200);
-					animacaoViaNS(14, 16, 17, 16, -1);
-					veiculo->cruzamentoAtual = A;
-					veiculo->semaforoAtual = S;
-					modificaTrafego(10, 16, 0, 0);
-					veiculo->direcao = rand() % 3;
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
+			if (estado->retirar) {
+				telemetriaVeiculo(TELEMETRIA_SAIDA, veiculo, veiculo->viaAtual);
+				saiFila(veiculo, 0);
+				limpaTrafego(veiculo->posicao.lin, veiculo->posicao.col);
+				estado->ativo = 0;
+				continue;
 			}
-		}
-		// Cruzamento D
-		if (veiculo->cruzamentoAtual == D && veiculo->semaforoAtual == N) { // Cruzamento D e semforo Norte
-			modificaTrafego(13, 31, 0, 0);
-			vTaskDelay(300);
-			if (veiculo->direcao == FRENTE) {
-				// Espera pelo sinal do semforo
-				if (xSemaphoreTake(semaforoFrenteDireita[0], portMAX_DELAY)) {
-					modificaTrafego(16, 31, 13, 31);
-					vTaskDelay(100);
-					animacaoSairS(18, 31, 16, 31, 1);
-					vTaskDelete(NULL);
+
+			// Travessia, com os mesmos tempos de percorreSegmento
+			veiculo->segmento = &travessias[veiculo->cruzamentoAtual][veiculo->semaforoAtual][veiculo->direcao];
+			veiculo->indiceCelula = 0;
+			estado->anterior = veiculo->posicao;
+			while ((estado->avanco = avancaVeiculo(veiculo)) != FIM_SEGMENTO) {
+				if (estado->avanco == BLOQUEADO) {
+					crDELAY(xHandle, ticksSimulacao(ESPERA_CELULA_MS));
 				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
-			else if (veiculo->direcao == DIREITA) {
-				if (xSemaphoreTake(semaforoFrenteDireita[0], portMAX_DELAY)) {
-					modificaTrafego(15, 31, 13, 31);
-					vTaskDelay(200);
-					animacaoViaEW(15, 30, 15, 31, -1);
-					vTaskDelay(100);
-					veiculo->cruzamentoAtual = B;
-					veiculo->semaforoAtual = E;
-					modificaTrafego(15, 20, 15, 20);
-					veiculo->direcao = rand() % 3; // Prxima direo do veculo
+				else {
+					crDELAY(xHandle, ticksSimulacao(tempoPercurso(distanciaCelulas(estado->anterior, veiculo->posicao), veiculo->segmento->perfil)));
+					estado->anterior = veiculo->posicao;
 				}
-				vTaskDelay(100); // Espera antes de tentar novamente
 			}
-			else if (veiculo->direcao == ESQUERDA) {
-				if (xSemaphoreTake(semaforoEsquerda[0], portMAX_DELAY)) {
-					modificaTrafego(17, 31, 13, 31);
-					vTaskDelay(100);
-					animacaoSairE(17, 39, 17, 31, 1);
-					vTaskDelete(NULL);
+
+			sorteiaDirecao(veiculo);
+			if (distritoVia(estado->proximaVia) != distritoLocal) {
+				estado->transferencia = (RegistroDistrito){ REGISTRO_VEICULO, (uint8_t)estado->proximaVia, direcaoRegistro(veiculo), veiculo->idVeiculo };
+				while (xQueueSend(filaTransferencia[distritoVia(estado->proximaVia)], &estado->transferencia, 0) != pdPASS) {
+					crDELAY(xHandle, 1);
 				}
-				vTaskDelay(100); // Espera antes de tentar novamente
+				limpaTrafego(veiculo->posicao.lin, veiculo->posicao.col);
+				estado->ativo = 0;
+				continue;
 			}
-		}
-		else if (veiculo->cruzamentoAtual == D && veiculo->semaforoAtual == S) { // Cruzamento D e semforo Sul
-			modificaTrafego(19, 35, 0, 0);
-			vTaskDelay(300);
-			if (veiculo->direcao == FRENTE) {
-				if (xSemaphoreTake(semaforoFrenteDireita[0], portMAX_DELAY)) {
-					modificaTrafego(16, 35, 19, 35);
-					vTaskDelay(200);
-					animacaoViaNS(14, 35, 16, 35, -1);
-					vTaskDelay(100);
-					veiculo->cruzamentoAtual = B;
-					veiculo->semaforoAtual = S;
-					modificaTrafego(10, 35, 0, 0);
-					veiculo->direcao = rand() % 3; // Prxima direo do veculo
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
+			estado->pedido = entraNaVia(veiculo, estado->proximaVia);
+			while (xQueueSend(filaDinamica, &estado->pedido, 0) != pdPASS) {
+				crDELAY(xHandle, 1);
 			}
-			else if (veiculo->direcao == DIREITA) {
-				if (xSemaphoreTake(semaforoFrenteDireita[0], portMAX_DELAY)) {
-					modificaTrafego(17, 35, 19, 35);
-					vTaskDelay(100);
-					animacaoSairE(17, 37, 17, 35, 1);
-					vTaskDelete(NULL);
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
+			while (veiculo->aguardandoChegada) {
+				crDELAY(xHandle, ticksSimulacao(PASSO_DINAMICA_MS));
 			}
-			else if (veiculo->direcao == ESQUERDA) {
-				if (xSemaphoreTake(semaforoEsquerda[1], portMAX_DELAY)) {
-					modificaTrafego(15, 35, 19, 35);
-					vTaskDelay(200);
-					animacaoViaEW(15, 30, 15, 35, -1);
-					vTaskDelay(100);
-					veiculo->cruzamentoAtual = D;
-					veiculo->semaforoAtual = E;
-					modificaTrafego(15, 20, 15, 20);
-					veiculo->direcao = rand() % 3; // Prxima direo do veculo
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
+			if (vias[estado->proximaVia].saida) {
+				estado->ativo = 0; // O veículo foi embora
+				continue;
 			}
+			veiculo->cruzamentoAtual = vias[estado->proximaVia].cruzamentoDestino;
+			veiculo->semaforoAtual = vias[estado->proximaVia].semaforoDestino;
+			veiculo->segmento = NULL;
+			crDELAY(xHandle, ticksSimulacao(100));
 		}
-		else if (veiculo->cruzamentoAtual == D && veiculo->semaforoAtual == E) { // Cruzamento D e semforo Leste
-			modificaTrafego(15, 39, 0, 0);
-			vTaskDelay(300);
-			if (veiculo->direcao == FRENTE) {
-				if (xSemaphoreTake(semaforoFrenteDireita[1], portMAX_DELAY)) {
-					modificaTrafego(15, 33, 15, 39);
-					vTaskDelay(200);
-					animacaoViaEW(15, 30, 15, 33, -1);
-					vTaskDelay(100);
-					veiculo->cruzamentoAtual = A;
-					veiculo->semaforoAtual = E;
-					modificaTrafego(15, 20, 15, 20);
-					veiculo->direcao = rand() % 3; // Prxima direo do veculo
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
-			else if (veiculo->direcao == DIREITA) {
-				if (xSemaphoreTake(semaforoFrenteDireita[1], portMAX_DELAY)) {
-					modificaTrafego(15, 35, 15, 39);
-					vTaskDelay(200);
-					animacaoViaNS(14, 35, 15, 35, -1);
-					vTaskDelay(100);
-					veiculo->cruzamentoAtual = B;
-					veiculo->semaforoAtual = S;
-					modificaTrafego(10, 35, 0, 0);
-					veiculo->direcao = rand() % 3; // Prxima direo do veculo
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
+	}
+	crEND();
+}
+
+// Cria o conjunto de corrotinas. Retorna quantas foram criadas
+int inicializaCorrotinas(int n) {
+	veiculosCorrotina = pvPortMalloc(n * sizeof(VeiculoCorrotina));
+	if (veiculosCorrotina == NULL)
+		return 0;
+	memset(veiculosCorrotina, 0, n * sizeof(VeiculoCorrotina));
+	for (int i = 0; i < n; i++) {
+		if (xCoRoutineCreate(CorrotinaVeiculo, 0, i) != pdPASS)
+			return i;
+	}
+	return n;
+}
+
+// Modo --retomada: cada veículo é uma função retomável, com o estado em um VeiculoRetomavel alocado na sua
+// chegada e liberado na sua saída. Ele só volta a rodar quando o que espera acontece: o fim de uma espera,
+// a abertura do seu sinal, a célula à frente vagar ou o aviso da dinâmica de que chegou ao fim da via
+typedef struct {
+	Retomavel retomavel; // Primeiro campo: o retomável é o próprio registro
+	Veiculo veiculo;
+	idVia proximaVia;
+	ResultadoTravessia travessia;
+	ResultadoAvanco avanco;
+	int retirar;
+	Celula anterior;
+	PedidoDinamica pedido;
+	RegistroDistrito transferencia;
+} VeiculoRetomavel;
+
+int usaRetomada = 0;
+
+// As esperas por sinal e por célula testam e pausam no mesmo passo, o que é atômico porque os retomáveis
+// rodam com o escalonador suspenso
+void passoVeiculoRetomavel(Retomavel *retomavel) {
+	VeiculoRetomavel *estado = (VeiculoRetomavel*)retomavel;
+	Veiculo *veiculo = &estado->veiculo;
+
+	RT_INICIO(retomavel);
+	while (!ocupaCelulaInicial(veiculo)) {
+		Celula inicio = celulaInicial(veiculo);
+		RT_ESPERA_EM(retomavel, &esperaCelula[inicio.lin][inicio.col]);
+	}
+	if (veiculo->transferido) {
+		estado->pedido = entraNaVia(veiculo, veiculo->viaAtual);
+		while (xQueueSend(filaDinamica, &estado->pedido, 0) != pdPASS)
+			RT_ESPERA_TEMPO(retomavel, 1);
+		while (veiculo->aguardandoChegada)
+			RT_ESPERA_AVISO(retomavel);
+	}
+
+	while (1) {
+		RT_ESPERA_TEMPO(retomavel, ticksSimulacao(300));
+		// Um veículo flexível depende de mais de um sinal e não cabe numa só lista: ele consulta os sinais
+		// a cada ESPERA_CELULA_MS, como as corrotinas
+		while ((estado->travessia = pedeTravessia(veiculo, &estado->proximaVia, 0)) == SINAL_FECHADO) {
+			if (listaSinaisVeiculo(veiculo) != NULL)
+				RT_ESPERA_EM(retomavel, listaSinaisVeiculo(veiculo));
+			else
+				RT_ESPERA_TEMPO(retomavel, ticksSimulacao(ESPERA_CELULA_MS));
+		}
+		estado->retirar = 0;
+		if (estado->travessia == SEM_VAGA) {
+			marcaEsperaVaga(veiculo, estado->proximaVia);
+			estado->retirar = remocaoPedida(veiculo);
+		}
+		if (estado->travessia != TRAVESSIA_LIBERADA && !estado->retirar) {
+			RT_ESPERA_TEMPO(retomavel, ticksSimulacao(INTERVALO_RESERVA_MS));
+			continue;
+		}
+
+		desmarcaEsperaVaga(veiculo);
+		if (veiculo->naVia) {
+			estado->pedido = (PedidoDinamica){ SAI_VIA, veiculo->viaAtual, veiculo };
+			while (xQueueSend(filaDinamica, &estado->pedido, 0) != pdPASS)
+				RT_ESPERA_TEMPO(retomavel, 1);
+			liberaVia(veiculo);
+		}
+		if (estado->retirar) {
+			telemetriaVeiculo(TELEMETRIA_SAIDA, veiculo, veiculo->viaAtual);
+			saiFila(veiculo, 0);
+			limpaTrafego(veiculo->posicao.lin, veiculo->posicao.col);
+			break;
+		}
+
+		veiculo->segmento = &travessias[veiculo->cruzamentoAtual][veiculo->semaforoAtual][veiculo->direcao];
+		veiculo->indiceCelula = 0;
+		estado->anterior = veiculo->posicao;
+		while ((estado->avanco = avancaVeiculo(veiculo)) != FIM_SEGMENTO) {
+			if (estado->avanco == BLOQUEADO) {
+				Celula proxima = veiculo->segmento->celulas[veiculo->indiceCelula];
+				RT_ESPERA_EM(retomavel, &esperaCelula[proxima.lin][proxima.col]);
 			}
-			else if (veiculo->direcao == ESQUERDA) {
-				if (xSemaphoreTake(semaforoEsquerda[2], portMAX_DELAY)) {
-					modificaTrafego(15, 31, 15, 39);
-					vTaskDelay(100);
-					animacaoSairS(18, 31, 15, 31, 1);
-					vTaskDelete(NULL);
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
+			else {
+				RT_ESPERA_TEMPO(retomavel, ticksSimulacao(tempoPercurso(distanciaCelulas(estado->anterior, veiculo->posicao), veiculo->segmento->perfil)));
+				estado->anterior = veiculo->posicao;
 			}
 		}
-		else if (veiculo->cruzamentoAtual == D && veiculo->semaforoAtual == W) { // Cruzamento D e semforo Oeste
-			modificaTrafego(17, 28, 0, 0);
-			vTaskDelay(300);
-			if (veiculo->direcao == FRENTE) {
-				if (xSemaphoreTake(semaforoFrenteDireita[1], portMAX_DELAY)) {
-					modificaTrafego(17, 33, 17, 28);
-					vTaskDelay(100);
-					animacaoSairE(17, 37, 17, 33, 1);
-					vTaskDelete(NULL);
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
-			}
-			else if (veiculo->direcao == DIREITA) {
-				if (xSemaphoreTake(semaforoFrenteDireita[1], portMAX_DELAY)) {
-					modificaTrafego(17, 31, 17, 28);
-					vTaskDelay(100);
-					animacaoSairS(18, 31, 17, 31, 1);
-					vTaskDelete(NULL);
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
+
+		sorteiaDirecao(veiculo);
+		if (distritoVia(estado->proximaVia) != distritoLocal) {
+			estado->transferencia = (RegistroDistrito){ REGISTRO_VEICULO, (uint8_t)estado->proximaVia, direcaoRegistro(veiculo), veiculo->idVeiculo };
+			while (xQueueSend(filaTransferencia[distritoVia(estado->proximaVia)], &estado->transferencia, 0) != pdPASS)
+				RT_ESPERA_TEMPO(retomavel, 1);
+			limpaTrafego(veiculo->posicao.lin, veiculo->posicao.col);
+			break;
+		}
+		estado->pedido = entraNaVia(veiculo, estado->proximaVia);
+		while (xQueueSend(filaDinamica, &estado->pedido, 0) != pdPASS)
+			RT_ESPERA_TEMPO(retomavel, 1);
+		while (veiculo->aguardandoChegada)
+			RT_ESPERA_AVISO(retomavel);
+		if (vias[estado->proximaVia].saida)
+			break; // O veículo foi embora
+		veiculo->cruzamentoAtual = vias[estado->proximaVia].cruzamentoDestino;
+		veiculo->semaforoAtual = vias[estado->proximaVia].semaforoDestino;
+		veiculo->segmento = NULL;
+		RT_ESPERA_TEMPO(retomavel, ticksSimulacao(100));
+	}
+	RT_FIM(retomavel);
+	vPortFree(estado);
+}
+
+// Heap que os veículos não usam, para que as filas, temporizadores e tarefas do kernel sempre achem memória.
+// Um veículo em tarefa própria custa o registro, o TCB e a pilha
+#define RESERVA_HEAP (4 * 1024)
+
+volatile LONG chegadasPerdidas; // Veículos que não puderam ser criados (sem memória ou corrotina livre)
+volatile LONG falhasMemoria;    // Chamadas a pvPortMalloc que falharam com o escalonador rodando
+
+static void *alocaVeiculo(size_t tamanho) {
+	if (xPortGetFreeHeapSize() < RESERVA_HEAP)
+		return NULL;
+	return pvPortMalloc(tamanho);
+}
+
+// Põe em execução um veículo com uma cópia dos dados: em uma corrotina livre no modo --corrotinas, como
+// retomável no modo --retomada ou em uma tarefa própria. Retorna 0 se não há memória ou corrotina livre
+static int criaVeiculo(const Veiculo *dados) {
+	if (usaRetomada) {
+		VeiculoRetomavel *estado = alocaVeiculo(sizeof(VeiculoRetomavel));
+		if (estado == NULL)
+			return 0;
+		memset(estado, 0, sizeof(*estado));
+		estado->veiculo = *dados;
+		estado->veiculo.retomavel = &estado->retomavel;
+		vTaskSuspendAll();
+		iniciaRetomavel(&estado->retomavel, passoVeiculoRetomavel);
+		xTaskResumeAll();
+		return 1;
+	}
+	if (nCorrotinas > 0) {
+		for (int i = 0; i < nCorrotinas; i++) {
+			VeiculoCorrotina *estado = &veiculosCorrotina[i];
+			if (!estado->ativo) {
+				estado->veiculo = *dados;
+				estado->veiculo.corrotina = 1;
+				estado->veiculo.alocado = 0;
+				estado->ativo = 1; // Por último: a corrotina só olha o veículo depois disso
+				return 1;
 			}
-			else if (veiculo->direcao == ESQUERDA) {
-				if (xSemaphoreTake(semaforoEsquerda[1], portMAX_DELAY)) {
-					modificaTrafego(17, 35, 17, 28);
-					vTaskDelay(200);
-					animacaoViaNS(14, 35, 17, 35, -1);
-					vTaskDelay(100);
-					veiculo->cruzamentoAtual = B;
-					veiculo->semaforoAtual = S;
-					modificaTrafego(10, 35, 0, 0);
-					veiculo->direcao = rand() % 3; // Prxima direo do veculo
-				}
-				vTaskDelay(100); // Espera antes de tentar novamente
+		}
+		return 0;
+	}
+	Veiculo *veiculo = alocaVeiculo(sizeof(Veiculo));
+	if (veiculo == NULL)
+		return 0;
+	*veiculo = *dados;
+	veiculo->alocado = 1;
+	// Um nome por veículo, para distinguir as tarefas no rastro: o distrito em que o veículo foi criado e o
+	// número dele ali, "V<k>-<n>". Cabe inteiro em configMAX_TASK_NAME_LEN, então ids diferentes dão nomes diferentes
+	char nome[configMAX_TASK_NAME_LEN];
+	int tamanhoNome = snprintf(nome, sizeof(nome), "V%d-%d", veiculo->idVeiculo / IDS_POR_DISTRITO,
+		veiculo->idVeiculo % IDS_POR_DISTRITO);
+	configASSERT(tamanhoNome > 0 && tamanhoNome < (int)sizeof(nome));
+	if (xTaskCreate(TaskVeiculo, (signed char*)nome, configMINIMAL_STACK_SIZE, veiculo, 1, NULL) != pdPASS) {
+		vPortFree(veiculo);
+		return 0;
+	}
+	return 1;
+}
+
+// Como criaVeiculo, contando as chegadas perdidas
+int iniciaVeiculo(const Veiculo *dados) {
+	int iniciado = criaVeiculo(dados);
+	if (!iniciado)
+		InterlockedIncrement(&chegadasPerdidas);
+	return iniciado;
+}
+
+// Demanda de veículos que entram pela borda da malha (veículos por minuto, 0 = só os veículos iniciais)
+double demandaPorMinuto = 0;
+
+// Cria veículos nas aproximações de entrada, as que não recebem nenhuma via interna, com chegadas de Poisson
+// (intervalos exponenciais). O veículo criado espera a célula da linha de parada vagar para entrar
+void TaskDemanda(void *param) {
+	struct { idCruzamento cruzamento; idSemaforo semaforo; } entradas[16];
+	int nEntradas = 0;
+	int proximoId = 100 + distritoLocal * IDS_POR_DISTRITO; // Os ids seguem o veículo entre distritos
+
+	for (int c = 0; c < 4; c++) {
+		for (int s = 0; s < 4 && cruzamentoLocal(c); s++) {
+			int interna = 0;
+			for (int v = 0; v < N_VIAS; v++)
+				interna |= !vias[v].saida && vias[v].cruzamentoDestino == c && vias[v].semaforoDestino == s;
+			if (!interna) {
+				entradas[nEntradas].cruzamento = c;
+				entradas[nEntradas].semaforo = s;
+				nEntradas++;
 			}
 		}
 	}
+
+	if (nEntradas == 0)
+		vTaskDelete(NULL);
+
+	while (1) {
+		double sorteio = (rand() + 1.0) / (RAND_MAX + 2.0);
+		esperaSimulacao(-log(sorteio) * 60000.0 / demandaPorMinuto);
+		Veiculo veiculo;
+		int e = rand() % nEntradas;
+		memset(&veiculo, 0, sizeof(veiculo));
+		configASSERT(proximoId < (distritoLocal + 1) * IDS_POR_DISTRITO); // Sem invadir os ids do próximo distrito
+		veiculo.idVeiculo = proximoId++;
+		veiculo.cruzamentoAtual = entradas[e].cruzamento;
+		veiculo.semaforoAtual = entradas[e].semaforo;
+		sorteiaDirecao(&veiculo);
+		iniciaVeiculo(&veiculo); // Sem memória ou corrotina livre, a chegada é perdida
+	}
+}
+
+// Despejo periódico das métricas (--metricas=<arquivo>), pelo temporizador
+#define PERIODO_METRICAS_MS 10000
+FILE *arquivoMetricas;
+
+void despejaMetricas(TimerHandle_t temporizador) {
+	escreveMetricas(arquivoMetricas, segundosSimulados(xTaskGetTickCount()), ticksPorSegundoSimulado());
+	fflush(arquivoMetricas);
+}
+
+// Resumos dos tempos de viagem (--quantis=<arquivo>): o arquivo é regravado inteiro a cada PERIODO_METRICAS_MS,
+// então a qualquer momento ele tem os resumos da execução até ali
+const char *arquivoQuantis;
+
+int gravaArquivoQuantis(const char *caminho) {
+	FILE *arquivo;
+	if (fopen_s(&arquivo, caminho, "wb") != 0)
+		return 0;
+	int ok = gravaResumos(arquivo, resumosViagem, N_RESUMOS_VIAGEM);
+	return fclose(arquivo) == 0 && ok;
+}
+
+void despejaQuantis(TimerHandle_t temporizador) {
+	gravaArquivoQuantis(arquivoQuantis);
+}
+
+// Mapa de calor da ocupação das células (--mapa-calor=<arquivo>), regravado a cada PERIODO_METRICAS_MS
+const char *arquivoMapaCalor;
+
+void despejaMapaCalor(TimerHandle_t temporizador) {
+	gravaMapaCalor(arquivoMapaCalor, xTaskGetTickCount());
+}
+
+void imprimeLinhaQuantis(const char *nome, ResumoQuantis *resumo) {
+	printf("%s %.0f %.1f %.1f %.1f %.1f\n", nome, resumo->total, quantilResumo(resumo, 0.5), quantilResumo(resumo, 0.9),
+		quantilResumo(resumo, 0.99), resumo->maximo);
+}
+
+// Tabela dos tempos de viagem: pares origem-destino com alguma viagem e depois as vias
+void imprimeQuantis(void) {
+	char nome[32];
+	printf("origem destino viagens p50_s p90_s p99_s max_s\n");
+	for (int o = 0; o < N_ORIGENS; o++) {
+		for (int d = 0; d < N_DESTINOS; d++) {
+			if (resumoOrigemDestino(o, d)->total == 0)
+				continue;
+			snprintf(nome, sizeof(nome), "%c-%c %s", 'A' + o / 4, "NSEW"[o % 4], nomeVia[SAIDA_AN + d]);
+			imprimeLinhaQuantis(nome, resumoOrigemDestino(o, d));
+		}
+	}
+	printf("via percursos p50_s p90_s p99_s max_s\n");
+	for (int v = 0; v < N_VIAS; v++)
+		if (resumoVia(v)->total > 0)
+			imprimeLinhaQuantis(nomeVia[v], resumoVia(v));
 }
 
-int main( void )
+// Junta os arquivos de resumos de várias execuções (--junta-quantis=<a,b,...>), imprime os quantis e, com
+// --quantis, grava o resultado, sem iniciar a simulação
+int juntaQuantis(char *lista) {
+	char *contexto = NULL;
+	int arquivos = 0;
+	for (char *caminho = strtok_s(lista, ",", &contexto); caminho != NULL; caminho = strtok_s(NULL, ",", &contexto)) {
+		FILE *arquivo;
+		if (fopen_s(&arquivo, caminho, "rb") != 0 || !juntaArquivoResumos(arquivo, resumosViagem, N_RESUMOS_VIAGEM)) {
+			printf("Arquivo de quantis inválido: %s\n", caminho);
+			return 1;
+		}
+		fclose(arquivo);
+		arquivos++;
+	}
+	fprintf(stderr, "%d arquivos juntados\n", arquivos);
+	imprimeQuantis();
+	if (arquivoQuantis != NULL && !gravaArquivoQuantis(arquivoQuantis)) {
+		printf("Não foi possível gravar %s\n", arquivoQuantis);
+		return 1;
+	}
+	return 0;
+}
+
+// Fim da execução (--duracao=<s>): grava as métricas finais, com os percentis, e os tempos de viagem na tela
+// e nos arquivos de métricas, de quantis e do mapa de calor, espera a telemetria e o gravador de rastro
+// esvaziarem os buffers e encerra o processo. Roda na tarefa dos temporizadores, que fica bloqueada nessas
+// esperas; os outros temporizadores atrasam, mas o processo termina logo depois
+void encerraSimulacao(TimerHandle_t temporizador) {
+	double instante = segundosSimulados(xTaskGetTickCount());
+	printf("\033[2J\033[H");
+	escreveMetricas(stdout, instante, ticksPorSegundoSimulado());
+	imprimeQuantis();
+	printf("Chegadas perdidas: %ld (falhas de memoria: %ld, heap livre: %u bytes)\n", chegadasPerdidas, falhasMemoria,
+		(unsigned)xPortGetFreeHeapSize());
+	fflush(stdout);
+	if (arquivoQuantis != NULL)
+		gravaArquivoQuantis(arquivoQuantis);
+	if (arquivoMapaCalor != NULL)
+		gravaMapaCalor(arquivoMapaCalor, xTaskGetTickCount());
+	if (arquivoMetricas != NULL) {
+		escreveMetricas(arquivoMetricas, instante, ticksPorSegundoSimulado());
+		fclose(arquivoMetricas);
+	}
+	encerraTelemetria();
+	if (xTraceRunning == pdTRUE) {
+		#if ( TRC_CFG_RECORDER_MODE == TRC_RECORDER_MODE_STREAMING )
+			// Duas voltas da TzCtrl para ela gravar no arquivo as páginas já completas do buffer do gravador
+			vTaskDelay(2 * TRC_CFG_CTRL_TASK_DELAY + 1);
+		#endif
+		vTraceStop();
+		prvSaveTraceFile();
+		xTraceRunning = pdFALSE;
+	}
+	exit(0);
+}
+
+// Consulta a um arquivo de trajetórias (--consulta): filtros por veículo, cruzamento, evento e intervalo em
+// segundos simulados; imprime as linhas encontradas em CSV e o tempo gasto, sem iniciar a simulação. Num
+// arquivo gravado com --escala=inf não há tempo simulado: o instante sai em ticks e não se filtra por ele
+const char *nomeEvento[] = { "chegada", "verde", "entrada", "saida" };
+
+typedef struct {
+	const char *arquivo;
+	int32_t veiculo;
+	int cruzamento;
+	int evento;
+	double de;  // s
+	double ate; // s
+} ConsultaTrajetorias;
+
+void imprimeLinhaTrajetoria(const RegistroTelemetria *linha, void *contexto) {
+	const ArquivoColunas *colunas = contexto;
+	double instante = colunas->ticksPorSegundo > 0 ? linha->instante / colunas->ticksPorSegundo : linha->instante;
+	printf("%.3f,%d,%c,%c,%d,%s,%s\n", instante, linha->veiculo,
+		'A' + linha->cruzamento, "NSEW"[linha->semaforo & 3], linha->direcao,
+		linha->tipo < 4 ? nomeEvento[linha->tipo] : "?", linha->via < N_VIAS ? nomeVia[linha->via] : "-");
+}
+
+int executaConsulta(const ConsultaTrajetorias *consulta) {
+	ArquivoColunas colunas;
+	clock_t inicio = clock();
+	if (!abreConsultaColunas(&colunas, consulta->arquivo)) {
+		printf("Arquivo de trajetórias inválido: %s\n", consulta->arquivo);
+		return 1;
+	}
+	if ((consulta->de > 0 || consulta->ate >= 0) && !(colunas.ticksPorSegundo > 0)) {
+		printf("%s foi gravado com --escala=inf, sem tempo simulado: --de e --ate não valem\n", consulta->arquivo);
+		fechaConsultaColunas(&colunas);
+		return 1;
+	}
+	FiltroTrajetoria filtro = { consulta->veiculo, consulta->cruzamento, consulta->evento, 0, UINT32_MAX };
+	if (consulta->de > 0)
+		filtro.instanteInicial = (uint32_t)(consulta->de * colunas.ticksPorSegundo);
+	if (consulta->ate >= 0)
+		filtro.instanteFinal = (uint32_t)(consulta->ate * colunas.ticksPorSegundo);
+	printf("instante,veiculo,cruzamento,aproximacao,movimento,evento,via\n");
+	long linhas = consultaColunas(&colunas, &filtro, imprimeLinhaTrajetoria, &colunas);
+	fprintf(stderr, "%ld linhas de %d blocos em %.1f ms\n", linhas, colunas.nBlocos, 1000.0 * (clock() - inicio) / CLOCKS_PER_SEC);
+	fechaConsultaColunas(&colunas);
+	return linhas < 0;
+}
+
+int main( int argc, char *argv[] )
 {
+	int semTela = 0;
+	const char *arquivoTelemetria = NULL;
+	const char *arquivoTrajetorias = NULL;
+	double duracao = 0; // s simulados; 0 = sem fim
+	char *juntar = NULL;
+	const char *arquivoRastro = NULL;
+	ConsultaTrajetorias consulta = { NULL, -1, -1, -1, 0, -1 };
+
 	setlocale(LC_ALL, "Portuguese");
+
+	// --escala=<fator> ajusta a velocidade da simulação (0.01 para inspeção, "inf" para rodar sem esperas)
+	// --sem-tela desliga o desenho do tráfego, para execuções em lote
+	// --faixas=<n> e --bolsao=<metros> definem as faixas corridas e o bolsão de conversão das vias internas
+	// --demanda=<veículos por minuto> cria veículos continuamente nas entradas da malha
+	// --impasse=remover retira um veículo de cada impasse detectado (o padrão só informa)
+	// --fragmentos=<n> avança a dinâmica das vias em n threads nativas, que roubam vias umas das outras
+	// --distrito=<k>/<n> simula só o distrito k de n (1, 2 ou 4), trocando veículos com os processos vizinhos;
+	// --hosts=<h0,h1,...> e --porta=<base> dizem onde eles estão (padrão: esta máquina, portas 27015 + k)
+	// --corrotinas=<n> executa os veículos em n corrotinas em vez de uma tarefa por veículo; não vale com --escala=inf
+	// --retomada executa cada veículo como função retomável, acordada só pelos eventos que ela espera
+	// --flexiveis=<percentual> dá a essa parte dos veículos a escolha entre seguir em frente e converter à esquerda
+	// --telemetria=<arquivo> grava em binário as transições dos veículos (ver telemetria.h)
+	// --trajetorias=<arquivo> grava as mesmas transições em formato colunar (ver colunas.h)
+	// --metricas=<arquivo> grava a cada 10 s simulados as filas, atendimentos, esperas e verdes por aproximação,
+	// com os tempos em segundos simulados; não vale com --escala=inf
+	// --duracao=<s> encerra a simulação depois desse tempo simulado, mostrando as métricas finais
+	// --quantis=<arquivo> grava os resumos dos tempos de viagem por origem-destino e por via (ver quantis.h);
+	// não vale com --escala=inf
+	// --junta-quantis=<a,b,...> só junta arquivos de quantis de outras execuções e mostra o resultado
+	// --rastro=<base> grava o rastro do FreeRTOS+Trace continuamente em <base>.000.psf, <base>.001.psf, ...
+	// --mapa-calor=<arquivo> grava a cada 10 s simulados a fração do tempo em que cada célula ficou ocupada (PGM)
+	// --consulta=<arquivo> só consulta um arquivo de trajetórias, filtrando por --veiculo=<id>, --cruzamento=<A-D>,
+	// --evento=<chegada|verde|entrada|saida>, --de=<s> e --ate=<s> (segundos simulados)
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--escala=", 9) == 0)
+			defineEscalaTempo(strtod(argv[i] + 9, NULL));
+		else if (strncmp(argv[i], "--faixas=", 9) == 0)
+			faixasVia = atoi(argv[i] + 9);
+		else if (strncmp(argv[i], "--bolsao=", 9) == 0)
+			comprimentoBolsao = strtod(argv[i] + 9, NULL);
+		else if (strncmp(argv[i], "--demanda=", 10) == 0)
+			demandaPorMinuto = strtod(argv[i] + 10, NULL);
+		else if (strcmp(argv[i], "--impasse=remover") == 0)
+			politicaImpasse = IMPASSE_REMOVE;
+		else if (strncmp(argv[i], "--fragmentos=", 13) == 0)
+			threadsFragmentos = atoi(argv[i] + 13);
+		else if (strncmp(argv[i], "--distrito=", 11) == 0)
+			sscanf(argv[i] + 11, "%d/%d", &distritoLocal, &nDistritos);
+		else if (strcmp(argv[i], "--retomada") == 0)
+			usaRetomada = 1;
+		else if (strncmp(argv[i], "--flexiveis=", 12) == 0)
+			percentualFlexiveis = atoi(argv[i] + 12);
+		else if (strncmp(argv[i], "--telemetria=", 13) == 0)
+			arquivoTelemetria = argv[i] + 13;
+		else if (strncmp(argv[i], "--trajetorias=", 14) == 0)
+			arquivoTrajetorias = argv[i] + 14;
+		else if (strncmp(argv[i], "--metricas=", 11) == 0) {
+			if (fopen_s(&arquivoMetricas, argv[i] + 11, "w") != 0)
+				arquivoMetricas = NULL;
+		}
+		else if (strncmp(argv[i], "--duracao=", 10) == 0)
+			duracao = strtod(argv[i] + 10, NULL);
+		else if (strncmp(argv[i], "--quantis=", 10) == 0)
+			arquivoQuantis = argv[i] + 10;
+		else if (strncmp(argv[i], "--junta-quantis=", 16) == 0)
+			juntar = argv[i] + 16;
+		else if (strncmp(argv[i], "--rastro=", 9) == 0)
+			arquivoRastro = argv[i] + 9;
+		else if (strncmp(argv[i], "--mapa-calor=", 13) == 0)
+			arquivoMapaCalor = argv[i] + 13;
+		else if (strncmp(argv[i], "--consulta=", 11) == 0)
+			consulta.arquivo = argv[i] + 11;
+		else if (strncmp(argv[i], "--veiculo=", 10) == 0)
+			consulta.veiculo = atoi(argv[i] + 10);
+		else if (strncmp(argv[i], "--cruzamento=", 13) == 0)
+			consulta.cruzamento = argv[i][13] - 'A';
+		else if (strncmp(argv[i], "--evento=", 9) == 0) {
+			for (int t = 0; t < 4; t++)
+				if (strcmp(argv[i] + 9, nomeEvento[t]) == 0)
+					consulta.evento = t;
+		}
+		else if (strncmp(argv[i], "--de=", 5) == 0)
+			consulta.de = strtod(argv[i] + 5, NULL);
+		else if (strncmp(argv[i], "--ate=", 6) == 0)
+			consulta.ate = strtod(argv[i] + 6, NULL);
+		else if (strncmp(argv[i], "--corrotinas=", 13) == 0)
+			nCorrotinas = atoi(argv[i] + 13);
+		else if (strncmp(argv[i], "--hosts=", 8) == 0)
+			hostsDistritos = argv[i] + 8;
+		else if (strncmp(argv[i], "--porta=", 8) == 0)
+			portaDistritos = atoi(argv[i] + 8);
+		else if (strcmp(argv[i], "--sem-tela") == 0)
+			semTela = 1;
+	}
+	if (consulta.cruzamento < -1 || consulta.cruzamento > D)
+		consulta.cruzamento = -1;
+	if (consulta.arquivo != NULL)
+		return executaConsulta(&consulta);
+	for (int r = 0; r < N_RESUMOS_VIAGEM; r++)
+		iniciaResumo(&resumosViagem[r]);
+	if (juntar != NULL)
+		return juntaQuantis(juntar);
+	// Os tempos das métricas e dos quantis são simulados; com escala infinita as esperas duram zero ticks e não
+	// há como medi-los (segundosSimulados daria inf ou NaN, que os resumos descartam)
+	if ((arquivoMetricas != NULL || arquivoQuantis != NULL) && !isfinite(escalaTempo)) {
+		printf("--metricas e --quantis precisam de uma --escala finita\n");
+		return 1;
+	}
+	// As corrotinas só rodam no gancho da tarefa ociosa; com escala infinita a TaskDinamica nunca bloqueia
+	// (vTaskDelay(0)), a tarefa ociosa não roda e os veículos não andariam
+	if (nCorrotinas > 0 && !isfinite(escalaTempo)) {
+		printf("--corrotinas precisa de uma --escala finita\n");
+		return 1;
+	}
+	if (nDistritos != 2 && nDistritos != 4)
+		nDistritos = 1;
+	if (distritoLocal < 0 || distritoLocal >= nDistritos)
+		distritoLocal = 0;
+	if (faixasVia < 1)
+		faixasVia = 1;
+	if (faixasVia > MAX_FAIXAS - 1) // Reserva uma faixa para o bolsão
+		faixasVia = MAX_FAIXAS - 1;
+	if (!(comprimentoBolsao > 0))
+		comprimentoBolsao = 0;
+	srand(time(NULL));
+
 	/* This demo uses heap_5.c, so start by defining some heap regions.  heap_5
 	is only used for test and example reasons.  Heap_4 is more appropriate.  See
 	http://www.freertos.org/a00111.html for an explanation. */
 	prvInitialiseHeap();
 
 	/* Initialise the trace recorder.  Use of the trace recorder is optional.
-	See http://www.FreeRTOS.org/trace for more information. */
-	vTraceEnable( TRC_START );
+	See http://www.FreeRTOS.org/trace for more information.  No modo streaming
+	(RASTRO_STREAMING, ver trcConfig.h) o rastro só é gravado com --rastro; no
+	modo snapshot, o padrão, ele vai para Trace.dump num assert ou no fim de
+	--duracao. */
+	#if ( TRC_CFG_RECORDER_MODE == TRC_RECORDER_MODE_STREAMING )
+	{
+		if( arquivoRastro != NULL )
+		{
+			defineArquivoRastro( arquivoRastro );
+			vTraceEnable( TRC_START );
+		}
+		else
+		{
+			vTraceEnable( TRC_INIT );
+		}
+	}
+	#else
+	{
+		if( arquivoRastro != NULL )
+		{
+			printf( "--rastro precisa do gravador em streaming (RASTRO_STREAMING, ver trcConfig.h)\n" );
+		}
+		vTraceEnable( TRC_START );
+	}
+	#endif
+	registraCanaisRastro();
 
 	inicializaTrafego();
+	inicializaSegmentos();
+	inicializaReservas();
+	inicializaDistritos();
+	inicializaDinamicaVias();
 
 	Veiculo veiculo1 = {.idVeiculo = 1, .cruzamentoAtual = A, .semaforoAtual = N, .direcao = FRENTE };
 	Veiculo veiculo2 = { .idVeiculo = 2, .cruzamentoAtual = D, .semaforoAtual = E, .direcao = DIREITA };
 	Veiculo veiculo3 = { .idVeiculo = 3, .cruzamentoAtual = B, .semaforoAtual = E, .direcao = ESQUERDA };
 	Veiculo veiculo4 = { .idVeiculo = 4, .cruzamentoAtual = C, .semaforoAtual = S, .direcao = DIREITA };
 
+	if ((arquivoTelemetria != NULL || arquivoTrajetorias != NULL) && !iniciaTelemetria(arquivoTelemetria, arquivoTrajetorias, ticksPorSegundoSimulado()))
+		printf("Não foi possível criar os arquivos de telemetria\n");
+
+	sinaisAbertos = xEventGroupCreate(); // Antes das tarefas, que podem consultar os sinais logo ao começar
+	vTraceSetEventGroupName(sinaisAbertos, "Sinais");
 	xTaskCreate(TaskCruzamento, (signed char*)"Cruzamento", configMINIMAL_STACK_SIZE, (void*)NULL, 1, NULL);
+	xTaskCreate(TaskDinamica, (signed char*)"Dinamica", configMINIMAL_STACK_SIZE, (void*)NULL, 1, NULL);
 
-	xTaskCreate(TaskVeiculo, (signed char*)"Veiculo", configMINIMAL_STACK_SIZE, &veiculo1, 1, NULL);
-	xTaskCreate(TaskVeiculo, (signed char*)"Veiculo", configMINIMAL_STACK_SIZE, &veiculo2, 1, NULL);
-	xTaskCreate(TaskVeiculo, (signed char*)"Veiculo", configMINIMAL_STACK_SIZE, &veiculo3, 1, NULL);
-	xTaskCreate(TaskVeiculo, (signed char*)"Veiculo", configMINIMAL_STACK_SIZE, &veiculo4, 1, NULL);
+	if (usaRetomada)
+		xTaskCreate(TaskRetomada, (signed char*)"Retomada", configMINIMAL_STACK_SIZE, (void*)NULL, 1, NULL);
+	else if (nCorrotinas > 0)
+		nCorrotinas = inicializaCorrotinas(nCorrotinas);
+	Veiculo *iniciais[] = { &veiculo1, &veiculo2, &veiculo3, &veiculo4 };
+	for (int i = 0; i < 4; i++) {
+		if (cruzamentoLocal(iniciais[i]->cruzamentoAtual))
+			iniciaVeiculo(iniciais[i]);
+	}
+	if (demandaPorMinuto > 0)
+		xTaskCreate(TaskDemanda, (signed char*)"Demanda", configMINIMAL_STACK_SIZE, (void*)NULL, 1, NULL);
+
+	TickType_t periodoImpasse = ticksSimulacao(PERIODO_IMPASSE_MS);
+	TimerHandle_t monitorImpasse = xTimerCreate("Impasse", periodoImpasse > 0 ? periodoImpasse : 1, pdTRUE, NULL, verificaImpasse);
+	xTimerStart(monitorImpasse, 0);
+	if (arquivoMetricas != NULL) {
+		TickType_t periodoMetricas = ticksSimulacao(PERIODO_METRICAS_MS);
+		TimerHandle_t despejo = xTimerCreate("Metricas", periodoMetricas > 0 ? periodoMetricas : 1, pdTRUE, NULL, despejaMetricas);
+		xTimerStart(despejo, 0);
+	}
+	if (arquivoQuantis != NULL) {
+		TickType_t periodoQuantis = ticksSimulacao(PERIODO_METRICAS_MS);
+		TimerHandle_t despejo = xTimerCreate("Quantis", periodoQuantis > 0 ? periodoQuantis : 1, pdTRUE, NULL, despejaQuantis);
+		xTimerStart(despejo, 0);
+	}
+	if (arquivoMapaCalor != NULL) {
+		TickType_t periodoMapa = ticksSimulacao(PERIODO_METRICAS_MS);
+		TimerHandle_t despejo = xTimerCreate("MapaCalor", periodoMapa > 0 ? periodoMapa : 1, pdTRUE, NULL, despejaMapaCalor);
+		xTimerStart(despejo, 0);
+	}
+	if (duracao > 0) {
+		TickType_t periodoFim = ticksSimulacao(duracao * 1000.0);
+		TimerHandle_t fim = xTimerCreate("Fim", periodoFim > 0 ? periodoFim : 1, pdFALSE, NULL, encerraSimulacao);
+		xTimerStart(fim, 0);
+	}
 
-	xTaskCreate(printaTrafego, (signed char*)"PrintarTrafego", configMINIMAL_STACK_SIZE, (void*)NULL, 1, NULL);
+	if (!semTela)
+		xTaskCreate(printaTrafego, (signed char*)"PrintarTrafego", configMINIMAL_STACK_SIZE, (void*)NULL, 1, NULL);
 	
 	vTaskStartScheduler(); 
 	for (;;);
@@ -975,6 +2238,14 @@ void vApplicationMallocFailedHook( void )
 	(although it does not provide information on how the remaining heap might be
 	fragmented).  See http://www.freertos.org/a00111.html for more
 	information. */
+
+	/* Com o escalonador rodando, quem pediu memória trata o NULL: um veículo
+	que não pode ser criado é uma chegada perdida, não o fim da simulação. */
+	if( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED )
+	{
+		InterlockedIncrement( &falhasMemoria );
+		return;
+	}
 	vAssertCalled( __LINE__, __FILE__ );
 }
 /*-----------------------------------------------------------*/
@@ -1006,6 +2277,13 @@ void vApplicationIdleHook( void )
 		}
 	*/
 
+	/* Os veículos do modo --corrotinas rodam aqui, um passo de corrotina por
+	volta da tarefa ociosa. */
+	if( nCorrotinas > 0 )
+	{
+		vCoRoutineSchedule();
+	}
+
 	#if ( mainCREATE_SIMPLE_BLINKY_DEMO_ONLY != 1 )
 	{
 		/* Call the idle task processing used by the full demo.  The simple
@@ -1094,6 +2372,7 @@ volatile uint32_t ulSetToNonZeroInDebuggerToContinue = 0;
 }
 /*-----------------------------------------------------------*/
 
+#if ( TRC_CFG_RECORDER_MODE == TRC_RECORDER_MODE_SNAPSHOT )
 static void prvSaveTraceFile( void )
 {
 FILE* pxOutputFile;
@@ -1111,6 +2390,7 @@ FILE* pxOutputFile;
 		printf( "\r\nFailed to create trace dump file\r\n" );
 	}
 }
+#endif
 /*-----------------------------------------------------------*/
 
 static void  prvInitialiseHeap( void )
@@ -0,0 +1,57 @@
+/* Standard includes. */
+#include <stdint.h>
+#include <stdio.h>
+#include <windows.h>
+
+#include "mapacalor.h"
+
+static volatile LONG64 acumulado[LINHAS_MALHA][COLUNAS_MALHA];
+static volatile uint32_t ocupadaDesde[LINHAS_MALHA][COLUNAS_MALHA];
+static uint32_t inicio;
+
+void inicializaMapaCalor(uint32_t instante) {
+	for (int i = 0; i < LINHAS_MALHA; i++) {
+		for (int j = 0; j < COLUNAS_MALHA; j++) {
+			acumulado[i][j] = 0;
+			ocupadaDesde[i][j] = instante;
+		}
+	}
+	inicio = instante;
+}
+
+void mapaCalorOcupa(int lin, int col, uint32_t instante) {
+	ocupadaDesde[lin][col] = instante;
+}
+
+// A soma é atômica para que a leitura pelo exportador nunca veja metade de um valor de 64 bits
+void mapaCalorLibera(int lin, int col, uint32_t instante) {
+	InterlockedExchangeAdd64(&acumulado[lin][col], (uint32_t)(instante - ocupadaDesde[lin][col]));
+}
+
+uint64_t ocupacaoCelula(int lin, int col, uint32_t instante) {
+	uint64_t total = InterlockedCompareExchange64(&acumulado[lin][col], 0, 0);
+	if (celulaOcupada(lin, col))
+		total += (uint32_t)(instante - ocupadaDesde[lin][col]);
+	return total;
+}
+
+int gravaMapaCalor(const char *caminho, uint32_t instante) {
+	static uint8_t imagem[LINHAS_MALHA * COLUNAS_MALHA * 2];
+	uint32_t decorrido = instante - inicio;
+	for (int i = 0; i < LINHAS_MALHA; i++) {
+		for (int j = 0; j < COLUNAS_MALHA; j++) {
+			uint64_t ocupado = ocupacaoCelula(i, j, instante);
+			uint32_t valor = decorrido > 0 ? (uint32_t)(ocupado * 65535 / decorrido) : 0;
+			if (valor > 65535) // Corrida com uma liberação durante a leitura
+				valor = 65535;
+			imagem[(i * COLUNAS_MALHA + j) * 2] = (uint8_t)(valor >> 8); // O PGM de 16 bits é big-endian
+			imagem[(i * COLUNAS_MALHA + j) * 2 + 1] = (uint8_t)valor;
+		}
+	}
+	FILE *arquivo;
+	if (fopen_s(&arquivo, caminho, "wb") != 0)
+		return 0;
+	fprintf(arquivo, "P5\n%d %d\n65535\n", COLUNAS_MALHA, LINHAS_MALHA);
+	int ok = fwrite(imagem, 1, sizeof(imagem), arquivo) == sizeof(imagem);
+	return fclose(arquivo) == 0 && ok;
+}
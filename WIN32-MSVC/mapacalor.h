@@ -0,0 +1,26 @@
+#ifndef MAPACALOR_H
+#define MAPACALOR_H
+
+#include <stdint.h>
+
+#include "ocupacao.h"
+
+// Mapa de calor da ocupação: quanto tempo cada célula da malha passou ocupada. A conta é feita nas próprias
+// transições, sem varredura periódica: ao ocupar, a célula guarda o instante; ao liberar, soma o intervalo ao
+// seu acumulado. Como só o dono de uma célula a ocupa e libera, cada célula tem um único escritor por vez.
+// Os instantes são ticks do chamador. Este módulo não usa a API do FreeRTOS.
+
+void inicializaMapaCalor(uint32_t instante);
+
+void mapaCalorOcupa(int lin, int col, uint32_t instante);
+void mapaCalorLibera(int lin, int col, uint32_t instante);
+
+// Ticks em que a célula esteve ocupada até o instante, contando a ocupação em curso
+uint64_t ocupacaoCelula(int lin, int col, uint32_t instante);
+
+// Grava o mapa como imagem PGM binária de 16 bits (P5), um pixel por célula, com a fração do tempo ocupada
+// desde o início em escala de 0 a 65535, para que imagens de execuções diferentes sejam comparáveis.
+// Retorna 0 se o arquivo não pôde ser gravado
+int gravaMapaCalor(const char *caminho, uint32_t instante);
+
+#endif /* MAPACALOR_H */
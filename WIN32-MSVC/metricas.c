@@ -0,0 +1,112 @@
+/* Standard includes. */
+#include <stdio.h>
+#include <windows.h>
+
+#include "metricas.h"
+
+typedef struct {
+	volatile LONG fila;
+	volatile LONG atendidos;
+	volatile LONG64 espera;
+} Contadores;
+
+// Uma fração ocupa um número inteiro de linhas de cache (16 * 16 bytes) e começa no início de uma, então
+// frações diferentes não dividem linhas entre si
+typedef __declspec(align(64)) struct {
+	Contadores aproximacoes[METRICAS_CRUZAMENTOS][METRICAS_APROXIMACOES];
+} Fracao;
+
+static Fracao fracoes[FRACOES_METRICAS];
+
+// O verde só é escrito pelo controlador, então não precisa de frações
+static volatile LONG64 verdeUsado[METRICAS_CRUZAMENTOS][METRICAS_APROXIMACOES];
+static volatile LONG64 verdeAberto[METRICAS_CRUZAMENTOS][METRICAS_APROXIMACOES];
+
+static Histograma esperas[METRICAS_CRUZAMENTOS][METRICAS_APROXIMACOES];
+static Histograma despertar;
+
+static Contadores *contadores(int cruzamento, int aproximacao, int fracao) {
+	return &fracoes[fracao & (FRACOES_METRICAS - 1)].aproximacoes[cruzamento][aproximacao];
+}
+
+// Leitura de 64 bits inteira também no Win32 de 32 bits
+static long long le64(volatile LONG64 *valor) {
+	return InterlockedCompareExchange64(valor, 0, 0);
+}
+
+void metricaChegada(int cruzamento, int aproximacao, int fracao) {
+	InterlockedIncrement(&contadores(cruzamento, aproximacao, fracao)->fila);
+}
+
+void metricaAtendido(int cruzamento, int aproximacao, int fracao, unsigned long espera) {
+	Contadores *c = contadores(cruzamento, aproximacao, fracao);
+	InterlockedDecrement(&c->fila);
+	InterlockedIncrement(&c->atendidos);
+	InterlockedExchangeAdd64(&c->espera, espera);
+	registraHistograma(&esperas[cruzamento][aproximacao], espera);
+}
+
+void metricaDesistencia(int cruzamento, int aproximacao, int fracao) {
+	InterlockedDecrement(&contadores(cruzamento, aproximacao, fracao)->fila);
+}
+
+void metricaVerde(int cruzamento, int aproximacao, unsigned long usado, unsigned long aberto) {
+	InterlockedExchangeAdd64(&verdeUsado[cruzamento][aproximacao], usado);
+	InterlockedExchangeAdd64(&verdeAberto[cruzamento][aproximacao], aberto);
+}
+
+unsigned long long relogioMetricas(void) {
+	static LARGE_INTEGER frequencia;
+	LARGE_INTEGER agora;
+	if (frequencia.QuadPart == 0)
+		QueryPerformanceFrequency(&frequencia);
+	QueryPerformanceCounter(&agora);
+	return (unsigned long long)(agora.QuadPart / frequencia.QuadPart * 1000000
+		+ agora.QuadPart % frequencia.QuadPart * 1000000 / frequencia.QuadPart);
+}
+
+void metricaDespertar(unsigned long long latencia) {
+	registraHistograma(&despertar, latencia);
+}
+
+Histograma *histogramaEspera(int cruzamento, int aproximacao) {
+	return &esperas[cruzamento][aproximacao];
+}
+
+Histograma *histogramaDespertar(void) {
+	return &despertar;
+}
+
+void leMetricas(int cruzamento, int aproximacao, MetricasAproximacao *metricas) {
+	metricas->fila = 0;
+	metricas->atendidos = 0;
+	metricas->espera = 0;
+	for (int f = 0; f < FRACOES_METRICAS; f++) {
+		Contadores *c = contadores(cruzamento, aproximacao, f);
+		metricas->fila += c->fila;
+		metricas->atendidos += c->atendidos;
+		metricas->espera += le64(&c->espera);
+	}
+	metricas->verdeUsado = le64(&verdeUsado[cruzamento][aproximacao]);
+	metricas->verdeAberto = le64(&verdeAberto[cruzamento][aproximacao]);
+}
+
+void escreveMetricas(FILE *saida, double instante, double ticksPorSegundo) {
+	fprintf(saida, "t = %.1f s\n", instante);
+	fprintf(saida, "cruzamento aproximacao fila atendidos espera_media_s espera_p50_s espera_p99_s espera_p999_s "
+		"verde_usado_s verde_aberto_s\n");
+	for (int c = 0; c < METRICAS_CRUZAMENTOS; c++) {
+		for (int a = 0; a < METRICAS_APROXIMACOES; a++) {
+			MetricasAproximacao m;
+			leMetricas(c, a, &m);
+			double esperaMedia = m.atendidos > 0 ? (double)m.espera / m.atendidos / ticksPorSegundo : 0.0;
+			Histograma *h = &esperas[c][a];
+			fprintf(saida, "%c %c %ld %ld %.2f %.2f %.2f %.2f %.1f %.1f\n", 'A' + c, "NSEW"[a], m.fila, m.atendidos,
+				esperaMedia, (double)percentilHistograma(h, 50.0) / ticksPorSegundo,
+				(double)percentilHistograma(h, 99.0) / ticksPorSegundo, (double)percentilHistograma(h, 99.9) / ticksPorSegundo,
+				(double)m.verdeUsado / ticksPorSegundo, (double)m.verdeAberto / ticksPorSegundo);
+		}
+	}
+	escreveHistograma(saida, "despertar", &despertar, 1.0, "us");
+	fprintf(saida, "\n");
+}
@@ -0,0 +1,53 @@
+#ifndef METRICAS_H
+#define METRICAS_H
+
+#include <stdio.h>
+
+#include "histograma.h"
+
+// Contadores por cruzamento e aproximação: fila na linha de parada, veículos atendidos, espera da chegada à
+// linha de parada até a liberação e tempo de verde usado. Cada contador é repartido em FRACOES_METRICAS
+// frações e cada veículo escreve sempre na mesma fração, escolhida pelo seu id, com uma operação atômica
+// simples, sem trava; as frações só são somadas na leitura. Uma leitura feita durante as escritas pode
+// misturar valores de instantes um pouco diferentes.
+// A distribuição das esperas de cada aproximação e a latência de despertar dos veículos ficam em histogramas
+// (ver histograma.h), dos quais saem os percentis.
+// Os tempos são em ticks, exceto a latência de despertar. Este módulo não usa a API do FreeRTOS.
+
+#define METRICAS_CRUZAMENTOS 4
+#define METRICAS_APROXIMACOES 4
+#define FRACOES_METRICAS 8 // Potência de 2
+
+typedef struct {
+	long fila;             // Veículos parados na linha de parada, à espera da liberação
+	long atendidos;        // Veículos liberados para atravessar
+	long long espera;      // Soma das esperas dos atendidos (ticks)
+	long long verdeUsado;  // Da abertura de cada fase até a última liberação da aproximação nela (ticks)
+	long long verdeAberto; // Tempo com algum sinal da aproximação aberto (ticks)
+} MetricasAproximacao;
+
+// Chamadas pelos veículos; fracao é qualquer inteiro estável por veículo
+void metricaChegada(int cruzamento, int aproximacao, int fracao);
+void metricaAtendido(int cruzamento, int aproximacao, int fracao, unsigned long espera);
+void metricaDesistencia(int cruzamento, int aproximacao, int fracao); // Deixou a fila sem ser atendido
+
+// Chamada pelo controlador ao fechar uma fase
+void metricaVerde(int cruzamento, int aproximacao, unsigned long usado, unsigned long aberto);
+
+// Relógio em microssegundos para a latência de despertar
+unsigned long long relogioMetricas(void);
+
+// Do sinal aberto pelo controlador até o veículo que o esperava voltar a executar (microssegundos)
+void metricaDespertar(unsigned long long latencia);
+
+void leMetricas(int cruzamento, int aproximacao, MetricasAproximacao *metricas);
+
+Histograma *histogramaEspera(int cruzamento, int aproximacao);
+Histograma *histogramaDespertar(void);
+
+// Tabela com uma linha por aproximação, com a espera média e os percentis 50, 99 e 99,9, precedida do
+// instante em segundos e seguida da latência de despertar. ticksPorSegundo converte os tempos em segundos
+// (os simulados, se o chamador descontar a escala de tempo)
+void escreveMetricas(FILE *saida, double instante, double ticksPorSegundo);
+
+#endif /* METRICAS_H */
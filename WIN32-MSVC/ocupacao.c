@@ -0,0 +1,68 @@
+/* Standard includes. */
+#include <string.h>
+#include <windows.h>
+#include <intrin.h>
+
+#include "ocupacao.h"
+
+static volatile LONG mapaLinhas[LINHAS_MALHA][PALAVRAS_LINHA];
+static volatile LONG mapaColunas[COLUNAS_MALHA][PALAVRAS_COLUNA];
+
+void inicializaOcupacao(void) {
+	memset((void*)mapaLinhas, 0, sizeof(mapaLinhas));
+	memset((void*)mapaColunas, 0, sizeof(mapaColunas));
+}
+
+int ocupaCelula(int lin, int col) {
+	if (InterlockedBitTestAndSet(&mapaLinhas[lin][col / BITS_PALAVRA], col % BITS_PALAVRA))
+		return 0;
+	InterlockedBitTestAndSet(&mapaColunas[col][lin / BITS_PALAVRA], lin % BITS_PALAVRA);
+	return 1;
+}
+
+// O espelho é limpo antes do mapa principal, para que ele nunca mostre livre uma célula já reservada de novo
+void liberaCelula(int lin, int col) {
+	InterlockedBitTestAndReset(&mapaColunas[col][lin / BITS_PALAVRA], lin % BITS_PALAVRA);
+	InterlockedBitTestAndReset(&mapaLinhas[lin][col / BITS_PALAVRA], col % BITS_PALAVRA);
+}
+
+int celulaOcupada(int lin, int col) {
+	return (mapaLinhas[lin][col / BITS_PALAVRA] >> (col % BITS_PALAVRA)) & 1;
+}
+
+// Varredura de um vetor de bits, de inicio até fim (em qualquer sentido). Em cada palavra os bits fora do
+// intervalo são descartados por máscara e o primeiro ocupado é achado com uma instrução de busca de bit
+static int livresNoVetor(const volatile LONG *palavras, int inicio, int fim) {
+	unsigned long bit;
+
+	if (fim >= inicio) {
+		for (int i = inicio; i <= fim; i = (i / BITS_PALAVRA + 1) * BITS_PALAVRA) {
+			unsigned long palavra = (unsigned long)palavras[i / BITS_PALAVRA] >> (i % BITS_PALAVRA);
+			int restantes = fim - i + 1;
+			if (restantes < BITS_PALAVRA)
+				palavra &= (1ul << restantes) - 1;
+			if (_BitScanForward(&bit, palavra))
+				return i + (int)bit - inicio;
+		}
+		return fim - inicio + 1;
+	}
+	for (int i = inicio; i >= fim; i = (i / BITS_PALAVRA) * BITS_PALAVRA - 1) {
+		int base = (i / BITS_PALAVRA) * BITS_PALAVRA;
+		unsigned long palavra = (unsigned long)palavras[i / BITS_PALAVRA];
+		if (i - base < BITS_PALAVRA - 1)
+			palavra &= (1ul << (i - base + 1)) - 1;
+		if (fim > base)
+			palavra &= ~((1ul << (fim - base)) - 1);
+		if (_BitScanReverse(&bit, palavra))
+			return inicio - (base + (int)bit);
+	}
+	return inicio - fim + 1;
+}
+
+int livresNaLinha(int lin, int colInicio, int colFim) {
+	return livresNoVetor(mapaLinhas[lin], colInicio, colFim);
+}
+
+int livresNaColuna(int col, int linInicio, int linFim) {
+	return livresNoVetor(mapaColunas[col], linInicio, linFim);
+}
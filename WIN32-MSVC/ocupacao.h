@@ -0,0 +1,33 @@
+#ifndef OCUPACAO_H
+#define OCUPACAO_H
+
+// Mapa de ocupação das células da malha, um bit por célula. Ocupar uma célula é uma única operação atômica
+// de teste e marcação, então dois veículos nunca ficam na mesma célula e um veículo só libera a célula que é
+// sua. O mapa por linhas é o que vale para as reservas; um espelho por colunas é atualizado logo depois e
+// serve às varreduras verticais.
+// Este módulo não usa a API do FreeRTOS.
+
+#define LINHAS_MALHA 23
+#define COLUNAS_MALHA 50
+#define BITS_PALAVRA 32
+#define PALAVRAS_LINHA ((COLUNAS_MALHA + BITS_PALAVRA - 1) / BITS_PALAVRA)
+#define PALAVRAS_COLUNA ((LINHAS_MALHA + BITS_PALAVRA - 1) / BITS_PALAVRA)
+
+void inicializaOcupacao(void);
+
+// Marca a célula como ocupada. Retorna 0, sem alterar nada, se ela já estava ocupada
+int ocupaCelula(int lin, int col);
+
+// Libera uma célula ocupada por quem chama
+void liberaCelula(int lin, int col);
+
+int celulaOcupada(int lin, int col);
+
+// Quantas células livres seguidas existem a partir de (lin, colInicio) em direção a colFim, inclusive.
+// A varredura é feita uma palavra de 32 células por vez
+int livresNaLinha(int lin, int colInicio, int colFim);
+
+// O mesmo, ao longo da coluna col, de linInicio em direção a linFim
+int livresNaColuna(int col, int linInicio, int linFim);
+
+#endif /* OCUPACAO_H */
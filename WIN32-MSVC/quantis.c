@@ -0,0 +1,197 @@
+/* Standard includes. */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "quantis.h"
+
+#define PI 3.14159265358979323846
+
+// Função de escala k1 e a sua inversa: um centróide pode ocupar no máximo uma unidade de k
+static double escalaK(double q) {
+	return COMPRESSAO_QUANTIS / (2.0 * PI) * asin(2.0 * q - 1.0);
+}
+
+static double inversaK(double k) {
+	if (k >= COMPRESSAO_QUANTIS / 4.0) // k1(1)
+		return 1.0;
+	return (sin(k * 2.0 * PI / COMPRESSAO_QUANTIS) + 1.0) / 2.0;
+}
+
+static int comparaCentroides(const void *a, const void *b) {
+	double x = ((const Centroide*)a)->media, y = ((const Centroide*)b)->media;
+	return (x > y) - (x < y);
+}
+
+// Funde os centróides dados (ordenados por média) e grava o resultado no resumo
+static void comprime(ResumoQuantis *resumo, Centroide *entrada, int n, double total) {
+	qsort(entrada, n, sizeof(Centroide), comparaCentroides);
+	resumo->nCentroides = 0;
+	if (n == 0)
+		return;
+	Centroide atual = entrada[0];
+	double acumulado = 0; // Peso dos centróides já fechados
+	double limite = total * inversaK(escalaK(0.0) + 1.0);
+	for (int i = 1; i < n; i++) {
+		if (acumulado + atual.peso + entrada[i].peso <= limite) {
+			atual.peso += entrada[i].peso;
+			atual.media += (entrada[i].media - atual.media) * entrada[i].peso / atual.peso;
+		}
+		else {
+			acumulado += atual.peso;
+			resumo->centroides[resumo->nCentroides++] = atual;
+			limite = total * inversaK(escalaK(acumulado / total) + 1.0);
+			atual = entrada[i];
+		}
+	}
+	resumo->centroides[resumo->nCentroides++] = atual;
+}
+
+// Funde os pendentes e, se houver, mais centróides de outro resumo
+static void funde(ResumoQuantis *resumo, const Centroide *outros, int nOutros, double pesoOutros) {
+	static Centroide entrada[2 * MAX_CENTROIDES + BUFFER_QUANTIS];
+	int n = 0;
+	memcpy(entrada, resumo->centroides, resumo->nCentroides * sizeof(Centroide));
+	n += resumo->nCentroides;
+	for (int i = 0; i < resumo->nPendentes; i++) {
+		entrada[n].media = resumo->pendentes[i];
+		entrada[n++].peso = 1.0;
+	}
+	if (nOutros > 0) // outros é NULL quando só os pendentes são fundidos
+		memcpy(entrada + n, outros, nOutros * sizeof(Centroide));
+	n += nOutros;
+	resumo->nPendentes = 0;
+	resumo->total += pesoOutros;
+	comprime(resumo, entrada, n, resumo->total);
+}
+
+void iniciaResumo(ResumoQuantis *resumo) {
+	resumo->nCentroides = 0;
+	resumo->nPendentes = 0;
+	resumo->total = 0;
+	resumo->minimo = INFINITY;
+	resumo->maximo = -INFINITY;
+}
+
+void registraResumo(ResumoQuantis *resumo, double valor) {
+	if (!isfinite(valor))
+		return;
+	if (resumo->nPendentes == BUFFER_QUANTIS)
+		funde(resumo, NULL, 0, 0);
+	resumo->pendentes[resumo->nPendentes++] = valor;
+	resumo->total += 1.0;
+	if (valor < resumo->minimo)
+		resumo->minimo = valor;
+	if (valor > resumo->maximo)
+		resumo->maximo = valor;
+}
+
+static void juntaCentroides(ResumoQuantis *destino, const Centroide *centroides, int n, double minimo, double maximo) {
+	double peso = 0;
+	for (int i = 0; i < n; i++)
+		peso += centroides[i].peso;
+	if (peso == 0)
+		return;
+	funde(destino, centroides, n, peso);
+	if (minimo < destino->minimo)
+		destino->minimo = minimo;
+	if (maximo > destino->maximo)
+		destino->maximo = maximo;
+}
+
+void juntaResumos(ResumoQuantis *destino, const ResumoQuantis *origem) {
+	static Centroide pendentes[BUFFER_QUANTIS];
+	for (int i = 0; i < origem->nPendentes; i++) {
+		pendentes[i].media = origem->pendentes[i];
+		pendentes[i].peso = 1.0;
+	}
+	juntaCentroides(destino, origem->centroides, origem->nCentroides, origem->minimo, origem->maximo);
+	juntaCentroides(destino, pendentes, origem->nPendentes, origem->minimo, origem->maximo);
+}
+
+// Cada centróide ocupa o intervalo de peso em torno do seu centro; entre dois centros o valor é interpolado,
+// e nas pontas a interpolação vai até o mínimo e o máximo
+double quantilResumo(ResumoQuantis *resumo, double q) {
+	if (resumo->total == 0)
+		return 0;
+	if (resumo->nPendentes > 0)
+		funde(resumo, NULL, 0, 0);
+	if (q <= 0)
+		return resumo->minimo;
+	if (q >= 1)
+		return resumo->maximo;
+	const Centroide *c = resumo->centroides;
+	int n = resumo->nCentroides;
+	double alvo = q * resumo->total;
+	if (alvo < c[0].peso / 2)
+		return resumo->minimo + (c[0].media - resumo->minimo) * alvo / (c[0].peso / 2);
+	double centro = c[0].peso / 2;
+	for (int i = 0; i + 1 < n; i++) {
+		double proximo = centro + (c[i].peso + c[i + 1].peso) / 2;
+		if (alvo < proximo)
+			return c[i].media + (c[i + 1].media - c[i].media) * (alvo - centro) / (proximo - centro);
+		centro = proximo;
+	}
+	double resto = resumo->total - centro;
+	return c[n - 1].media + (resumo->maximo - c[n - 1].media) * (resto > 0 ? (alvo - centro) / resto : 1.0);
+}
+
+static int gravaU32(FILE *arquivo, uint32_t valor) {
+	uint8_t bytes[4] = { (uint8_t)valor, (uint8_t)(valor >> 8), (uint8_t)(valor >> 16), (uint8_t)(valor >> 24) };
+	return fwrite(bytes, 1, 4, arquivo) == 4;
+}
+
+static int leU32(FILE *arquivo, uint32_t *valor) {
+	uint8_t bytes[4];
+	if (fread(bytes, 1, 4, arquivo) != 4)
+		return 0;
+	*valor = bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+	return 1;
+}
+
+// O Windows só roda em little-endian, então o double vai como está na memória
+static int gravaDouble(FILE *arquivo, double valor) {
+	return fwrite(&valor, sizeof(double), 1, arquivo) == 1;
+}
+
+static int leDouble(FILE *arquivo, double *valor) {
+	return fread(valor, sizeof(double), 1, arquivo) == 1;
+}
+
+int gravaResumos(FILE *arquivo, ResumoQuantis *resumos, int n) {
+	int ok = fwrite("QTD1", 1, 4, arquivo) == 4 && gravaU32(arquivo, COMPRESSAO_QUANTIS) && gravaU32(arquivo, n);
+	for (int r = 0; r < n && ok; r++) {
+		ResumoQuantis *resumo = &resumos[r];
+		if (resumo->nPendentes > 0)
+			funde(resumo, NULL, 0, 0);
+		ok = gravaDouble(arquivo, resumo->minimo) && gravaDouble(arquivo, resumo->maximo)
+			&& gravaU32(arquivo, resumo->nCentroides);
+		for (int i = 0; i < resumo->nCentroides && ok; i++)
+			ok = gravaDouble(arquivo, resumo->centroides[i].media) && gravaDouble(arquivo, resumo->centroides[i].peso);
+	}
+	return ok;
+}
+
+int juntaArquivoResumos(FILE *arquivo, ResumoQuantis *resumos, int n) {
+	static Centroide lidos[MAX_CENTROIDES];
+	char cabecalho[4];
+	uint32_t compressao, quantidade;
+	if (fread(cabecalho, 1, 4, arquivo) != 4 || memcmp(cabecalho, "QTD1", 4) != 0
+		|| !leU32(arquivo, &compressao) || compressao != COMPRESSAO_QUANTIS
+		|| !leU32(arquivo, &quantidade) || quantidade != (uint32_t)n)
+		return 0;
+	for (int r = 0; r < n; r++) {
+		double minimo, maximo;
+		uint32_t nCentroides;
+		if (!leDouble(arquivo, &minimo) || !leDouble(arquivo, &maximo) || !leU32(arquivo, &nCentroides)
+			|| nCentroides > MAX_CENTROIDES)
+			return 0;
+		for (uint32_t i = 0; i < nCentroides; i++)
+			if (!leDouble(arquivo, &lidos[i].media) || !leDouble(arquivo, &lidos[i].peso) || !(lidos[i].peso >= 0))
+				return 0;
+		juntaCentroides(&resumos[r], lidos, nCentroides, minimo, maximo);
+	}
+	return 1;
+}
@@ -0,0 +1,53 @@
+#ifndef QUANTIS_H
+#define QUANTIS_H
+
+#include <stdio.h>
+
+// Resumo de quantis com memória fixa (t-digest com fusão): os valores entram num buffer e, quando ele enche,
+// são fundidos aos centróides, cujo tamanho é limitado pela função de escala k1, de modo que os centróides
+// perto das caudas guardam poucos pontos e os quantis extremos saem mais precisos que a mediana. Dois
+// resumos se juntam fundindo os centróides, então execuções paralelas (outras sementes, outros distritos)
+// podem ser somadas num único resultado. As funções usam áreas de trabalho estáticas e não podem ser chamadas
+// por duas threads ao mesmo tempo, nem para resumos diferentes.
+// Este módulo não usa a API do FreeRTOS.
+
+#define COMPRESSAO_QUANTIS 100 // delta do t-digest: mais centróides = quantis mais precisos
+#define MAX_CENTROIDES (2 * COMPRESSAO_QUANTIS)
+#define BUFFER_QUANTIS 256
+
+typedef struct {
+	double media;
+	double peso;
+} Centroide;
+
+typedef struct {
+	Centroide centroides[MAX_CENTROIDES];
+	int nCentroides;
+	double pendentes[BUFFER_QUANTIS]; // Valores ainda não fundidos
+	int nPendentes;
+	double total; // Peso somado, incluindo os pendentes
+	double minimo;
+	double maximo;
+} ResumoQuantis;
+
+void iniciaResumo(ResumoQuantis *resumo);
+
+// Valores não finitos são ignorados
+void registraResumo(ResumoQuantis *resumo, double valor);
+
+// Funde origem em destino; origem não muda
+void juntaResumos(ResumoQuantis *destino, const ResumoQuantis *origem);
+
+// Valor estimado do quantil q (de 0 a 1), ou 0 se o resumo está vazio. Pode fundir os pendentes
+double quantilResumo(ResumoQuantis *resumo, double q);
+
+// Arquivo de resumos: cabeçalho "QTD1", a compressão e o número de resumos (uint32), e para cada resumo
+// mínimo, máximo (double), o número de centróides (uint32) e os pares média e peso (double), em little-endian.
+// Um arquivo gravado com outra compressão ou outro número de resumos não é aceito
+int gravaResumos(FILE *arquivo, ResumoQuantis *resumos, int n);
+
+// Junta aos resumos os que estão no arquivo. Retorna 0 se o arquivo não é compatível ou está truncado; nesse
+// caso os resumos lidos antes do erro já foram juntados
+int juntaArquivoResumos(FILE *arquivo, ResumoQuantis *resumos, int n);
+
+#endif /* QUANTIS_H */
@@ -0,0 +1,37 @@
+/* Standard includes. */
+#include <string.h>
+
+#include "reserva.h"
+
+void inicializaTabelaReserva(TabelaReserva *tabela, uint32_t intervaloAtual) {
+	memset(tabela->reservadas, 0, sizeof(tabela->reservadas));
+	tabela->intervaloBase = intervaloAtual;
+}
+
+// Descarta os intervalos que já passaram, liberando as suas posições para o fim do horizonte
+static void avancaTabela(TabelaReserva *tabela, uint32_t intervaloAtual) {
+	uint32_t passados = intervaloAtual - tabela->intervaloBase;
+	if ((int32_t)passados <= 0)
+		return;
+	if (passados >= INTERVALOS_RESERVA) {
+		memset(tabela->reservadas, 0, sizeof(tabela->reservadas));
+	}
+	else {
+		for (uint32_t i = 0; i < passados; i++)
+			tabela->reservadas[(tabela->intervaloBase + i) % INTERVALOS_RESERVA] = 0;
+	}
+	tabela->intervaloBase = intervaloAtual;
+}
+
+int reservaCelulas(TabelaReserva *tabela, uint32_t inicio, const uint64_t *mascaras, int nIntervalos) {
+	avancaTabela(tabela, inicio);
+	if (nIntervalos > INTERVALOS_RESERVA || (int32_t)(inicio - tabela->intervaloBase) < 0)
+		return 0;
+	for (int k = 0; k < nIntervalos; k++) {
+		if (tabela->reservadas[(inicio + k) % INTERVALOS_RESERVA] & mascaras[k])
+			return 0;
+	}
+	for (int k = 0; k < nIntervalos; k++)
+		tabela->reservadas[(inicio + k) % INTERVALOS_RESERVA] |= mascaras[k];
+	return 1;
+}
@@ -0,0 +1,26 @@
+#ifndef RESERVA_H
+#define RESERVA_H
+
+#include <stdint.h>
+
+// Tabela de reservas espaço-tempo de um cruzamento. O tempo é dividido em intervalos e, para cada intervalo
+// do horizonte, uma palavra de 64 bits marca as células do cruzamento já reservadas. Um pedido traz, para
+// cada intervalo a partir do início, as células de que precisa, e só é aceito se nenhuma delas já estiver
+// reservada, de modo que movimentos compatíveis atravessam ao mesmo tempo.
+// Este módulo não usa a API do FreeRTOS; quem chama garante a exclusão mútua.
+
+#define INTERVALOS_RESERVA 64   // Horizonte da tabela, em intervalos
+#define MAX_CELULAS_RESERVA 64  // Células distintas de um cruzamento, uma por bit
+
+typedef struct {
+	uint64_t reservadas[INTERVALOS_RESERVA]; // Indexado pelo intervalo absoluto módulo INTERVALOS_RESERVA
+	uint32_t intervaloBase;                  // Intervalo mais antigo ainda guardado na tabela
+} TabelaReserva;
+
+void inicializaTabelaReserva(TabelaReserva *tabela, uint32_t intervaloAtual);
+
+// Reserva as células de mascaras[k] no intervalo inicio + k, para k de 0 a nIntervalos - 1.
+// Retorna 0, sem reservar nada, se houver conflito ou se o pedido passar do horizonte
+int reservaCelulas(TabelaReserva *tabela, uint32_t inicio, const uint64_t *mascaras, int nIntervalos);
+
+#endif /* RESERVA_H */
@@ -0,0 +1,128 @@
+/* FreeRTOS kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "retomada.h"
+
+static ListaEspera prontos;
+static ListaEspera relogio[FATIAS_RELOGIO];
+static TickType_t ultimoTick;
+
+static void insereLista(ListaEspera *lista, Retomavel *retomavel) {
+	retomavel->proximo = NULL;
+	if (lista->ultimo != NULL)
+		lista->ultimo->proximo = retomavel;
+	else
+		lista->primeiro = retomavel;
+	lista->ultimo = retomavel;
+}
+
+static void insereProntos(Retomavel *retomavel) {
+	retomavel->estado = RT_PRONTO;
+	insereLista(&prontos, retomavel);
+}
+
+static Retomavel *retiraPronto(void) {
+	taskENTER_CRITICAL();
+	Retomavel *retomavel = prontos.primeiro;
+	if (retomavel != NULL) {
+		prontos.primeiro = retomavel->proximo;
+		if (prontos.primeiro == NULL)
+			prontos.ultimo = NULL;
+		retomavel->estado = RT_EXECUTANDO;
+	}
+	taskEXIT_CRITICAL();
+	return retomavel;
+}
+
+void iniciaRetomavel(Retomavel *retomavel, FuncaoRetomavel executa) {
+	retomavel->linha = 0;
+	retomavel->executa = executa;
+	taskENTER_CRITICAL();
+	insereProntos(retomavel);
+	taskEXIT_CRITICAL();
+}
+
+void esperaPrazo(Retomavel *retomavel, TickType_t ticks) {
+	retomavel->prazo = xTaskGetTickCount() + (ticks > 0 ? ticks : 1);
+	retomavel->estado = RT_ESPERA_PRAZO;
+	taskENTER_CRITICAL();
+	insereLista(&relogio[retomavel->prazo % FATIAS_RELOGIO], retomavel);
+	taskEXIT_CRITICAL();
+}
+
+void esperaEm(Retomavel *retomavel, ListaEspera *lista) {
+	retomavel->estado = RT_ESPERA_LISTA;
+	taskENTER_CRITICAL();
+	insereLista(lista, retomavel);
+	taskEXIT_CRITICAL();
+}
+
+void esperaAviso(Retomavel *retomavel) {
+	retomavel->estado = RT_ESPERA_AVISO;
+}
+
+// Passa a lista inteira para o fim dos prontos. O teste fora da seção crítica deixa barato avisar uma lista
+// vazia, o caso comum de uma célula que vaga sem ninguém esperando
+void avisaLista(ListaEspera *lista) {
+	if (lista->primeiro == NULL)
+		return;
+	taskENTER_CRITICAL();
+	if (lista->primeiro != NULL) { // Outra tarefa pode ter esvaziado a lista antes da seção crítica
+		for (Retomavel *retomavel = lista->primeiro; retomavel != NULL; retomavel = retomavel->proximo)
+			retomavel->estado = RT_PRONTO;
+		if (prontos.ultimo != NULL)
+			prontos.ultimo->proximo = lista->primeiro;
+		else
+			prontos.primeiro = lista->primeiro;
+		prontos.ultimo = lista->ultimo;
+		lista->primeiro = lista->ultimo = NULL;
+	}
+	taskEXIT_CRITICAL();
+}
+
+void avisaRetomavel(Retomavel *retomavel) {
+	taskENTER_CRITICAL();
+	if (retomavel->estado == RT_ESPERA_AVISO)
+		insereProntos(retomavel);
+	taskEXIT_CRITICAL();
+}
+
+// Percorre as fatias dos ticks desde a última chamada. Cada fatia guarda também prazos de voltas futuras da
+// roda, que continuam nela
+static void vencePrazos(TickType_t agora) {
+	TickType_t ticks = agora - ultimoTick;
+	if (ticks > FATIAS_RELOGIO)
+		ticks = FATIAS_RELOGIO;
+	for (TickType_t t = agora - ticks + 1; ticks > 0; t++, ticks--) {
+		ListaEspera *fatia = &relogio[t % FATIAS_RELOGIO];
+		taskENTER_CRITICAL();
+		Retomavel *retomavel = fatia->primeiro;
+		fatia->primeiro = fatia->ultimo = NULL;
+		while (retomavel != NULL) {
+			Retomavel *proximo = retomavel->proximo;
+			if ((int32_t)(agora - retomavel->prazo) >= 0)
+				insereProntos(retomavel);
+			else
+				insereLista(fatia, retomavel);
+			retomavel = proximo;
+		}
+		taskEXIT_CRITICAL();
+	}
+	ultimoTick = agora;
+}
+
+void TaskRetomada(void *param) {
+	Retomavel *retomavel;
+
+	ultimoTick = xTaskGetTickCount();
+	while (1) {
+		vTaskSuspendAll();
+		vencePrazos(xTaskGetTickCount());
+		// O retomável pode terminar e liberar a própria memória; depois de executa ele não é mais tocado
+		while ((retomavel = retiraPronto()) != NULL)
+			retomavel->executa(retomavel);
+		xTaskResumeAll();
+		vTaskDelay(1);
+	}
+}
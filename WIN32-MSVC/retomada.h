@@ -0,0 +1,63 @@
+#ifndef RETOMADA_H
+#define RETOMADA_H
+
+#include "FreeRTOS.h"
+
+// Funções retomáveis no estilo protothread, escritas como código sequencial que pausa em RT_ESPERA_*, e um
+// escalonador que só as retoma quando o evento esperado acontece: o fim de um prazo, um aviso direto ou um
+// aviso a uma lista de espera (um sinal que abre, uma célula que vaga). Cada passo do escalonador custa o
+// número de retomáveis prontos mais os prazos que vencem, não o número total de retomáveis.
+// Como num protothread, as variáveis locais não sobrevivem a uma pausa, e o ponto de retomada é uma linha do
+// código: só pode haver uma macro RT_ por linha e nenhuma dentro de outro switch.
+// Os retomáveis rodam na TaskRetomada com o escalonador do FreeRTOS suspenso, então testar uma condição e
+// pausar à espera dela é atômico em relação às outras tarefas.
+
+#define FATIAS_RELOGIO 256 // Listas da roda de prazos, uma por tick módulo FATIAS_RELOGIO
+
+typedef enum {
+	RT_PRONTO,
+	RT_EXECUTANDO,
+	RT_ESPERA_PRAZO,
+	RT_ESPERA_LISTA,
+	RT_ESPERA_AVISO
+} EstadoRetomavel;
+
+typedef struct Retomavel Retomavel;
+typedef void (*FuncaoRetomavel)(Retomavel *retomavel);
+
+struct Retomavel {
+	unsigned linha;          // Ponto de retomada; 0 = início
+	FuncaoRetomavel executa;
+	EstadoRetomavel estado;
+	TickType_t prazo;
+	Retomavel *proximo;      // Na lista em que está
+};
+
+typedef struct {
+	Retomavel *primeiro;
+	Retomavel *ultimo;
+} ListaEspera;
+
+#define RT_INICIO(r) switch ((r)->linha) { case 0:
+#define RT_FIM(r) } (r)->linha = 0
+#define RT_PAUSA(r) (r)->linha = __LINE__; return; case __LINE__:
+#define RT_ESPERA_TEMPO(r, ticks) do { esperaPrazo((r), (ticks)); RT_PAUSA(r); } while (0)
+#define RT_ESPERA_EM(r, lista) do { esperaEm((r), (lista)); RT_PAUSA(r); } while (0)
+#define RT_ESPERA_AVISO(r) do { esperaAviso(r); RT_PAUSA(r); } while (0)
+
+// Põe o retomável na lista de prontos, para começar do início
+void iniciaRetomavel(Retomavel *retomavel, FuncaoRetomavel executa);
+
+// Chamadas por um retomável antes de pausar (use as macros RT_ESPERA_*). Um prazo de 0 ticks vale como 1
+void esperaPrazo(Retomavel *retomavel, TickType_t ticks);
+void esperaEm(Retomavel *retomavel, ListaEspera *lista);
+void esperaAviso(Retomavel *retomavel);
+
+// Podem ser chamadas de qualquer tarefa. Acordam todos os retomáveis da lista ou um que espera aviso
+void avisaLista(ListaEspera *lista);
+void avisaRetomavel(Retomavel *retomavel);
+
+// A cada tick, vence os prazos e executa os retomáveis prontos até não sobrar nenhum
+void TaskRetomada(void *param);
+
+#endif /* RETOMADA_H */
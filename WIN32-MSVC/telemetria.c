@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <string.h>
+
+/* FreeRTOS kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "stream_buffer.h"
+
+#include "telemetria.h"
+#include "colunas.h"
+
+// Memória estática: o heap da simulação é pequeno e fica para as tarefas dos veículos.
+// O stream buffer precisa de um byte além da capacidade
+static uint8_t armazenamento[CAPACIDADE_TELEMETRIA * sizeof(RegistroTelemetria) + 1];
+static StaticStreamBuffer_t controleFluxo;
+static StreamBufferHandle_t fluxo;
+static FILE *arquivo;  // Registros brutos; NULL se não pedidos
+static int colunas;    // 1 = grava também as trajetórias colunares
+static volatile unsigned long perdidos;
+static TaskHandle_t tarefaTelemetria;
+static volatile int encerrando;       // Pedido de encerraTelemetria
+static StaticSemaphore_t controleEncerrada;
+static SemaphoreHandle_t encerrada;   // Dado pela tarefa depois da última gravação
+
+// Um stream buffer admite um só escritor por vez. Os emissores ficam serializados pela suspensão do
+// escalonador (as corrotinas rodam na tarefa ociosa), e só escrevem registros inteiros, então a leitura de
+// um múltiplo do tamanho do registro nunca corta um registro ao meio
+void emiteTelemetria(const RegistroTelemetria *registro) {
+	if (fluxo == NULL)
+		return;
+	vTaskSuspendAll();
+	if (xStreamBufferSpacesAvailable(fluxo) >= sizeof(*registro))
+		xStreamBufferSend(fluxo, registro, sizeof(*registro), 0);
+	else
+		perdidos++;
+	xTaskResumeAll();
+}
+
+unsigned long registrosTelemetriaPerdidos(void) {
+	return perdidos;
+}
+
+// Espera um lote inteiro, ou o fim do intervalo, e grava o que recebeu. O arquivo de registros só é
+// descarregado quando o fluxo está calmo, isto é, quando o lote veio incompleto.
+// No encerramento esvazia o buffer, grava o bloco colunar aberto e avisa quem pediu; depois não grava mais nada
+static void TaskTelemetria(void *param) {
+	static RegistroTelemetria lote[LOTE_TELEMETRIA];
+	TickType_t ultimoBloco = xTaskGetTickCount();
+	while (!encerrando) {
+		size_t bytes = xStreamBufferReceive(fluxo, lote, sizeof(lote), pdMS_TO_TICKS(INTERVALO_DESCARGA_MS));
+		if (arquivo != NULL) {
+			if (bytes > 0)
+				fwrite(lote, 1, bytes, arquivo);
+			if (bytes < sizeof(lote))
+				fflush(arquivo);
+		}
+		if (colunas) {
+			for (size_t i = 0; i < bytes / sizeof(RegistroTelemetria); i++)
+				acrescentaColunas(&lote[i]);
+			if (xTaskGetTickCount() - ultimoBloco >= pdMS_TO_TICKS(INTERVALO_BLOCO_MS)) {
+				descarregaColunas();
+				ultimoBloco = xTaskGetTickCount();
+			}
+		}
+	}
+
+	size_t bytes;
+	while ((bytes = xStreamBufferReceive(fluxo, lote, sizeof(lote), 0)) > 0) {
+		if (arquivo != NULL)
+			fwrite(lote, 1, bytes, arquivo);
+		if (colunas) {
+			for (size_t i = 0; i < bytes / sizeof(RegistroTelemetria); i++)
+				acrescentaColunas(&lote[i]);
+		}
+	}
+	if (colunas)
+		descarregaColunas();
+	if (arquivo != NULL)
+		fflush(arquivo);
+	xSemaphoreGive(encerrada);
+	vTaskSuspend(NULL);
+}
+
+void encerraTelemetria(void) {
+	if (fluxo == NULL)
+		return;
+	encerrando = 1;
+	xTaskAbortDelay(tarefaTelemetria); // Não espera o fim do intervalo de descarga
+	xSemaphoreTake(encerrada, pdMS_TO_TICKS(ESPERA_ENCERRAMENTO_MS));
+}
+
+int iniciaTelemetria(const char *caminhoRegistros, const char *caminhoColunas, double ticksPorSegundoSimulado) {
+	if (caminhoRegistros != NULL) {
+		if (fopen_s(&arquivo, caminhoRegistros, "wb") != 0 || arquivo == NULL)
+			return 0;
+		CabecalhoTelemetria cabecalho;
+		memcpy(cabecalho.marca, "TLM1", 4);
+		cabecalho.tamanhoRegistro = sizeof(RegistroTelemetria);
+		cabecalho.ticksPorSegundo = configTICK_RATE_HZ;
+		fwrite(&cabecalho, sizeof(cabecalho), 1, arquivo);
+	}
+	if (caminhoColunas != NULL) {
+		if (!abreColunas(caminhoColunas, ticksPorSegundoSimulado))
+			return 0;
+		colunas = 1;
+	}
+
+	encerrada = xSemaphoreCreateBinaryStatic(&controleEncerrada);
+	fluxo = xStreamBufferCreateStatic(CAPACIDADE_TELEMETRIA * sizeof(RegistroTelemetria),
+		LOTE_TELEMETRIA * sizeof(RegistroTelemetria), armazenamento, &controleFluxo);
+	xTaskCreate(TaskTelemetria, (signed char*)"Telemetria", configMINIMAL_STACK_SIZE, (void*)NULL, PRIORIDADE_TELEMETRIA,
+		&tarefaTelemetria);
+	return 1;
+}
@@ -0,0 +1,63 @@
+#ifndef TELEMETRIA_H
+#define TELEMETRIA_H
+
+#include <stdint.h>
+
+// Registro binário das transições dos veículos. Quem emite só copia um registro de tamanho fixo para um
+// stream buffer do FreeRTOS; uma tarefa acima dos veículos esvazia o buffer em lotes e os grava em arquivo.
+// O arquivo de registros começa com um CabecalhoTelemetria seguido dos registros, na ordem em que foram
+// emitidos e na representação da máquina (little-endian no Win32). A mesma tarefa pode gravar as trajetórias
+// em formato colunar (colunas.h).
+
+#define CAPACIDADE_TELEMETRIA 128 // Registros no stream buffer
+#define LOTE_TELEMETRIA 32        // Registros por gravação; a tarefa também grava o que houver a cada intervalo
+#define INTERVALO_DESCARGA_MS 1000
+// Acima dos veículos (prioridade 1): com --escala=inf eles nunca bloqueiam e uma tarefa ociosa não rodaria.
+// A tarefa fica bloqueada no stream buffer até haver um lote ou passar o intervalo, então quase não rouba CPU
+#define PRIORIDADE_TELEMETRIA (tskIDLE_PRIORITY + 2)
+#define INTERVALO_BLOCO_MS 10000  // Com pouco tráfego, o bloco colunar incompleto é gravado a cada intervalo
+#define ESPERA_ENCERRAMENTO_MS 5000 // Limite para a última gravação em encerraTelemetria
+#define VIA_NENHUMA 0xFF
+
+typedef enum {
+	TELEMETRIA_CHEGADA, // Chegou à linha de parada; via: a via em que está
+	TELEMETRIA_VERDE,   // Conseguiu sinal, vaga e reserva; via: a via de destino, direcao: o movimento escolhido
+	TELEMETRIA_ENTRADA, // Entrou na via
+	TELEMETRIA_SAIDA    // Deixou a malha, pelo fim de uma saída ou retirado de um impasse
+} TipoTelemetria;
+
+typedef struct {
+	uint32_t instante;   // Tick do FreeRTOS
+	int32_t veiculo;
+	uint8_t tipo;        // TipoTelemetria
+	uint8_t cruzamento;
+	uint8_t semaforo;
+	uint8_t direcao;
+	uint8_t via;         // VIA_NENHUMA se não se aplica
+	uint8_t distrito;
+	uint16_t reservado;
+} RegistroTelemetria;
+
+typedef struct {
+	char marca[4];             // "TLM1"
+	uint16_t tamanhoRegistro;  // sizeof(RegistroTelemetria)
+	uint16_t ticksPorSegundo;
+} CabecalhoTelemetria;
+
+// Abre os arquivos pedidos (registros brutos e/ou trajetórias colunares; NULL = não gravar), cria o stream
+// buffer e a tarefa de descarga. ticksPorSegundoSimulado vai para o cabeçalho das trajetórias, que contam o
+// tempo em segundos simulados. Retorna 0 se não conseguiu; sem telemetria iniciada, emiteTelemetria não faz nada
+int iniciaTelemetria(const char *caminhoRegistros, const char *caminhoColunas, double ticksPorSegundoSimulado);
+
+// Copia o registro para o buffer. Pode ser chamada por tarefas, corrotinas e com o escalonador suspenso;
+// com o buffer cheio o registro é descartado e contado
+void emiteTelemetria(const RegistroTelemetria *registro);
+
+unsigned long registrosTelemetriaPerdidos(void);
+
+// Fim da execução: a tarefa de descarga grava os registros ainda no buffer e o bloco colunar aberto e descarrega
+// os arquivos. Retorna quando ela terminou (ou depois de ESPERA_ENCERRAMENTO_MS); os registros emitidos depois
+// disso não são gravados. Não faz nada se a telemetria não foi iniciada
+void encerraTelemetria(void);
+
+#endif /* TELEMETRIA_H */
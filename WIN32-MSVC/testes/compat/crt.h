@@ -0,0 +1,26 @@
+#ifndef COMPAT_CRT_H
+#define COMPAT_CRT_H
+
+// Funções da biblioteca C do MSVC usadas pelos módulos testados, sobre as equivalentes POSIX.
+// Incluído em todo arquivo pelo Makefile (-include), como o MSVC as declara em <stdio.h>
+
+#include <stdio.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#define __int64 long long
+
+static inline int fopen_s(FILE **arquivo, const char *caminho, const char *modo) {
+	*arquivo = fopen(caminho, modo);
+	return *arquivo != NULL ? 0 : errno;
+}
+
+static inline int _fseeki64(FILE *arquivo, long long deslocamento, int origem) {
+	return fseeko(arquivo, (off_t)deslocamento, origem);
+}
+
+static inline long long _ftelli64(FILE *arquivo) {
+	return (long long)ftello(arquivo);
+}
+
+#endif /* COMPAT_CRT_H */
@@ -0,0 +1,20 @@
+#ifndef COMPAT_INTRIN_H
+#define COMPAT_INTRIN_H
+
+// Intrínsecos de busca de bit do MSVC, sobre os do gcc
+
+static inline unsigned char _BitScanForward(unsigned long *indice, unsigned long mascara) {
+	if (mascara == 0)
+		return 0;
+	*indice = (unsigned long)__builtin_ctzl(mascara);
+	return 1;
+}
+
+static inline unsigned char _BitScanReverse(unsigned long *indice, unsigned long mascara) {
+	if (mascara == 0)
+		return 0;
+	*indice = (unsigned long)(8 * sizeof(mascara) - 1 - __builtin_clzl(mascara));
+	return 1;
+}
+
+#endif /* COMPAT_INTRIN_H */
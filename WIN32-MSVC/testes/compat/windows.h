@@ -0,0 +1,129 @@
+#ifndef COMPAT_WINDOWS_H
+#define COMPAT_WINDOWS_H
+
+// O pouco da API do Windows que os módulos sem FreeRTOS usam, para compilá-los no Linux: as operações
+// Interlocked sobre os atômicos do gcc e as threads e os eventos de reinício automático sobre pthreads.
+// LONG é long, como no Windows; no Linux de 64 bits ele tem 64 bits, o que só muda a folga das estruturas
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+
+typedef long LONG;
+typedef long long LONG64;
+typedef unsigned long DWORD;
+typedef void *LPVOID;
+typedef void *HANDLE;
+
+#define WINAPI
+#define FALSE 0
+#define TRUE 1
+#define INFINITE 0xFFFFFFFFul
+
+static inline LONG InterlockedIncrement(volatile LONG *valor) {
+	return __atomic_add_fetch(valor, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedDecrement(volatile LONG *valor) {
+	return __atomic_sub_fetch(valor, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedExchange(volatile LONG *destino, LONG valor) {
+	return __atomic_exchange_n(destino, valor, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedCompareExchange(volatile LONG *destino, LONG novo, LONG esperado) {
+	return __sync_val_compare_and_swap(destino, esperado, novo);
+}
+
+static inline LONG64 InterlockedIncrement64(volatile LONG64 *valor) {
+	return __atomic_add_fetch(valor, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG64 InterlockedCompareExchange64(volatile LONG64 *destino, LONG64 novo, LONG64 esperado) {
+	return __sync_val_compare_and_swap(destino, esperado, novo);
+}
+
+static inline unsigned char InterlockedBitTestAndSet(volatile LONG *palavra, LONG bit) {
+	return (unsigned char)((__atomic_fetch_or(palavra, 1l << bit, __ATOMIC_SEQ_CST) >> bit) & 1);
+}
+
+static inline unsigned char InterlockedBitTestAndReset(volatile LONG *palavra, LONG bit) {
+	return (unsigned char)((__atomic_fetch_and(palavra, ~(1l << bit), __ATOMIC_SEQ_CST) >> bit) & 1);
+}
+
+#define MemoryBarrier() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define YieldProcessor() sched_yield() // Cede o núcleo: a máquina de testes pode ter um só
+
+// Evento de reinício automático: WaitForSingleObject consome o sinal
+typedef struct {
+	pthread_mutex_t trava;
+	pthread_cond_t condicao;
+	int sinalizado;
+} EventoCompat;
+
+static inline HANDLE CreateEvent(void *atributos, int reinicioManual, int inicial, const char *nome) {
+	(void)atributos; (void)reinicioManual; (void)nome;
+	EventoCompat *evento = malloc(sizeof(EventoCompat));
+	if (evento == NULL)
+		return NULL;
+	pthread_mutex_init(&evento->trava, NULL);
+	pthread_cond_init(&evento->condicao, NULL);
+	evento->sinalizado = inicial;
+	return evento;
+}
+
+static inline int SetEvent(HANDLE handle) {
+	EventoCompat *evento = handle;
+	pthread_mutex_lock(&evento->trava);
+	evento->sinalizado = 1;
+	pthread_cond_signal(&evento->condicao);
+	pthread_mutex_unlock(&evento->trava);
+	return 1;
+}
+
+// Só espera eventos e sem limite de tempo, que é o que trabalho.c usa
+static inline DWORD WaitForSingleObject(HANDLE handle, DWORD milissegundos) {
+	EventoCompat *evento = handle;
+	(void)milissegundos;
+	pthread_mutex_lock(&evento->trava);
+	while (!evento->sinalizado)
+		pthread_cond_wait(&evento->condicao, &evento->trava);
+	evento->sinalizado = 0;
+	pthread_mutex_unlock(&evento->trava);
+	return 0;
+}
+
+typedef DWORD (*FuncaoThreadCompat)(LPVOID);
+
+typedef struct {
+	FuncaoThreadCompat funcao;
+	LPVOID parametro;
+} InicioThreadCompat;
+
+static inline void *executaThreadCompat(void *argumento) {
+	InicioThreadCompat inicio = *(InicioThreadCompat*)argumento;
+	free(argumento);
+	inicio.funcao(inicio.parametro);
+	return NULL;
+}
+
+static inline HANDLE CreateThread(void *atributos, size_t pilha, FuncaoThreadCompat funcao, LPVOID parametro,
+	DWORD opcoes, DWORD *id) {
+	(void)atributos; (void)pilha; (void)opcoes; (void)id;
+	InicioThreadCompat *inicio = malloc(sizeof(InicioThreadCompat));
+	pthread_t thread;
+	if (inicio == NULL)
+		return NULL;
+	inicio->funcao = funcao;
+	inicio->parametro = parametro;
+	if (pthread_create(&thread, NULL, executaThreadCompat, inicio) != 0) {
+		free(inicio);
+		return NULL;
+	}
+	pthread_detach(thread);
+	return (HANDLE)inicio; // Só é comparado com NULL
+}
+
+#endif /* COMPAT_WINDOWS_H */
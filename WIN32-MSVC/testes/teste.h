@@ -0,0 +1,27 @@
+#ifndef TESTE_H
+#define TESTE_H
+
+#include <stdio.h>
+
+// Conferências dos testes: uma falha é contada e mostrada com o arquivo e a linha, e o teste continua.
+// Cada teste termina com return resultadoTeste(), que dá 1 ao make quando algo falhou
+
+static int falhasTeste;
+
+#define CONFERE(condicao) do { \
+	if (!(condicao)) { \
+		falhasTeste++; \
+		fprintf(stderr, "%s:%d: falhou: %s\n", __FILE__, __LINE__, #condicao); \
+	} \
+} while (0)
+
+static int resultadoTeste(const char *nome) {
+	if (falhasTeste > 0) {
+		fprintf(stderr, "%s: %d falhas\n", nome, falhasTeste);
+		return 1;
+	}
+	printf("%s: ok\n", nome);
+	return 0;
+}
+
+#endif /* TESTE_H */
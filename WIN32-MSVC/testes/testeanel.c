@@ -0,0 +1,87 @@
+/* Standard includes. */
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "anel.h"
+#include "teste.h"
+
+#define CAPACIDADE 8
+#define ITENS_THREADS 1000000
+
+// Enche e esvazia a fila em lotes de tamanhos variados, para que os índices deem várias voltas na memória,
+// conferindo a ordem, a fila cheia e a fila vazia
+static void testaVoltas(uint32_t inicio) {
+	AnelSPSC anel;
+	uint32_t memoria[CAPACIDADE];
+	uint32_t escrito = 0, lido = 0, item;
+
+	inicializaAnel(&anel, memoria, sizeof(uint32_t), CAPACIDADE);
+	// Índices perto do limite de 32 bits: a diferença cabeca - cauda continua valendo depois do estouro
+	anel.cabeca = anel.caudaVista = anel.cauda = anel.cabecaVista = inicio;
+	for (int rodada = 0; rodada < 1000; rodada++) {
+		int escrever = rodada % (CAPACIDADE + 3);
+		for (int i = 0; i < escrever; i++) {
+			int cabe = escrito - lido < CAPACIDADE;
+			CONFERE(escreveAnel(&anel, &escrito) == cabe);
+			if (cabe)
+				escrito++;
+		}
+		int ler = (rodada * 7) % (CAPACIDADE + 2);
+		for (int i = 0; i < ler; i++) {
+			int tem = lido != escrito;
+			CONFERE(leAnel(&anel, &item) == tem);
+			if (tem) {
+				CONFERE(item == lido);
+				lido++;
+			}
+		}
+	}
+	while (leAnel(&anel, &item)) {
+		CONFERE(item == lido);
+		lido++;
+	}
+	CONFERE(lido == escrito);
+	CONFERE(escrito > 10 * CAPACIDADE);
+}
+
+static AnelSPSC anelThreads;
+static uint32_t memoriaThreads[CAPACIDADE];
+
+static void *produtor(void *argumento) {
+	(void)argumento;
+	for (uint32_t i = 0; i < ITENS_THREADS; i++) {
+		while (!escreveAnel(&anelThreads, &i))
+			sched_yield(); // Com um só processador, o consumidor precisa rodar para a fila esvaziar
+	}
+	return NULL;
+}
+
+// Um produtor e um consumidor em threads diferentes: nenhum item se perde, repete ou sai de ordem
+static void testaThreads(void) {
+	pthread_t thread;
+	uint32_t item, esperado = 0;
+	int foraDeOrdem = 0;
+
+	inicializaAnel(&anelThreads, memoriaThreads, sizeof(uint32_t), CAPACIDADE);
+	CONFERE(pthread_create(&thread, NULL, produtor, NULL) == 0);
+	while (esperado < ITENS_THREADS) {
+		if (leAnel(&anelThreads, &item)) {
+			foraDeOrdem += item != esperado;
+			esperado++;
+		}
+		else
+			sched_yield();
+	}
+	pthread_join(thread, NULL);
+	CONFERE(foraDeOrdem == 0);
+	CONFERE(!leAnel(&anelThreads, &item));
+}
+
+int main(void) {
+	testaVoltas(0);
+	testaVoltas(UINT32_MAX - 20);
+	testaThreads();
+	return resultadoTeste("anel");
+}
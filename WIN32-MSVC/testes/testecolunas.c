@@ -0,0 +1,124 @@
+/* Standard includes. */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "colunas.h"
+#include "teste.h"
+
+#define ARQUIVO "testecolunas.col"
+#define TICKS_POR_SEGUNDO 12.5 // Simulados, como com --escala=80
+#define BLOCOS (2 * BLOCOS_SEGMENTO + 3)
+#define LINHAS (BLOCOS * LINHAS_BLOCO - 100) // O último bloco fica incompleto
+
+// Linha i, gerada de novo na conferência. Os instantes voltam um pouco de vez em quando, como os da telemetria
+static RegistroTelemetria linhaGerada(long i) {
+	RegistroTelemetria r;
+	memset(&r, 0, sizeof(r));
+	r.instante = (uint32_t)(i / 3 - (i % 17 == 0 ? 2 : 0) + 10);
+	r.veiculo = (int32_t)(100 + (i * 7919) % 5000);
+	r.cruzamento = (uint8_t)(i % 4);
+	r.semaforo = (uint8_t)((i / 4) % 4);
+	r.direcao = (uint8_t)(i % 3);
+	r.tipo = (uint8_t)((i / 2) % 4);
+	r.via = (uint8_t)(i % 11 == 0 ? VIA_NENHUMA : i % 12);
+	return r;
+}
+
+static int mesmaLinha(const RegistroTelemetria *a, const RegistroTelemetria *b) {
+	return a->instante == b->instante && a->veiculo == b->veiculo && a->cruzamento == b->cruzamento
+		&& a->semaforo == b->semaforo && a->direcao == b->direcao && a->tipo == b->tipo && a->via == b->via;
+}
+
+typedef struct {
+	const FiltroTrajetoria *filtro;
+	long proxima; // Próxima linha gerada a considerar
+	long erradas;
+} Conferencia;
+
+static int passaFiltro(const RegistroTelemetria *r, const FiltroTrajetoria *f) {
+	return (f->veiculo < 0 || r->veiculo == f->veiculo) && (f->cruzamento < 0 || r->cruzamento == f->cruzamento)
+		&& (f->evento < 0 || r->tipo == f->evento) && r->instante >= f->instanteInicial && r->instante <= f->instanteFinal;
+}
+
+// Cada linha devolvida tem de ser a próxima linha gerada que passa no filtro
+static void confereLinha(const RegistroTelemetria *linha, void *contexto) {
+	Conferencia *c = contexto;
+	RegistroTelemetria esperada;
+	do {
+		esperada = linhaGerada(c->proxima++);
+	} while (c->proxima <= LINHAS && !passaFiltro(&esperada, c->filtro));
+	c->erradas += !mesmaLinha(linha, &esperada);
+}
+
+static void confereConsulta(ArquivoColunas *colunas, FiltroTrajetoria filtro) {
+	Conferencia c = { &filtro, 0, 0 };
+	long esperadas = 0;
+	for (long i = 0; i < LINHAS; i++) {
+		RegistroTelemetria r = linhaGerada(i);
+		esperadas += passaFiltro(&r, &filtro);
+	}
+	CONFERE(consultaColunas(colunas, &filtro, confereLinha, &c) == esperadas);
+	CONFERE(c.erradas == 0);
+}
+
+// O arquivo fica completo depois de cada bloco, inclusive dos que fecham um segmento do índice
+static void confereBlocos(int blocos) {
+	ArquivoColunas colunas;
+	CONFERE(abreConsultaColunas(&colunas, ARQUIVO));
+	CONFERE(colunas.nBlocos == blocos);
+	fechaConsultaColunas(&colunas);
+}
+
+int main(void) {
+	ArquivoColunas colunas;
+
+	CONFERE(abreColunas(ARQUIVO, TICKS_POR_SEGUNDO));
+	confereBlocos(0);
+	for (long i = 0; i < LINHAS; i++) {
+		RegistroTelemetria r = linhaGerada(i);
+		acrescentaColunas(&r);
+		long linhas = i + 1;
+		if (linhas % LINHAS_BLOCO == 0) {
+			int blocos = (int)(linhas / LINHAS_BLOCO);
+			if (blocos % BLOCOS_SEGMENTO >= BLOCOS_SEGMENTO - 1 || blocos % BLOCOS_SEGMENTO <= 1)
+				confereBlocos(blocos);
+		}
+	}
+	descarregaColunas();
+
+	CONFERE(abreConsultaColunas(&colunas, ARQUIVO));
+	CONFERE(colunas.nBlocos == BLOCOS);
+	CONFERE(colunas.ticksPorSegundo == TICKS_POR_SEGUNDO);
+
+	// Ida e volta de todas as colunas, bloco a bloco
+	static int64_t valores[LINHAS_BLOCO];
+	long linha = 0, erradas = 0;
+	for (int b = 0; b < colunas.nBlocos; b++) {
+		CONFERE(leColunaBloco(&colunas, b, COLUNA_VEICULO, valores));
+		for (uint32_t i = 0; i < colunas.indice[b].nLinhas; i++)
+			erradas += valores[i] != linhaGerada(linha + i).veiculo;
+		CONFERE(leColunaBloco(&colunas, b, COLUNA_INSTANTE, valores));
+		for (uint32_t i = 0; i < colunas.indice[b].nLinhas; i++)
+			erradas += valores[i] != linhaGerada(linha + i).instante;
+		linha += colunas.indice[b].nLinhas;
+	}
+	CONFERE(linha == LINHAS);
+	CONFERE(erradas == 0);
+
+	// Consultas, que usam o índice para descartar blocos, contra a varredura das linhas geradas
+	FiltroTrajetoria todas = { -1, -1, -1, 0, UINT32_MAX };
+	confereConsulta(&colunas, todas);
+	FiltroTrajetoria veiculo = { 1234, -1, -1, 0, UINT32_MAX };
+	confereConsulta(&colunas, veiculo);
+	FiltroTrajetoria intervalo = { -1, 2, TELEMETRIA_VERDE, 80000, 90000 };
+	confereConsulta(&colunas, intervalo);
+	// Um intervalo em volta da fronteira entre o primeiro e o segundo segmento do índice
+	uint32_t fronteira = linhaGerada((long)BLOCOS_SEGMENTO * LINHAS_BLOCO).instante;
+	FiltroTrajetoria fronteiraSegmento = { -1, -1, -1, fronteira - 50, fronteira + 50 };
+	confereConsulta(&colunas, fronteiraSegmento);
+	fechaConsultaColunas(&colunas);
+
+	remove(ARQUIVO);
+	return resultadoTeste("colunas");
+}
@@ -0,0 +1,124 @@
+/* Standard includes. */
+#include <math.h>
+#include <string.h>
+
+#include "dinamica.h"
+#include "teste.h"
+
+#define N_VIAS 64
+#define PASSOS 200
+#define DT 0.1f
+#define TOLERANCIA 1e-2f // m e m/s, depois de PASSOS passos
+
+static DinamicaVia viasAVX2[N_VIAS];
+static DinamicaVia viasEscalar[N_VIAS];
+static unsigned semente = 12345;
+
+static float aleatorio(float minimo, float maximo) {
+	semente = semente * 1103515245u + 12345u;
+	return minimo + (maximo - minimo) * (float)((semente >> 8) & 0xFFFF) / 65535.0f;
+}
+
+// Faixas com 1 a 64 veículos, para passar por todos os tamanhos do último bloco de 8, com e sem linha de parada
+static void montaVias(void) {
+	for (int v = 0; v < N_VIAS; v++) {
+		DinamicaVia *via = &viasAVX2[v];
+		int n = 1 + v % MAX_VEICULOS_VIA;
+		float comprimento = 8.0f * n + aleatorio(20.0f, 200.0f);
+		inicializaDinamicaVia(via, comprimento, aleatorio(8.0f, 16.0f), v % 3 != 0);
+		adicionaFaixa(via, 0.0f, 1u);
+		DinamicaFaixa *faixa = &via->faixas[0];
+		float x = comprimento - aleatorio(0.0f, 10.0f);
+		for (int k = 1; k <= n; k++) {
+			faixa->posicao[k] = x;
+			faixa->velocidade[k] = aleatorio(0.0f, via->velocidadeDesejada);
+			faixa->referencia[k] = &viasAVX2[v];
+			faixa->movimento[k] = 1u;
+			x -= ESPACAMENTO_PARADO + aleatorio(0.0f, 3.0f);
+		}
+		faixa->n = n;
+	}
+	memcpy(viasEscalar, viasAVX2, sizeof(viasAVX2));
+}
+
+static void avanca(DinamicaVia *vias) {
+	for (int p = 0; p < PASSOS; p++) {
+		for (int v = 0; v < N_VIAS; v++)
+			passoDinamicaVia(&vias[v], DT);
+	}
+}
+
+// Os dois núcleos fazem o mesmo cálculo; só o inverso aproximado do AVX2 muda os últimos bits
+static void testaConcordancia(void) {
+	float maiorDiferenca = 0;
+
+	montaVias();
+	if (!inicializaDinamica()) {
+		printf("dinamica: processador sem AVX2, concordância não conferida\n");
+		return;
+	}
+	avanca(viasAVX2);
+	usaNucleoEscalar();
+	avanca(viasEscalar);
+	for (int v = 0; v < N_VIAS; v++) {
+		const DinamicaFaixa *a = &viasAVX2[v].faixas[0], *e = &viasEscalar[v].faixas[0];
+		CONFERE(a->n == e->n);
+		for (int k = 1; k <= a->n && k <= e->n; k++) {
+			maiorDiferenca = fmaxf(maiorDiferenca, fabsf(a->posicao[k] - e->posicao[k]));
+			maiorDiferenca = fmaxf(maiorDiferenca, fabsf(a->velocidade[k] - e->velocidade[k]));
+		}
+	}
+	CONFERE(maiorDiferenca < TOLERANCIA);
+}
+
+// Numa via com linha de parada os veículos param em fila: o primeiro na linha e os outros sem encostar. Eles
+// entram parados, pois a entrada só exige IDM_DISTANCIA_MINIMA livre e quem entra rápido numa fila que já
+// chegou ao início não consegue frear nesse espaço
+static void testaFila(int avx2) {
+	DinamicaVia via;
+
+	if (avx2 && !inicializaDinamica())
+		return;
+	if (!avx2)
+		usaNucleoEscalar();
+	inicializaDinamicaVia(&via, 100.0f, 14.0f, 1);
+	adicionaFaixa(&via, 0.0f, 1u);
+	const DinamicaFaixa *faixa = &via.faixas[0];
+	for (int i = 0; i < 1200; i++) {
+		if (i % 20 == 0 && faixa->n < capacidadeVia(&via))
+			insereVeiculoVia(&via, &via, 0.0f, 1u);
+		passoDinamicaVia(&via, DT);
+	}
+	CONFERE(faixa->n == capacidadeVia(&via));
+	CONFERE(fabsf(faixa->posicao[1] - via.comprimento) < 0.5f);
+	for (int k = 1; k <= faixa->n; k++) {
+		CONFERE(faixa->velocidade[k] < 0.1f);
+		if (k > 1)
+			CONFERE(faixa->posicao[k - 1] - faixa->posicao[k] >= COMPRIMENTO_VEICULO + IDM_DISTANCIA_MINIMA * 0.5f);
+	}
+}
+
+// Não entra ninguém enquanto o último veículo ainda está junto ao início da faixa
+static void testaEntrada(void) {
+	DinamicaVia via;
+	int a, b;
+
+	inicializaDinamicaVia(&via, 100.0f, 14.0f, 1);
+	adicionaFaixa(&via, 0.0f, 1u);
+	CONFERE(insereVeiculoVia(&via, &a, 0.0f, 1u));
+	CONFERE(!insereVeiculoVia(&via, &b, 0.0f, 1u));
+	for (int i = 0; i < 50; i++)
+		passoDinamicaVia(&via, DT);
+	CONFERE(insereVeiculoVia(&via, &b, 0.0f, 1u));
+	CONFERE(!removePrimeiroVia(&via, &b)); // Só o primeiro da faixa sai
+	CONFERE(removePrimeiroVia(&via, &a));
+	CONFERE(removePrimeiroVia(&via, &b));
+}
+
+int main(void) {
+	testaConcordancia();
+	testaFila(1);
+	testaFila(0);
+	testaEntrada();
+	return resultadoTeste("dinamica");
+}
@@ -0,0 +1,148 @@
+/* Standard includes. */
+#include <string.h>
+
+#include "fragmentos.h"
+#include "teste.h"
+
+#define DT 0.05f
+#define N_VIAS 8
+#define VEICULOS 12
+
+static DinamicaVia vias[N_VIAS];
+static int referencias[N_VIAS][VEICULOS];
+
+static void montaVias(int nVias, float comprimento, int linhaParada) {
+	for (int v = 0; v < nVias; v++) {
+		inicializaDinamicaVia(&vias[v], comprimento, 10.0f, linhaParada);
+		adicionaFaixa(&vias[v], 0.0f, 1u);
+	}
+}
+
+static void entra(int via, void *referencia) {
+	PedidoVia pedido = { ENTRA_VIA, referencia, 5.0f, 1u };
+	CONFERE(enviaPedidoVia(via, &pedido));
+}
+
+static void sai(int via, void *referencia) {
+	PedidoVia pedido = { SAI_VIA, referencia, 0.0f, 0u };
+	CONFERE(enviaPedidoVia(via, &pedido));
+}
+
+// Nenhum par de veículos da faixa mais perto que o comprimento de um veículo
+static int sobreposicoes(const DinamicaVia *via) {
+	const DinamicaFaixa *faixa = &via->faixas[0];
+	int n = 0;
+	for (int k = 2; k <= faixa->n; k++)
+		n += faixa->posicao[k - 1] - faixa->posicao[k] < COMPRIMENTO_VEICULO - 1e-3f;
+	return n;
+}
+
+// Entradas pedidas no mesmo passo numa via que só recebe um veículo por vez: as que não cabem ficam adiadas
+// e entram depois, na ordem dos pedidos, e chegam à linha de parada nessa ordem. Cada uma sai ao chegar
+static void testaOrdemAdiados(void) {
+	int ordem[VEICULOS], nChegadas = 0, sobrepostos = 0;
+	EventoVia evento;
+	int dono[1] = { 0 }, saida[1] = { 0 };
+
+	montaVias(1, 60.0f, 1);
+	inicializaFragmentos(vias, dono, saida, 1, 0);
+	for (int i = 0; i < VEICULOS; i++)
+		entra(0, &referencias[0][i]);
+	for (int passo = 0; passo < 4000 && nChegadas < VEICULOS; passo++) {
+		executaPassoFragmentos(DT);
+		sobrepostos += sobreposicoes(&vias[0]);
+		while (recebeEventoVia(&evento)) {
+			if (evento.tipo != CHEGOU_PARADA)
+				continue;
+			int i = (int)((int*)evento.referencia - referencias[0]);
+			if (nChegadas == 0 || ordem[nChegadas - 1] != i) {
+				ordem[nChegadas++] = i;
+				sai(0, evento.referencia);
+			}
+		}
+	}
+	CONFERE(nChegadas == VEICULOS);
+	for (int i = 0; i < nChegadas; i++)
+		CONFERE(ordem[i] == i);
+	CONFERE(sobrepostos == 0);
+}
+
+// A saída de um veículo cuja entrada ainda está adiada cancela a entrada, e a saída de quem ainda não é o
+// primeiro da faixa espera até ele ser
+static void testaSaidas(void) {
+	int a, b, c;
+	int dono[1] = { 0 }, saida[1] = { 0 };
+	const DinamicaFaixa *faixa = &vias[0].faixas[0];
+
+	montaVias(1, 60.0f, 1);
+	inicializaFragmentos(vias, dono, saida, 1, 0);
+	entra(0, &a);
+	entra(0, &b); // Adiada: a ainda está junto ao início
+	sai(0, &b);   // Cancela a entrada de b
+	executaPassoFragmentos(DT);
+	CONFERE(faixa->n == 1 && faixa->referencia[1] == &a);
+	for (int passo = 0; passo < 40; passo++)
+		executaPassoFragmentos(DT);
+	CONFERE(faixa->n == 1);
+
+	entra(0, &c);
+	sai(0, &c); // c não é o primeiro: a saída fica adiada até a sair
+	for (int passo = 0; passo < 10; passo++)
+		executaPassoFragmentos(DT);
+	CONFERE(faixa->n == 2);
+	sai(0, &a);
+	executaPassoFragmentos(DT); // Os adiados são tentados antes dos pedidos novos: c só sai no passo seguinte
+	CONFERE(faixa->n == 1 && faixa->referencia[1] == &c);
+	executaPassoFragmentos(DT);
+	CONFERE(faixa->n == 0);
+}
+
+// Várias vias em quatro fragmentos: com trabalhadores que roubam vias uns dos outros, o resultado é o mesmo
+// de quando tudo roda na thread de quem chama, pois nenhuma via depende de outra durante um passo
+static void rodaMalha(int threads, DinamicaVia *resultado, long *saidas) {
+	int dono[N_VIAS], saida[N_VIAS];
+	EventoVia evento;
+
+	for (int v = 0; v < N_VIAS; v++) {
+		dono[v] = v % MAX_FRAGMENTOS;
+		saida[v] = v % 2;
+	}
+	montaVias(N_VIAS, 80.0f, 0);
+	for (int v = 0; v < N_VIAS; v += 2)
+		vias[v].linhaParada = vias[v].faixas[0].linhaParada = 1;
+	CONFERE(inicializaFragmentos(vias, dono, saida, N_VIAS, threads));
+	*saidas = 0;
+	for (int passo = 0; passo < 600; passo++) {
+		if (passo % 40 == 0 && passo / 40 < VEICULOS) {
+			for (int v = 0; v < N_VIAS; v++)
+				entra(v, &referencias[v][passo / 40]);
+		}
+		executaPassoFragmentos(DT);
+		while (recebeEventoVia(&evento))
+			*saidas += evento.tipo == DEIXOU_MALHA;
+	}
+	memcpy(resultado, vias, sizeof(vias));
+}
+
+static void testaTrabalhadores(void) {
+	static DinamicaVia sozinho[N_VIAS], comThreads[N_VIAS];
+	long saidasSozinho, saidasThreads;
+
+	rodaMalha(0, sozinho, &saidasSozinho);
+	rodaMalha(3, comThreads, &saidasThreads);
+	CONFERE(saidasSozinho > 0);
+	CONFERE(saidasSozinho == saidasThreads);
+	for (int v = 0; v < N_VIAS; v++) {
+		const DinamicaFaixa *a = &sozinho[v].faixas[0], *b = &comThreads[v].faixas[0];
+		CONFERE(a->n == b->n);
+		CONFERE(memcmp(a->posicao, b->posicao, (1 + a->n) * sizeof(float)) == 0);
+	}
+}
+
+int main(void) {
+	inicializaDinamica();
+	testaOrdemAdiados();
+	testaSaidas();
+	testaTrabalhadores();
+	return resultadoTeste("fragmentos");
+}
@@ -0,0 +1,52 @@
+/* Standard includes. */
+#include <string.h>
+#include <pthread.h>
+
+#include "histograma.h"
+#include "teste.h"
+
+#define THREADS 4
+#define POR_THREAD 100000
+
+static Histograma histograma;
+
+static void *registra(void *argumento) {
+	(void)argumento;
+	for (int i = 1; i <= POR_THREAD; i++)
+		registraHistograma(&histograma, (unsigned long long)i);
+	return NULL;
+}
+
+int main(void) {
+	pthread_t threads[THREADS];
+
+	// Valores pequenos são exatos
+	memset(&histograma, 0, sizeof(histograma));
+	for (int v = 1; v <= 100; v++)
+		registraHistograma(&histograma, v);
+	CONFERE(percentilHistograma(&histograma, 50.0) == 50);
+	CONFERE(percentilHistograma(&histograma, 100.0) == 100);
+	CONFERE(maximoHistograma(&histograma) == 100);
+
+	// Registros de várias threads ao mesmo tempo: nenhum se perde, e os percentis ficam dentro do erro
+	// relativo de 2^-(BITS_PRECISAO-1)
+	memset(&histograma, 0, sizeof(histograma));
+	for (int t = 0; t < THREADS; t++)
+		CONFERE(pthread_create(&threads[t], NULL, registra, NULL) == 0);
+	for (int t = 0; t < THREADS; t++)
+		pthread_join(threads[t], NULL);
+	CONFERE(totalHistograma(&histograma) == (long long)THREADS * POR_THREAD);
+	CONFERE(maximoHistograma(&histograma) == POR_THREAD);
+	const double percentis[] = { 1.0, 50.0, 90.0, 99.0, 99.9 };
+	for (size_t k = 0; k < sizeof(percentis) / sizeof(percentis[0]); k++) {
+		double exato = percentis[k] / 100.0 * POR_THREAD;
+		double estimado = (double)percentilHistograma(&histograma, percentis[k]);
+		CONFERE(estimado >= exato - 1.0);
+		CONFERE(estimado <= exato * (1.0 + 1.0 / (1 << (BITS_PRECISAO - 1))) + 1.0);
+	}
+
+	// Valores acima de 2^BITS_VALOR vão para a última faixa, e o máximo continua exato
+	registraHistograma(&histograma, 1ull << (BITS_VALOR + 2));
+	CONFERE(maximoHistograma(&histograma) == 1ull << (BITS_VALOR + 2));
+	return resultadoTeste("histograma");
+}
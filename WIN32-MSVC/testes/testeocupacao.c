@@ -0,0 +1,62 @@
+/* Standard includes. */
+#include <string.h>
+
+#include "ocupacao.h"
+#include "teste.h"
+
+static int referencia[LINHAS_MALHA][COLUNAS_MALHA];
+
+// Contagem célula a célula, para comparar com a varredura por palavras
+static int livresReferencia(int lin, int col, int passoLin, int passoCol, int fim) {
+	int n = 0;
+	while (!referencia[lin][col]) {
+		n++;
+		if ((passoCol != 0 ? col : lin) == fim)
+			break;
+		lin += passoLin;
+		col += passoCol;
+	}
+	return n;
+}
+
+int main(void) {
+	unsigned semente = 1;
+	int erradas = 0;
+
+	inicializaOcupacao();
+	memset(referencia, 0, sizeof(referencia));
+	CONFERE(ocupaCelula(3, 31));
+	CONFERE(!ocupaCelula(3, 31)); // Já ocupada
+	CONFERE(celulaOcupada(3, 31));
+	liberaCelula(3, 31);
+	CONFERE(!celulaOcupada(3, 31));
+	CONFERE(ocupaCelula(3, 31));
+	liberaCelula(3, 31);
+
+	// Mapas aleatórios, com as fronteiras das palavras de 32 bits no meio das linhas
+	for (int rodada = 0; rodada < 200; rodada++) {
+		for (int i = 0; i < 40; i++) {
+			semente = semente * 1103515245u + 12345u;
+			int lin = (semente >> 8) % LINHAS_MALHA, col = (semente >> 16) % COLUNAS_MALHA;
+			if (referencia[lin][col]) {
+				liberaCelula(lin, col);
+				referencia[lin][col] = 0;
+			}
+			else {
+				CONFERE(ocupaCelula(lin, col));
+				referencia[lin][col] = 1;
+			}
+		}
+		for (int lin = 0; lin < LINHAS_MALHA; lin++) {
+			for (int col = 0; col < COLUNAS_MALHA; col++) {
+				erradas += celulaOcupada(lin, col) != referencia[lin][col];
+				erradas += livresNaLinha(lin, col, COLUNAS_MALHA - 1) != livresReferencia(lin, col, 0, 1, COLUNAS_MALHA - 1);
+				erradas += livresNaLinha(lin, col, 0) != livresReferencia(lin, col, 0, -1, 0);
+				erradas += livresNaColuna(col, lin, LINHAS_MALHA - 1) != livresReferencia(lin, col, 1, 0, LINHAS_MALHA - 1);
+				erradas += livresNaColuna(col, lin, 0) != livresReferencia(lin, col, -1, 0, 0);
+			}
+		}
+	}
+	CONFERE(erradas == 0);
+	return resultadoTeste("ocupacao");
+}
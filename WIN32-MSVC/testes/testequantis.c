@@ -0,0 +1,83 @@
+/* Standard includes. */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "quantis.h"
+#include "teste.h"
+
+#define VALORES 100000
+
+static ResumoQuantis inteiro, metades[2], juntos, lidos[2];
+
+// Valores de uma exponencial de média 60, como tempos de viagem
+static double valor(long i) {
+	return -60.0 * log(1.0 - (i * 0.6180339887 - floor(i * 0.6180339887)));
+}
+
+static int comparaDouble(const void *a, const void *b) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+// Erro do quantil estimado em posição (quantil verdadeiro do valor estimado menos q)
+static double erroPosicao(const double *ordenados, double estimado, double q) {
+	long abaixo = 0, acima = VALORES;
+	while (abaixo < acima) {
+		long meio = (abaixo + acima) / 2;
+		if (ordenados[meio] < estimado)
+			abaixo = meio + 1;
+		else
+			acima = meio;
+	}
+	return fabs((double)abaixo / VALORES - q);
+}
+
+int main(void) {
+	static double ordenados[VALORES];
+	const double qs[] = { 0.01, 0.5, 0.9, 0.99, 0.999 };
+
+	iniciaResumo(&inteiro);
+	iniciaResumo(&metades[0]);
+	iniciaResumo(&metades[1]);
+	iniciaResumo(&juntos);
+	for (long i = 0; i < VALORES; i++) {
+		ordenados[i] = valor(i);
+		registraResumo(&inteiro, ordenados[i]);
+		registraResumo(&metades[i % 2], ordenados[i]);
+	}
+	registraResumo(&inteiro, NAN); // Ignorado
+	qsort(ordenados, VALORES, sizeof(double), comparaDouble);
+
+	juntaResumos(&juntos, &metades[0]);
+	juntaResumos(&juntos, &metades[1]);
+	CONFERE(inteiro.total == VALORES);
+	CONFERE(juntos.total == VALORES);
+	CONFERE(quantilResumo(&inteiro, 0.0) == ordenados[0]);
+	CONFERE(quantilResumo(&inteiro, 1.0) == ordenados[VALORES - 1]);
+	for (size_t k = 0; k < sizeof(qs) / sizeof(qs[0]); k++) {
+		// O t-digest é mais preciso nas caudas: a tolerância em posição cai junto com q(1 - q)
+		double tolerancia = 0.002 + 0.04 * qs[k] * (1.0 - qs[k]);
+		CONFERE(erroPosicao(ordenados, quantilResumo(&inteiro, qs[k]), qs[k]) < tolerancia);
+		CONFERE(erroPosicao(ordenados, quantilResumo(&juntos, qs[k]), qs[k]) < tolerancia);
+	}
+
+	// Ida e volta pelo arquivo: juntar o arquivo a resumos vazios dá os mesmos quantis
+	FILE *arquivo = tmpfile();
+	CONFERE(arquivo != NULL);
+	if (arquivo != NULL) {
+		CONFERE(gravaResumos(arquivo, metades, 2));
+		rewind(arquivo);
+		iniciaResumo(&lidos[0]);
+		iniciaResumo(&lidos[1]);
+		CONFERE(juntaArquivoResumos(arquivo, lidos, 2));
+		for (int r = 0; r < 2; r++) {
+			CONFERE(lidos[r].total == metades[r].total);
+			CONFERE(quantilResumo(&lidos[r], 0.9) == quantilResumo(&metades[r], 0.9));
+		}
+		rewind(arquivo);
+		CONFERE(!juntaArquivoResumos(arquivo, lidos, 1)); // Outro número de resumos
+		fclose(arquivo);
+	}
+	return resultadoTeste("quantis");
+}
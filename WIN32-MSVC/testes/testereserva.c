@@ -0,0 +1,42 @@
+/* Standard includes. */
+#include <stdint.h>
+
+#include "reserva.h"
+#include "teste.h"
+
+int main(void) {
+	TabelaReserva tabela;
+	uint64_t norte[3] = { 0x1, 0x2, 0x4 };
+	uint64_t leste[3] = { 0x8, 0x2, 0x10 }; // Cruza com norte se começar no mesmo intervalo
+	uint64_t compativel[3] = { 0x100, 0x200, 0x400 };
+	uint64_t conflitante[2] = { 0x20, 0x2 };
+	uint64_t longo[INTERVALOS_RESERVA + 1] = { 0 };
+
+	// O início de cada pedido é o intervalo atual, então os pedidos vêm em ordem de início
+	inicializaTabelaReserva(&tabela, 1000);
+	CONFERE(reservaCelulas(&tabela, 1000, norte, 3));
+	CONFERE(!reservaCelulas(&tabela, 1000, leste, 3));
+	CONFERE(reservaCelulas(&tabela, 1000, compativel, 3));
+	CONFERE(reservaCelulas(&tabela, 1001, leste, 3));
+	// Pedido recusado não deixa nenhuma célula reservada
+	CONFERE(!reservaCelulas(&tabela, 1001, conflitante, 2));
+	CONFERE(reservaCelulas(&tabela, 1001, conflitante, 1));
+	CONFERE(!reservaCelulas(&tabela, 1000, norte, 1)); // Já passou
+
+	// As posições dos intervalos passados voltam a valer para o fim do horizonte: 1064 usa a posição de 1000
+	longo[1] = 0x10;
+	longo[62] = 0x1;
+	CONFERE(!reservaCelulas(&tabela, 1002, longo, INTERVALOS_RESERVA)); // 0x10 ainda está em 1003
+	longo[1] = 0;
+	CONFERE(reservaCelulas(&tabela, 1002, longo, INTERVALOS_RESERVA));
+	CONFERE(!reservaCelulas(&tabela, 1002, longo, INTERVALOS_RESERVA + 1));
+
+	// Contador de intervalos dando a volta nos 32 bits
+	inicializaTabelaReserva(&tabela, UINT32_MAX - 1);
+	CONFERE(reservaCelulas(&tabela, UINT32_MAX - 1, norte, 3));
+	CONFERE(!reservaCelulas(&tabela, UINT32_MAX, norte + 1, 1));
+	CONFERE(!reservaCelulas(&tabela, 0, norte + 2, 1));
+	CONFERE(reservaCelulas(&tabela, 0, norte + 1, 1));
+	CONFERE(!reservaCelulas(&tabela, UINT32_MAX, compativel, 1)); // Já passou
+	return resultadoTeste("reserva");
+}
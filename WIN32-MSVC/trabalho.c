@@ -0,0 +1,140 @@
+/* Standard includes. */
+#include <string.h>
+#include <windows.h>
+
+#include "trabalho.h"
+
+// Deque de Chase-Lev de tamanho fixo. topo só cresce (roubos e a disputa pelo último trabalho, ambos por
+// CAS); fundo só é escrito pela dona
+typedef struct {
+	volatile LONG topo;
+	char folgaTopo[60];
+	volatile LONG fundo;
+	char folgaFundo[60];
+	Trabalho trabalhos[CAPACIDADE_DEQUE];
+} Deque;
+
+static Deque deques[MAX_TRABALHADORES];
+static HANDLE inicioTrabalhador[MAX_TRABALHADORES];
+static HANDLE passoConcluido;
+static volatile LONG trabalhosPendentes;
+static volatile LONG trabalhadoresOcupados;
+static int nTrabalhadores;
+
+static int empilha(Deque *deque, Trabalho trabalho) {
+	LONG fundo = deque->fundo;
+	if (fundo - deque->topo >= CAPACIDADE_DEQUE)
+		return 0;
+	deque->trabalhos[fundo & (CAPACIDADE_DEQUE - 1)] = trabalho;
+	MemoryBarrier();
+	deque->fundo = fundo + 1;
+	return 1;
+}
+
+// Dona: retira do fundo. Só disputa com os ladrões quando resta um único trabalho
+static int retiraProprio(Deque *deque, Trabalho *trabalho) {
+	LONG fundo = deque->fundo - 1;
+	InterlockedExchange(&deque->fundo, fundo); // Publica o novo fundo antes de ler o topo
+	LONG topo = deque->topo;
+	if (topo > fundo) { // Vazio
+		deque->fundo = topo;
+		return 0;
+	}
+	*trabalho = deque->trabalhos[fundo & (CAPACIDADE_DEQUE - 1)];
+	if (topo < fundo)
+		return 1;
+	// Último trabalho: quem avançar o topo primeiro fica com ele
+	int ganhou = InterlockedCompareExchange(&deque->topo, topo + 1, topo) == topo;
+	deque->fundo = topo + 1;
+	return ganhou;
+}
+
+// Ladrão: retira do topo
+static int rouba(Deque *deque, Trabalho *trabalho) {
+	LONG topo = deque->topo;
+	MemoryBarrier();
+	LONG fundo = deque->fundo;
+	if (topo >= fundo)
+		return 0;
+	*trabalho = deque->trabalhos[topo & (CAPACIDADE_DEQUE - 1)];
+	return InterlockedCompareExchange(&deque->topo, topo + 1, topo) == topo;
+}
+
+static void concluiTrabalho(Trabalho *trabalho) {
+	trabalho->executa(trabalho->argumento);
+	InterlockedDecrement(&trabalhosPendentes);
+}
+
+// Cada trabalhador esvazia o próprio deque e depois rouba dos outros, começando pelo vizinho, até não
+// restar trabalho pendente. O último a parar avisa o coordenador; só então os deques podem receber o
+// próximo passo
+static DWORD WINAPI threadTrabalhador(LPVOID parametro) {
+	int eu = (int)(intptr_t)parametro;
+	Trabalho trabalho;
+
+	while (1) {
+		WaitForSingleObject(inicioTrabalhador[eu], INFINITE);
+		while (trabalhosPendentes > 0) {
+			if (retiraProprio(&deques[eu], &trabalho)) {
+				concluiTrabalho(&trabalho);
+				continue;
+			}
+			int roubou = 0;
+			for (int i = 1; i < nTrabalhadores && !roubou; i++)
+				roubou = rouba(&deques[(eu + i) % nTrabalhadores], &trabalho);
+			if (roubou)
+				concluiTrabalho(&trabalho);
+			else
+				YieldProcessor();
+		}
+		if (InterlockedDecrement(&trabalhadoresOcupados) == 0)
+			SetEvent(passoConcluido);
+	}
+	return 0;
+}
+
+int inicializaTrabalhadores(int n) {
+	memset((void*)deques, 0, sizeof(deques));
+	nTrabalhadores = n < MAX_TRABALHADORES ? n : MAX_TRABALHADORES;
+	if (nTrabalhadores <= 0) {
+		nTrabalhadores = 0;
+		return 1;
+	}
+	passoConcluido = CreateEvent(NULL, FALSE, FALSE, NULL);
+	for (int t = 0; t < nTrabalhadores; t++) {
+		inicioTrabalhador[t] = CreateEvent(NULL, FALSE, FALSE, NULL);
+		if (inicioTrabalhador[t] == NULL || CreateThread(NULL, 0, threadTrabalhador, (LPVOID)(intptr_t)t, 0, NULL) == NULL) {
+			nTrabalhadores = 0; // As threads já criadas ficam paradas esperando um início que não vem
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int numeroTrabalhadores(void) {
+	return nTrabalhadores;
+}
+
+int adicionaTrabalho(int trabalhador, Trabalho trabalho) {
+	Deque *deque = &deques[nTrabalhadores > 0 ? trabalhador % nTrabalhadores : 0];
+	if (!empilha(deque, trabalho))
+		return 0;
+	InterlockedIncrement(&trabalhosPendentes);
+	return 1;
+}
+
+void executaTrabalhos(void) {
+	Trabalho trabalho;
+
+	if (nTrabalhadores == 0) {
+		while (retiraProprio(&deques[0], &trabalho))
+			concluiTrabalho(&trabalho);
+		return;
+	}
+	if (trabalhosPendentes == 0)
+		return;
+	trabalhadoresOcupados = nTrabalhadores;
+	for (int t = 0; t < nTrabalhadores; t++)
+		SetEvent(inicioTrabalhador[t]);
+	WaitForSingleObject(passoConcluido, INFINITE);
+}
@@ -0,0 +1,32 @@
+#ifndef TRABALHO_H
+#define TRABALHO_H
+
+// Conjunto de threads nativas que executam trabalhos curtos com roubo de trabalho. Cada thread tem um deque
+// próprio (Chase-Lev): a dona retira do fundo, na ordem inversa em que os trabalhos entraram, e as outras,
+// quando ficam sem trabalho, roubam do topo. Assim uma thread ociosa ajuda a mais carregada e o tempo de um
+// passo acompanha o trabalho total, não o do trabalhador mais carregado.
+// Os trabalhos de um passo são todos adicionados antes de executaTrabalhos, por uma única thread coordenadora.
+// Este módulo não usa a API do FreeRTOS.
+
+#define MAX_TRABALHADORES 16
+#define CAPACIDADE_DEQUE 64 // Trabalhos por trabalhador em um passo. Potência de 2
+
+typedef struct {
+	void (*executa)(void *argumento);
+	void *argumento;
+} Trabalho;
+
+// Cria nTrabalhadores threads. Com 0, executaTrabalhos roda os trabalhos na thread de quem chama.
+// Retorna 0 se não conseguiu criar as threads
+int inicializaTrabalhadores(int nTrabalhadores);
+
+int numeroTrabalhadores(void);
+
+// Coloca um trabalho no deque do trabalhador indicado (de preferência o que já tem os dados em cache).
+// Retorna 0 se o deque está cheio
+int adicionaTrabalho(int trabalhador, Trabalho trabalho);
+
+// Executa todos os trabalhos adicionados e só retorna quando todos terminaram
+void executaTrabalhos(void);
+
+#endif /* TRABALHO_H */